@@ -0,0 +1,60 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+#include "../include/arena.h"
+#include "../include/channel.h"
+
+typedef enum {
+    AGGREGATE_RAW,                   // Every sample is posted (one per measurement interval)
+    AGGREGATE_WINDOW,                // Sample fast, post one summary per channel per interval
+    AGGREGATE_DEADBAND,              // Sample fast, post a sample only when it moved enough
+} aggregation_mode_t;
+
+// Build-time defaults, e.g. make CFLAGS="-DDEFAULT_AGGREGATION=AGGREGATE_WINDOW"
+#ifndef DEFAULT_AGGREGATION
+#define DEFAULT_AGGREGATION AGGREGATE_RAW
+#endif
+#ifndef SAMPLE_INTERVAL_MS
+#define SAMPLE_INTERVAL_MS 1000      // Sampling period in window and deadband mode
+#endif
+#ifndef DEADBAND_DEFAULT
+#define DEADBAND_DEFAULT 0.5         // Change from the last posted value that posts again
+#endif
+
+
+// Streaming summary of one channel over a window, O(1) memory (Welford's mean/variance)
+typedef struct {
+    uint32_t count;
+    double min;
+    double max;
+    double mean;
+    double m2;                       // Sum of squared distances from the mean
+    int64_t first_ms;                // Epoch ms of the first and last sample
+    int64_t last_ms;
+} aggregate_t;
+
+typedef struct {
+    aggregation_mode_t mode;
+    double deadband;
+    uint64_t window_start;           // Monotonic ms the current window opened
+    int max_channels;
+    aggregate_t* windows;            // One per channel
+    double* last_sent;               // Deadband: value last posted per channel
+    uint64_t* last_sent_at;          // Deadband: monotonic ms it was posted, 0 = never
+} aggregator_t;
+
+
+void Aggregate_Reset(aggregate_t* window);
+void Aggregate_Add(aggregate_t* window, int64_t epoch_ms, double value);
+double Aggregate_Stddev(const aggregate_t* window);
+
+int Aggregator_Init(aggregator_t* aggregator, arena_t* arena, int max_channels,
+                    aggregation_mode_t mode, double deadband, uint64_t now);
+void Aggregator_Add_Rows(aggregator_t* aggregator, const channel_set_t* channels);
+void Aggregator_Reset_Windows(aggregator_t* aggregator, uint64_t now);
+int Aggregator_Deadband(aggregator_t* aggregator, int channel, double value, uint64_t now, uint64_t heartbeat_ms);
+
+const char* Aggregation_Name(aggregation_mode_t mode);
+
+#endif // AGGREGATE_H
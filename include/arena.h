@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16
+
+// Bump allocator over one block taken from the heap at startup.
+// Long-lived buffers are carved first, then Arena_Mark() records where the
+// per-cycle region starts and Arena_Reset() drops everything after it in O(1).
+typedef struct {
+    char* base;
+    size_t size;
+    size_t used;
+    size_t peak;                  // Highest used seen, to size the arena
+} arena_t;
+
+int Arena_Init(arena_t* arena, size_t size);
+void* Arena_Alloc(arena_t* arena, size_t size);
+size_t Arena_Mark(const arena_t* arena);
+void Arena_Reset(arena_t* arena, size_t mark);
+void Arena_Free(arena_t* arena);
+
+// Heap calls made by our own code, counted when built with -DHEAP_COUNT and
+// linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+// (make heapcheck). Always 0 otherwise.
+unsigned long Heap_Calls(void);
+
+#endif // ARENA_H
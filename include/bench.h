@@ -0,0 +1,33 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#define BENCH_READINGS 100000        // Readings encoded per backend
+
+#define BENCH_CHANNELS 1000          // Channel benchmark: channels sampled per tick
+#define BENCH_CHANNEL_HZ 10          // Ticks per second
+#define BENCH_CHANNEL_SECONDS 60     // Simulated run time
+#define BENCH_WINDOW_SECONDS 10      // Aggregation window of the aggregation benchmark
+
+// Pipeline benchmark (--bench pipeline): the real task against a local stand-in server
+#define BENCH_PIPELINE_HOURS 6       // Simulated run time
+#define BENCH_PIPELINE_INTERVAL 10   // Seconds between readings
+#define BENCH_PIPELINE_LATENCY_MS 20 // Stand-in answer delay
+#define BENCH_PIPELINE_READINGS 30000  // --source max stops after this many readings
+#define BENCH_PIPELINE_SEED 1
+#define BENCH_STORE_FILE "bin/bench_backlog.dat"   // Own backlog, the node's is left alone
+#define BENCH_REPLAY_ROWS_MAX 100000 // Rows read from a --source replay file
+#define BENCH_START_EPOCH_MS 1700000000000LL   // Virtual wall clock at the start of a run
+
+// Gateway benchmark (--bench gateway): simulated nodes sending to the gateway over UDP
+#define BENCH_GATEWAY_READINGS 200000
+#define BENCH_GATEWAY_NODES 200
+#define BENCH_GATEWAY_RATE 10000       // Readings per second, all nodes together
+#define BENCH_GATEWAY_DUPLICATES 0.05  // Share of datagrams a node sends twice
+
+// Recovery check (--bench recovery): crashes at known points, the backlog reopened after each
+#define BENCH_RECOVERY_CAPACITY 64   // Slots of the check's own ring file
+#define BENCH_RECOVERY_GROUP 8       // commit_records during the check
+
+int Run_Benchmarks(int argc, char** argv);
+
+#endif // BENCH_H
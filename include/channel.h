@@ -0,0 +1,84 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdint.h>
+#include "../include/arena.h"
+
+#define CHANNEL_ID_MAX 64            // Same limit as a frame sensor id
+#define CHANNEL_ROWS 64              // Samples kept per channel between uploads
+#define CHANNEL_DEFAULT_MAX 8        // Channels the sensor task makes room for
+
+
+typedef enum {
+    CHANNEL_TEMPERATURE,             // °C
+    CHANNEL_HUMIDITY,                // %RH
+    CHANNEL_PRESSURE,                // hPa
+} channel_kind_t;
+
+typedef struct {
+    char id[CHANNEL_ID_MAX + 1];     // Sent as sensor_id
+    channel_kind_t kind;
+    double level;                    // Simulated source: slowly drifting base value
+    double min;                      // Plausible range - the simulated level restarts outside it
+    double max;
+} channel_t;
+
+/*
+ * Where sampled values come from. Without one the channels simulate a slowly
+ * drifting signal from a seeded PRNG - the same seed gives the same readings.
+ * sample() is called once per channel per row, index is the channel's position.
+ */
+typedef struct {
+    const char* name;
+    double (*sample)(void* state, const channel_t* channel, int index, int64_t epoch_ms);
+    void* state;
+} channel_source_t;
+
+extern const channel_source_t channel_source_synthetic;   // Cheap ramp, no randomness - for max-rate runs
+
+/*
+ * Channel registry with a columnar (struct-of-arrays) ring of samples.
+ *
+ * One row is one sampling instant: timestamps[row] plus one value per channel.
+ * Values are stored a column per channel, values[channel * rows + row], so a
+ * window of one channel is a contiguous run the encoders serialize in one go.
+ *
+ *   row sequence:   head ............ tail
+ *   timestamps:     [ t0 | t1 | t2 | ... ]
+ *   channel 0:      [ v  | v  | v  | ... ]
+ *   channel 1:      [ v  | v  | v  | ... ]
+ *
+ * Everything is carved from an arena once - sampling never allocates.
+ * A full ring drops its oldest row.
+ */
+typedef struct {
+    channel_t* channels;
+    int count;
+    int max_channels;
+    uint32_t rows;                   // Ring capacity in rows
+    uint64_t head;                   // Sequence number of the oldest row kept
+    uint64_t tail;                   // Sequence number the next row gets
+    uint64_t dropped;                // Rows lost because nobody consumed them
+    uint64_t random;                 // PRNG state of the simulated signal
+    channel_source_t source;         // sample == NULL: simulated signal
+    int64_t* timestamps;             // rows x epoch ms
+    double* values;                  // max_channels x rows
+} channel_set_t;
+
+
+int Channel_Set_Init(channel_set_t* set, arena_t* arena, int max_channels, uint32_t rows);
+int Channel_Add(channel_set_t* set, const char* id, channel_kind_t kind);
+int Channel_Configure(channel_set_t* set, int channel, const char* id, double min, double max);
+void Channel_Seed(channel_set_t* set, uint64_t seed);
+void Channel_Set_Source(channel_set_t* set, const channel_source_t* source);
+int Channel_Sample_All(channel_set_t* set, int64_t epoch_ms);
+
+uint32_t Channel_Pending(const channel_set_t* set);
+int Channel_Window(const channel_set_t* set, int channel, uint32_t first, uint32_t count,
+                   const int64_t** timestamps, const double** values);
+void Channel_Consume(channel_set_t* set, uint32_t count);
+
+const char* Channel_Quantity(channel_kind_t kind);
+const char* Channel_Unit(channel_kind_t kind);
+
+#endif // CHANNEL_H
@@ -0,0 +1,21 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/*
+ * The one source of time for the node. Normally CLOCK_MONOTONIC for deadlines
+ * and CLOCK_REALTIME for reading timestamps. The benchmark harness switches it
+ * to a virtual clock that only moves when Clock_Advance() is called: the
+ * scheduler jumps straight to the next deadline instead of sleeping, so hours
+ * of operation run in seconds with every timer behaving as it would live.
+ */
+uint64_t Clock_Now_Us(void);
+uint64_t Clock_Now_Ms(void);
+int64_t Clock_Wall_Ms(void);
+
+void Clock_Use_Virtual(uint64_t start_us, int64_t wall_ms);
+int Clock_Is_Virtual(void);
+void Clock_Advance(uint64_t to_us);
+
+#endif // CLOCK_H
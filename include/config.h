@@ -0,0 +1,86 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include "../include/tcp.h"
+#include "../include/encode.h"
+#include "../include/aggregate.h"
+#include "../include/retention.h"
+
+#define CONFIG_FILE "bin/config.txt"
+#define CONFIG_MAX_SIZE 4096         // The file is read into a stack buffer - no heap on reload
+#define CONFIG_PATH_MAX 256
+
+// Used for every key the file leaves out
+#define DEFAULT_SERVER_HOST "httpbin.org"
+#define DEFAULT_SERVER_PORT 80
+#define DEFAULT_MEASUREMENT_INTERVAL 30  // seconds
+#define DEFAULT_CONNECTION_TIMEOUT 5     // seconds, per HTTP phase
+#define DEFAULT_BACKUP_FILE "bin/saved_temp.txt"
+#define DEFAULT_BATCH_FLUSH_MS 0         // Backlog records leave with the next drain
+#define DEFAULT_THREADED 0               // Single-threaded state machine, for small devices
+#define DEFAULT_GATEWAY_PORT 0           // Not a gateway - only the node's own readings go out
+#define DEFAULT_COMMIT_RECORDS STORE_COMMIT_RECORDS
+#define DEFAULT_COMMIT_MS STORE_COMMIT_MS
+#define DEFAULT_DURABILITY STORE_DURABILITY_GROUP
+#define DEFAULT_RETENTION_MAX_BYTES 0    // The whole backlog file
+#define DEFAULT_RETENTION_MAX_AGE_S 0    // Readings are kept however old they are
+#define DEFAULT_RETENTION_POLICY RETENTION_DROP_OLDEST
+
+// Valid ranges, a snapshot outside them is rejected as a whole
+#define CONFIG_INTERVAL_MIN 10
+#define CONFIG_INTERVAL_MAX 120
+#define CONFIG_TIMEOUT_MIN 1
+#define CONFIG_TIMEOUT_MAX 60
+#define CONFIG_SAMPLE_MS_MIN 100
+#define CONFIG_SAMPLE_MS_MAX 60000
+#define CONFIG_BATCH_FLUSH_MS_MAX 120000
+#define CONFIG_COMMIT_MS_MAX 600000
+#define CONFIG_RETENTION_BYTES_MAX (1 << 30)
+#define CONFIG_RETENTION_AGE_MAX (366 * 24 * 3600)
+#define CONFIG_DEVICE_ID_MAX 48      // Leaves room for the "_humidity" channel suffix
+
+
+/*
+ * One validated snapshot of bin/config.txt. Never modified once published:
+ * a reload (SIGHUP or the file changing) parses into a second slot, and the
+ * sensor task swaps the pointer with Config_Apply() between cycles, so a cycle
+ * always sees one consistent snapshot.
+ */
+typedef struct {
+    int measurement_interval;        // Seconds between posts
+    char device_id[CONFIG_DEVICE_ID_MAX + 1];
+    char server_host[TCP_HOST_MAX];
+    int server_port;
+    int connection_timeout;          // Seconds, per HTTP phase
+    char backup_file[CONFIG_PATH_MAX];   // Old text backlog, imported once at startup
+    double temperature_min;          // Plausible range of the temperature channel
+    double temperature_max;
+    encoding_t payload_encoding;
+    aggregation_mode_t aggregation;
+    int sample_interval_ms;
+    double deadband;
+    int batch_flush_ms;              // Online, a partial backlog batch waits this long for more records
+    int commit_records;              // Backlog records cached in memory before one group write
+    int commit_ms;                   // Oldest cached backlog record waits at most this long for its group
+    store_durability_t durability;   // What a group commit guarantees
+    int retention_max_bytes;         // Backlog space records may take, 0 = the whole file
+    int retention_max_age_s;         // Readings older than this are dropped, 0 = never
+    retention_policy_t retention_policy;   // What makes room once the backlog is over retention_max_bytes
+    int threaded;                    // Sampler, encoder and uploader on their own threads (read at startup only)
+    int gateway_port;                // Takes readings from other nodes on this TCP/UDP port, 0 = off (read at startup only)
+    unsigned long generation;        // Incremented by every snapshot published
+} config_t;
+
+
+void Config_Defaults(config_t* config);
+int Config_Load(const char* path, config_t* config);
+
+int Config_Init(const char* path);
+const config_t* Config_Current(void);
+int Config_Watch(void (*on_staged)(void*), void* context);
+int Config_Stage(void);
+const config_t* Config_Apply(void);
+const config_t* Config_Publish(const config_t* config);
+
+#endif // CONFIG_H
@@ -0,0 +1,102 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stdint.h>
+#include "../include/sensor.h"
+
+typedef enum {
+    ENCODING_JSON,                   // Sensor_JSON object, one per POST or a JSON array per batch
+    ENCODING_FRAME,                  // Compact little-endian binary frame
+} encoding_t;
+
+// Build-time default, e.g. make CFLAGS="-DDEFAULT_ENCODING=ENCODING_FRAME"
+#ifndef DEFAULT_ENCODING
+#define DEFAULT_ENCODING ENCODING_JSON
+#endif
+
+/*
+ * Binary frame layout (all integers little-endian):
+ *
+ *   reading:  u8 version | u8 kind=1 | u8 id_len | id | i64 epoch_ms | i32 value (1/100 units)
+ *   batch:    u8 version | u8 kind=2 | u8 id_len | id | u16 count | i64 epoch_ms | i32 value
+ *             then count-1 x (zigzag varint delta_ms, zigzag varint delta_value)
+ *   summary:  u8 version | u8 kind=3 | u8 id_len | id | i64 first_ms | u32 span_ms | u32 count
+ *             | i32 min | i32 max | i32 mean | i32 stddev
+ *
+ * A reading is ~28 bytes instead of ~90 for JSON, a batched reading 2-4 bytes.
+ */
+#define FRAME_VERSION 1
+#define FRAME_KIND_READING 1
+#define FRAME_KIND_BATCH 2
+#define FRAME_KIND_SUMMARY 3
+#define FRAME_ID_MAX 64
+#define FRAME_CONTENT_TYPE "application/x-sensornode-frame"
+#define JSON_CONTENT_TYPE "application/json"
+
+
+typedef struct {
+    const char* name;
+    const char* content_type;
+    uint16_t store_type;             // Record type used for this encoding in the backlog
+    int (*encode)(const Sensor_Data_t* data, char* out, int out_size);
+    // A window of one channel straight from the channel ring's columns
+    int (*encode_window)(const char* sensor_id, const char* quantity, const int64_t* timestamps,
+                         const double* values, int count, char* out, int out_size);
+} encoder_t;
+
+// One reading decoded from a frame
+typedef struct {
+    char sensor_id[FRAME_ID_MAX + 1];
+    int64_t epoch_ms;
+    int32_t value;                   // 1/100 units (0.01 °C)
+} frame_reading_t;
+
+// Walks the readings of a reading or batch frame (Frame_Reader_Next())
+typedef struct {
+    const char* frame;
+    int length;
+    int offset;                      // Next pair of deltas
+    int left;                        // Readings not returned yet
+    int started;                     // The first reading has been returned
+    frame_reading_t last;
+} frame_reader_t;
+
+// When and by which sensor a stored record was measured (backlog retention)
+typedef struct {
+    int64_t epoch_ms;                // Oldest reading the record holds
+    uint32_t source;                 // FNV-1a of the sensor id - tells channels apart
+} record_info_t;
+
+// Builds a delta-encoded batch frame from single reading frames
+typedef struct {
+    char* buffer;
+    int size;
+    int used;
+    int count;
+    int count_offset;
+    frame_reading_t last;
+} frame_batch_t;
+
+
+const encoder_t* Encoder_Get(encoding_t encoding);
+const encoder_t* Encoder_For_Store_Type(uint16_t store_type);
+
+int Frame_Encode(const Sensor_Data_t* data, char* out, int out_size);
+int Frame_Encode_Reading(const frame_reading_t* reading, char* out, int out_size);
+int Frame_Decode(const char* frame, int length, frame_reading_t* reading);
+int Frame_Kind(const char* frame, int length);
+int Frame_Length(const char* data, int available);
+int Frame_Encode_Window(const char* sensor_id, const char* quantity, const int64_t* timestamps,
+                        const double* values, int count, char* out, int out_size);
+
+void Frame_Batch_Begin(frame_batch_t* batch, char* buffer, int size);
+int Frame_Batch_Add(frame_batch_t* batch, const char* frame, int length);
+int Frame_Batch_End(frame_batch_t* batch);
+
+int Frame_Reader_Begin(frame_reader_t* reader, const char* frame, int length);
+int Frame_Reader_Next(frame_reader_t* reader, frame_reading_t* reading);
+
+int Record_Info(const char* data, int length, uint16_t store_type, record_info_t* info);
+int Record_Is_Reading(const char* data, int length);
+
+#endif // ENCODE_H
@@ -0,0 +1,62 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdint.h>
+#include "../include/pipeline.h"
+
+#define GATEWAY_CLIENTS_MAX 256      // TCP connections served at once, more are closed on accept
+#define GATEWAY_BUFFER_SIZE 8192     // Unparsed bytes per connection (one HTTP request with its body)
+#define GATEWAY_DATAGRAMS 32         // UDP datagrams taken per recvmmsg()
+#define GATEWAY_DATAGRAM_MAX 2048
+#define GATEWAY_EVENTS 64            // Ready sockets handled per dispatch
+#define GATEWAY_QUEUE_SLOTS 4096     // Readings held in memory ahead of the backlog
+#define GATEWAY_DEDUPE_SLOTS 16384   // Fingerprints of recent readings, direct-mapped
+#define GATEWAY_ARENA_SIZE (GATEWAY_QUEUE_SLOTS * sizeof(pipeline_record_t) + 4 * 1024)
+
+#define GATEWAY_BATCH_MAX_RECORDS 256   // Upstream POSTs of a gateway: few and large
+#define GATEWAY_BATCH_MAX_BYTES (32 * 1024)
+
+
+typedef struct {
+    unsigned long connections;       // TCP connections accepted
+    unsigned long requests;          // HTTP POSTs answered
+    unsigned long datagrams;         // UDP datagrams received
+    unsigned long accepted;          // Readings queued or spilled to the backlog
+    unsigned long duplicates;        // Readings seen recently, dropped
+    unsigned long rejected;          // Items that were no reading we know
+    unsigned long spilled;           // Accepted while the queue was full - went to the backlog
+    unsigned long lost;              // Neither the queue nor the backlog had room
+} gateway_stats_t;
+
+/*
+ * Gateway mode: the node also takes readings from other nodes and forwards
+ * them upstream with its own, in the large batches the backlog drain builds.
+ *
+ * One port, two transports, all on the main loop:
+ *   UDP  - each datagram holds one or more items
+ *   TCP  - a stream of items, or HTTP POSTs (a plain sensornode pointed at the
+ *          gateway), answered 200 once the readings are queued. A POST needs
+ *          a Content-Length: a chunked one is answered 411 and closed
+ * An item is a JSON object (Sensor_JSON) or a binary reading, summary or
+ * batch frame (encode.h); a JSON array or whitespace between items is fine.
+ * An object without a sensor_id, a timestamp and a value is rejected.
+ * Batch frames are split into reading frames, so every queued record is one
+ * reading and the uploader batches them like its own.
+ *
+ * The listening sockets and connections sit in the gateway's own epoll set,
+ * which the scheduler watches as one fd - each dispatch touches only the
+ * sockets that are ready. Memory is fixed at start: connection buffers, the
+ * queue and the dedupe table are static or carved once. A full queue spills
+ * to the backlog file; a full backlog (or a record too large for it) answers
+ * HTTP 503 so the sender keeps the reading.
+ *
+ * Readings seen recently (same bytes - a node resending after a lost answer)
+ * are dropped by a table of 64-bit fingerprints.
+ */
+int Gateway_Start(int port, store_t* backlog, void (*on_queued)(void*), void* context);
+int Gateway_Port(void);
+spsc_ring_t* Gateway_Queue(void);
+const gateway_stats_t* Gateway_Stats(void);
+void Gateway_Stop(void);
+
+#endif // GATEWAY_H
@@ -6,17 +6,111 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include "../include/tcp.h"
 
-#define SERVER_HOST "httpbin.org"
-#define SERVER_PORT 80
 #define METHOD_POST "/post"
 
 
-#define BUFFER_SIZE 1024
 #define MAX_RESPONSE_SIZE 128
+#define HTTP_PIPELINE_DEPTH 4     // POSTs written back-to-back before reading responses
+#define HTTP_HEADER_SIZE 256      // Header template (everything but the Content-Length value)
+#define HTTP_TEMPLATE_MAX 4       // Distinct path/host/content type combinations
+#define HTTP_LENGTH_LINE_SIZE 32  // "<Content-Length value>\r\n\r\n"
+#define HTTP_IOV_BATCH 64         // Pieces gathered into one sendmsg()
+#define HTTP_LINE_MAX 256         // Status/header/chunk-size line kept by the parser, longer lines are cut
+#define HTTP_RETRY_AFTER_MAX 3600 // Cap on a server's Retry-After (s)
+#define HTTP_LENGTH_CHUNKED (-2)  // Http_Request_Length(): Transfer-Encoding: chunked
 
-char* build_http_request(const char *path, const char *hostname, const char *body);
-void Print_HTTP_Status(const char* response);
+// Request body as a list of parts sent in place (no copy into one buffer)
+typedef struct {
+    struct iovec* parts;
+    int count;                  // Parts in use
+    int capacity;               // Parts available in parts[]
+    size_t length;              // Body bytes in total
+    const char* content_type;   // NULL = application/json
+} http_body_t;
 
-#endif //HTTP_H
+// Precomputed request header up to and including "Content-Length: "
+typedef struct {
+    const char* path;
+    const char* content_type;
+    char hostname[TCP_HOST_MAX];
+    char text[HTTP_HEADER_SIZE];
+    int length;
+} http_template_t;
+
+const http_template_t* Http_Template(const char* path, const char* hostname, const char* content_type);
+void Http_Template_Reset(void);
+
+void Http_Body_Reset(http_body_t* body);
+int Http_Body_Add(http_body_t* body, const void* data, size_t length);
+long Http_Request_Length(const char* headers, int length);
+
+typedef enum {
+    HTTP_PARSE_STATUS,
+    HTTP_PARSE_HEADERS,
+    HTTP_PARSE_BODY,            // Content-Length framed
+    HTTP_PARSE_CHUNK_SIZE,
+    HTTP_PARSE_CHUNK_DATA,
+    HTTP_PARSE_CHUNK_END,       // CRLF after a chunk
+    HTTP_PARSE_TRAILERS,
+    HTTP_PARSE_UNTIL_CLOSE,     // No framing - body ends when the server closes
+    HTTP_PARSE_DONE,
+    HTTP_PARSE_ERROR,
+} http_parse_state_t;
+
+// Incremental HTTP/1.x response parser, fed bytes as they arrive
+typedef struct {
+    http_parse_state_t state;
+    char line[HTTP_LINE_MAX];
+    int line_len;
+
+    int status;
+    char status_line[MAX_RESPONSE_SIZE];
+    long long content_length;   // -1 = not given
+    int chunked;
+    int keep_alive;
+    int retry_after;            // Seconds, -1 = not given
+    unsigned long long body_left;   // Bytes left in the body or current chunk
+    unsigned long long body_bytes;  // Body bytes discarded
+} http_parser_t;
+
+typedef enum {
+    HTTP_CLASS_NONE,            // No response
+    HTTP_CLASS_SUCCESS,         // 2xx - data delivered
+    HTTP_CLASS_RETRY,           // Transient (408, 429, 5xx, ...) - keep the data, back off
+    HTTP_CLASS_REJECTED,        // The payload itself was refused (400, 413, 415, 422)
+} http_status_class_t;
 
+// Pipelined POSTs on one connection, driven step by step from socket readiness
+typedef struct {
+    tcp_conn_t* conn;
+    const http_body_t* bodies;
+    int count;                  // Requests in the transaction
+    const http_template_t* templates[HTTP_PIPELINE_DEPTH];
+    char length_lines[HTTP_PIPELINE_DEPTH][HTTP_LENGTH_LINE_SIZE];
+    int length_line_lengths[HTTP_PIPELINE_DEPTH];
+
+    int sent;                   // Requests completely written
+    int piece;                  // Piece of the current request being written (0 = header template)
+    size_t offset;              // Bytes of that piece already written
+    size_t bytes_sent;          // 0 = nothing has left yet (safe to retry on a new socket)
+
+    int received;               // Responses completely read
+    http_parser_t parser;       // Response being read
+    int keep_alive;             // Last response allows another one on this socket
+    int retry_after;            // Longest Retry-After seen (s), -1 = none
+    int status_codes[HTTP_PIPELINE_DEPTH];  // -1 for requests that got no response
+} http_txn_t;
+
+void Http_Parser_Init(http_parser_t* parser);
+int Http_Parser_Feed(http_parser_t* parser, const char* data, size_t length);
+int Http_Parser_Finish(http_parser_t* parser);
+http_status_class_t Http_Status_Class(int status);
+
+int Http_Txn_Begin(http_txn_t* txn, tcp_conn_t* conn, const char* path, const http_body_t* bodies, int count);
+int Http_Txn_Send(http_txn_t* txn);
+int Http_Txn_Recv(http_txn_t* txn);
+
+#endif //HTTP_H
@@ -0,0 +1,58 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+// Levels above LOG_LEVEL compile to nothing - make release builds with LOG_LEVEL_INFO.
+// The dead call still type-checks its arguments and keeps them "used".
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_SLOTS 256                // Records the ring holds between drains (power of two)
+#define LOG_SLOT_SIZE 192            // One formatted record, longer ones are cut off
+#define LOG_RETRY_MS 50              // Output blocked - try the rest again this much later
+
+/*
+ * Records are key=value lines: the caller's format starts with ev=<event>, the
+ * logger adds the time and level in front:
+ *
+ *   t=12.034 lvl=info ev=http_status code=200
+ *
+ * Logging only formats into a lock-free ring and never touches a descriptor.
+ * The main loop drains the ring with Log_Flush() before it goes idle; output
+ * that would block stays queued, and a full ring drops records and counts them.
+ */
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Log_Write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { if (0) Log_Write(LOG_LEVEL_ERROR, __VA_ARGS__); } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) Log_Write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do { if (0) Log_Write(LOG_LEVEL_WARN, __VA_ARGS__); } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Log_Write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { if (0) Log_Write(LOG_LEVEL_INFO, __VA_ARGS__); } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Log_Write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { if (0) Log_Write(LOG_LEVEL_DEBUG, __VA_ARGS__); } while (0)
+#endif
+
+
+int Log_Init(int fd);
+void Log_Write(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+int Log_Flush(void);
+uint64_t Log_Dropped(void);
+
+#endif // LOG_H
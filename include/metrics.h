@@ -0,0 +1,90 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Build-time settings, e.g. make CFLAGS="-DMETRICS_PORT=0" to switch the endpoint off
+#ifndef METRICS_PORT
+#define METRICS_PORT 9464            // Prometheus page on 127.0.0.1, 0 = no endpoint
+#endif
+#ifndef METRICS_DUMP_FILE
+#define METRICS_DUMP_FILE "bin/metrics.txt"
+#endif
+#ifndef METRICS_DUMP_MS
+#define METRICS_DUMP_MS 60000        // How often the dump file is rewritten, 0 = never
+#endif
+
+#define METRICS_PAGE_MAX (32 * 1024) // Rendered page; families that do not fit are cut off
+#define METRICS_STATES_MAX 16        // State machine states with their own histogram
+#define METRICS_RESULTS 8            // result_code 0 (ok) down to -7
+
+/*
+ * HDR-style latency histogram in microseconds: exact below 8 µs, then 8
+ * sub-buckets per power of two, so every bucket is within 12.5% of the values
+ * it holds from 8 µs up to about 70 minutes. Recording is a handful of relaxed
+ * atomic adds - no locks and no allocation, safe from any thread.
+ */
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB_COUNT (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_EXPONENT 32
+#define METRICS_BUCKETS ((METRICS_MAX_EXPONENT - METRICS_SUB_BITS + 2) * METRICS_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} metrics_histogram_t;
+
+typedef enum {
+    METRIC_TCP_CONNECT,              // First handshake started until a candidate won
+    METRIC_TCP_SEND,                 // One sendmsg() call
+    METRIC_TCP_RECV,                 // One recv() call
+    METRIC_ENCODE,                   // One payload encoded
+    METRIC_CYCLE,                    // STATE_INITIALIZE until STATE_DONE
+    METRIC_COMMIT,                   // One backlog group written (and synced, as the durability level asks)
+    METRIC_TIMER_COUNT,
+} metrics_timer_t;
+
+typedef enum {
+    METRIC_TX_BYTES,
+    METRIC_RX_BYTES,
+    METRIC_QUEUE_SPILLED,            // Threaded/gateway mode: readings sent to the backlog because the queue was full
+    METRIC_BACKLOG_UNWRITTEN,        // Backlog records acked while still in the write-back cache - never written
+    METRIC_BACKLOG_EXPIRED,          // Retention: backlog records older than retention_max_age_s, dropped
+    METRIC_BACKLOG_EVICTED,          // Retention: oldest backlog records dropped for size
+    METRIC_BACKLOG_DOWNSAMPLED,      // Retention: backlog records thinned out of the oldest readings for size
+    METRIC_GATEWAY_ACCEPTED,         // Gateway mode: readings taken from downstream nodes
+    METRIC_GATEWAY_DUPLICATES,       // Gateway mode: readings seen recently, dropped
+    METRIC_GATEWAY_REJECTED,         // Gateway mode: items that were no reading, or lost for lack of room
+    METRIC_COUNTER_COUNT,
+} metrics_counter_t;
+
+typedef enum {
+    METRIC_BACKLOG_RECORDS,
+    METRIC_BACKLOG_BYTES,
+    METRIC_QUEUE_RECORDS,            // Threaded/gateway mode: readings waiting in the in-memory queue
+    METRIC_GAUGE_COUNT,
+} metrics_gauge_t;
+
+
+uint64_t Metrics_Now_Us(void);
+
+void Metrics_Record(metrics_histogram_t* histogram, uint64_t us);
+uint64_t Metrics_Percentile(const metrics_histogram_t* histogram, double quantile);
+
+void Metrics_Time(metrics_timer_t timer, uint64_t us);
+void Metrics_State_Time(int state, uint64_t us);
+void Metrics_Count(metrics_counter_t counter, uint64_t n);
+void Metrics_Gauge(metrics_gauge_t gauge, uint64_t value);
+void Metrics_Result(int result_code);
+void Metrics_State_Names(const char* const* names, int count);
+
+int Metrics_Render_Prometheus(char* out, size_t size);
+int Metrics_Render_Compact(char* out, size_t size);
+int Metrics_Dump(const char* path);
+
+int Metrics_Serve(int port, const char* dump_path, uint32_t dump_ms);
+
+#endif // METRICS_H
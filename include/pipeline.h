@@ -0,0 +1,84 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "../include/spsc.h"
+#include "../include/sensor.h"
+#include "../include/encode.h"
+#include "../include/config.h"
+
+#define PIPELINE_SAMPLE_SLOTS 256    // Samples between sampler and encoder
+#define PIPELINE_RECORD_SLOTS 1024   // Encoded readings waiting for the uploader before they spill to disk
+#define PIPELINE_ARENA_SIZE (PIPELINE_RECORD_SLOTS * sizeof(pipeline_record_t) + 32 * 1024)
+
+
+// One channel's value at one sampling instant (sampler -> encoder)
+typedef struct {
+    int64_t epoch_ms;
+    double value;
+    int channel;
+} pipeline_sample_t;
+
+// One encoded reading, laid out like a backlog record (encoder or gateway -> uploader)
+typedef struct {
+    uint16_t length;
+    uint16_t type;                   // STORE_TYPE_*
+    char data[STORE_PAYLOAD_MAX];
+} pipeline_record_t;
+
+/*
+ * Threaded mode: three stages, each owning its data, joined by SPSC rings.
+ *
+ *   sampler thread --samples--> encoder thread --records--> uploader (sensor task)
+ *                                     |
+ *                                     +--> backlog file, only while the record ring is full
+ *
+ * The sampler keeps the sampling cadence whatever the network does; the encoder
+ * turns samples into payloads in place in the record ring; the sensor task on
+ * the main loop batches records from the ring (then the backlog) into uploads
+ * and frees ring slots once the server took them. A record ring that fills up
+ * (uploader offline or too slow) is the backpressure: new readings go to the
+ * backlog instead, and go out from there once the queue has drained.
+ *
+ * Handoffs are eventfd wakeups. The encoder only writes one when the uploader
+ * has said it is going to sleep (Pipeline_Idle()), so a busy uploader costs no
+ * syscalls at all.
+ */
+typedef struct pipeline {
+    arena_t arena;                   // Rings and channels, taken from the heap once
+    channel_set_t channels;          // Sampler's channels - ids and kinds are fixed once threads run
+    const encoder_t* encoder;
+    store_t* backlog;                // Spill target, shared with the uploader
+    pthread_mutex_t backlog_lock;
+    spsc_ring_t samples;
+    spsc_ring_t records;
+
+    int period_ms;                   // Sampling period, may change while running (atomic)
+    int stop_fd;                     // eventfd, readable once Pipeline_Stop() was called
+    int encode_fd;                   // eventfd, sampler -> encoder
+    int wake_fd;                     // eventfd, encoder -> uploader
+    int uploader_idle;               // Uploader asked to be woken (atomic)
+    int uploader_sleeping;           // Uploader went to sleep on wake_fd (main thread only)
+    pthread_t sampler_thread;
+    pthread_t encoder_thread;
+    int running;
+
+    unsigned long samples_dropped;   // Sample ring full - the encoder fell behind (sampler only)
+    unsigned long spilled;           // Records written to the backlog instead of the queue (encoder only)
+    unsigned long lost;              // Records neither queued nor spilled (encoder only)
+} pipeline_t;
+
+
+int Pipeline_Start(pipeline_t* pipeline, const config_t* config, store_t* backlog, uint64_t seed, int period_ms);
+void Pipeline_Stop(pipeline_t* pipeline);
+void Pipeline_Set_Period(pipeline_t* pipeline, int period_ms);
+
+// Uploader side (main loop)
+spsc_ring_t* Pipeline_Queue(pipeline_t* pipeline);
+record_cursor_t Pipeline_Queue_Cursor(spsc_ring_t* queue);
+int Pipeline_Idle(pipeline_t* pipeline);
+int Pipeline_Woken(pipeline_t* pipeline);
+int Pipeline_Wake_Fd(const pipeline_t* pipeline);
+
+#endif // PIPELINE_H
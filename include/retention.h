@@ -0,0 +1,43 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include <stdint.h>
+#include "../include/store.h"
+
+#define RETENTION_PERIOD_MS 60000    // Checks while the backlog is within its limits - limits are soft by this much
+#define RETENTION_STEP_RECORDS 64    // Records one run examines for age or drops for size
+#define RETENTION_THIN_RECORDS 128   // Window one downsampling run halves
+#define RETENTION_SOURCES 64         // Sensors told apart while thinning, more share a slot
+
+
+typedef enum {
+    RETENTION_DROP_OLDEST,           // Over the size limit, the oldest records go
+    RETENTION_DOWNSAMPLE_OLDEST,     // Over the size limit, every other reading of the oldest records goes
+} retention_policy_t;
+
+typedef struct {
+    unsigned long expired;           // Records older than retention_max_age_s (or unreadable)
+    unsigned long dropped;           // Oldest records dropped for size
+    unsigned long downsampled;       // Records thinned out of the oldest window for size
+    unsigned long runs;              // Runs that removed something
+} retention_stats_t;
+
+/*
+ * Backlog retention: keeps a backlog that only grows while offline within a
+ * byte limit and a reading age (config.h: retention_*), oldest records first.
+ *
+ * Runs as a low-priority task on the main loop, so a due sampling or upload
+ * always goes first. Every run does a bounded amount of work - at most
+ * RETENTION_STEP_RECORDS records looked at for age and dropped for size, or
+ * one window of RETENTION_THIN_RECORDS halved with one write - and runs again
+ * at once while there is more to do. Nothing is allocated: the thinning window
+ * is static, and the backlog file keeps its preallocated size, so disk and
+ * memory stay what they were at start however long the node is offline.
+ *
+ * Records an upload holds are never touched; the task waits for the next run.
+ */
+int Retention_Start(store_t* backlog);
+const retention_stats_t* Retention_Stats(void);
+void Retention_Stop(void);
+
+#endif // RETENTION_H
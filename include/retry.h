@@ -0,0 +1,59 @@
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <stdint.h>
+
+// Build-time defaults, e.g. make CFLAGS="-DRETRY_CAP_MS=600000"
+#ifndef RETRY_BASE_MS
+#define RETRY_BASE_MS 1000           // Shortest wait after a failed upload
+#endif
+#ifndef RETRY_CAP_MS
+#define RETRY_CAP_MS 300000          // Longest wait between attempts (5 min)
+#endif
+#ifndef BREAKER_THRESHOLD
+#define BREAKER_THRESHOLD 5          // Consecutive failures that open the breaker
+#endif
+
+
+typedef enum {
+    BREAKER_CLOSED,                  // Uploads allowed, failures back off
+    BREAKER_OPEN,                    // No uploads until the backoff has passed
+    BREAKER_HALF_OPEN,               // One probe upload decides whether to close again
+} breaker_state_t;
+
+/*
+ * Retry policy for the upload path.
+ *
+ * Every failure waits a decorrelated-jitter delay before the next attempt:
+ *
+ *   delay = min(cap, random_between(base, previous_delay * 3))
+ *
+ * so nodes that lose the backend together do not come back in lockstep.
+ * After BREAKER_THRESHOLD failures in a row the breaker opens; when the wait is
+ * over it goes half-open and lets exactly one upload through as a probe.
+ * Fresh readings and the backlog drain both ask Retry_Allow() first.
+ */
+typedef struct {
+    breaker_state_t state;
+    uint32_t base_ms;
+    uint32_t cap_ms;
+    uint32_t threshold;
+    uint32_t failures;               // Consecutive failed attempts
+    uint64_t delay_ms;               // Last backoff delay, grows with each failure
+    uint64_t next_attempt_at;        // No attempt before this time (ms)
+    uint64_t offline_since;          // First failure of the current outage (ms), 0 = online
+    int probe_in_flight;             // Half-open probe handed out, waiting for its result
+    uint32_t seed;                   // xorshift32 state for the jitter
+    unsigned long trips;             // Times the breaker opened
+} retry_policy_t;
+
+
+void Retry_Init(retry_policy_t* policy, uint32_t base_ms, uint32_t cap_ms, uint32_t threshold, uint32_t seed);
+int Retry_Allow(retry_policy_t* policy, uint64_t now);
+uint64_t Retry_Next_Attempt(const retry_policy_t* policy);
+void Retry_Success(retry_policy_t* policy, uint64_t now);
+void Retry_Failure(retry_policy_t* policy, uint64_t now);
+void Retry_Hold(retry_policy_t* policy, uint64_t until);
+const char* Retry_State_Name(breaker_state_t state);
+
+#endif // RETRY_H
@@ -2,33 +2,55 @@
 #define SENSOR_H
 
 #include <time.h>
+#include "../include/store.h"
+#include "../include/http.h"
+#include "../include/arena.h"
+#include "../include/channel.h"
+#include "../include/aggregate.h"
 
 // Sensor configuration
-#define DEFAULT_SENSOR_ID "sensornode_001"
+#define DEFAULT_SENSOR_ID "sensornode_001"             // Primary channel, sent fresh every interval
+#define DEFAULT_HUMIDITY_ID "sensornode_001_humidity"
+#define DEFAULT_PRESSURE_ID "sensornode_001_pressure"
 #define SENSOR_READ_INTERVAL 60  // seconds
 
 // Sensor data structure
 typedef struct {
-    double temperature;
+    double value;
+    const char* quantity;         // JSON key: "temperature", "humidity", "pressure"
     char* timestamp;
+    time_t epoch;                 // Same instant as timestamp, for binary encodings
     const char* sensor_id;
+    const aggregate_t* summary;   // Window summary instead of a single value, NULL for a sample
 } Sensor_Data_t;
 
-double Random_Temperature_Sensor(void);
+// Where upload batches are read from: the backlog, or the threaded pipeline's queue.
+// peek() returns 1 with a view of the next record, 0 when none is left, -1 if it is corrupt.
+typedef struct {
+    void* source;
+    int (*peek)(void* source, store_view_t* view);
+    void (*advance)(void* source);
+} record_cursor_t;
+
 char* Get_Current_Timestamp(void);
+char* Format_Timestamp(time_t when);
 
 int Sensor_Init(void);
-Sensor_Data_t* Sensor_Read(void);
+int Sensor_Register_Channels(channel_set_t* channels);
+int Sensor_Configure_Channels(channel_set_t* channels, const char* device_id, double temperature_min, double temperature_max);
+Sensor_Data_t* Sensor_Read(arena_t* arena, const channel_set_t* channels, int channel);
+Sensor_Data_t* Sensor_Summary(arena_t* arena, const channel_set_t* channels, int channel, const aggregate_t* window);
 
 int Sensor_JSON(const Sensor_Data_t* SensorData_t, char* json_buffer, int buffer_size);
-int Save_Sensor_Data_To_File(char* request);
-
-int Send_Saved_Sensor_Data(char* buffer);
+int Sensor_JSON_Window(const char* sensor_id, const char* quantity, const int64_t* timestamps,
+                       const double* values, int count, char* json_buffer, int buffer_size);
+int Save_Sensor_Data_To_File(store_t* store, const char* data, int length, uint16_t type);
+int Import_Saved_Text_File(store_t* store, const char* path);
 
-int Read_Complete_Saved_File(char** buffer, size_t* file_size);     // NOT USED YET TRY THIS LATER
-int Remove_Sent_Object_From_File(const char* sent_object);
+int Read_Record_Batches(const record_cursor_t* cursor, http_body_t* bodies, char** scratch, int max_batches, int body_size, int max_records, int* record_counts);
+int Read_Saved_Batches(store_t* store, http_body_t* bodies, char** scratch, int max_batches, int body_size, int max_records, int* record_counts);
 
-void Sensor_Free(Sensor_Data_t* SensorData_t);
+int Remove_Saved_Objects(store_t* store, int count);
 
 int parse_interval(int argc, char **argv);
 #endif
\ No newline at end of file
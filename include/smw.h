@@ -6,6 +6,15 @@
 #include "../include/tcp.h"
 #include "../include/http.h"
 #include "../include/sensor.h"
+#include "../include/encode.h"
+#include "../include/arena.h"
+#include "../include/retry.h"
+#include "../include/config.h"
+#include "../include/metrics.h"
+#include "../include/log.h"
+#include "../include/clock.h"
+#include "../include/wheel.h"
+#include "../include/pipeline.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -14,60 +23,143 @@
 #include <unistd.h>
 #include <time.h>
 #include <signal.h>
+#include <sys/epoll.h>
 
-#define SERVER_HOST "httpbin.org"
-#define SERVER_PORT 80
-
-#define BUFFER_SIZE 1024
 #define BUFFER_JSON_SIZE 256
-#define MAX_RESPONSE_SIZE 128
+
+#define BATCH_MAX_RECORDS 32       // Default saved readings per backlog POST
+#define BATCH_MAX_BYTES 4096       // Default size limit of one backlog body
+
+#define SMW_POLL_MS 10                 // Re-check interval when epoll (or the resolver's eventfd) is not available
+#define SAVE_THROTTLE_MS 1000          // Acked backlog position written to disk at most this often
+
+// Arena of one task: its batch buffers (part lists and scratch of every pipelined body) on top
+// of the channel ring, aggregator windows and per-cycle allocations
+#define TASK_ARENA_BASE (12 * 1024)
+#define TASK_ARENA_SIZE(records, bytes) (TASK_ARENA_BASE + HTTP_PIPELINE_DEPTH * \
+                                         ((bytes) + (2 * (records) + 1) * sizeof(struct iovec) + 2 * ARENA_ALIGN))
 
 
 typedef enum {
     STATE_INITIALIZE,
     STATE_READ_SENSOR,
     STATE_PROCESS_SAVED_DATA,
-    STATE_HTTP_TRANSACTION,
+    STATE_HTTP_TRANSACTION,       // Pick the bodies and start the transaction
+    STATE_HTTP_RESOLVING,
+    STATE_HTTP_CONNECTING,        // Non-blocking connect, woken when the socket is writable
+    STATE_HTTP_SENDING,           // Partial writes resume when the socket is writable again
+    STATE_HTTP_RECEIVING,         // Responses parsed as bytes arrive
+    STATE_HTTP_COMPLETE,          // Ack what the server accepted, decide where to go next
     STATE_OFFLINE,
     STATE_SAVE_DATA,
     STATE_DONE,
     STATE_FAILED,
 } task_state_t;
 
+#define SENSOR_STATE_COUNT (STATE_FAILED + 1)
+extern const char* const sensor_state_names[SENSOR_STATE_COUNT];   // Metrics labels
+
+
+struct smw_task;
 
 typedef struct {
     task_state_t state;
-    int sockfd;
-    Sensor_Data_t* sensor_data;
-    char json_buffer[BUFFER_JSON_SIZE];
-    char fromfile_buffer[BUFFER_JSON_SIZE];   
-    char* http_request;
-    char http_response[MAX_RESPONSE_SIZE];
+    struct smw_task* task;        // Task running this context, woken by socket readiness
+    tcp_conn_t* conn;             // Pooled keep-alive connection to the configured server
+    http_txn_t txn;               // Upload in flight
+    wheel_timer_t phase_timer;    // Gives up on the current HTTP phase
+    int phase_timeout_ms;         // Deadline of each HTTP phase (connection_timeout)
+    int watch_fds[TCP_ADDR_MAX];  // Sockets registered with Smw_Watch_Fd()
+    int watch_count;
+    int txn_retried;              // Already moved to a fresh socket once in this transaction
+    Sensor_Data_t* sensor_data;   // Allocated from arena, gone after the next reset
+    channel_set_t channels;       // Registered channels and their sample ring, carved from arena once
+    aggregator_t aggregator;      // Per-channel window summaries / deadband state
+    aggregate_t closed_window;    // Primary channel's last closed window, sensor_data points here
+    aggregation_mode_t aggregation;  // What leaves the node: raw samples, window summaries or deadband changes
+    double deadband;              // Deadband mode: change that posts a sample
+    int sample_interval_ms;       // Sampling period when aggregating (raw mode samples once per interval)
+    const channel_source_t* source;  // Where samples come from, NULL = simulated signal
+    uint32_t seed;                // Seeds the simulated signal and the retry jitter
+    arena_t arena;                // Every buffer the task needs - taken from the heap once
+    size_t cycle_mark;            // Arena position where per-cycle allocations start
+    unsigned long cycles;         // Completed cycles (STATE_DONE)
+    unsigned long cycle_heap_calls;  // Heap_Calls() when the current cycle started
+    const encoder_t* encoder;     // Payload encoding for fresh readings (JSON or binary frame)
+    char payload_buffer[BUFFER_JSON_SIZE];
+    int payload_length;           // 0 = no fresh reading pending
+    struct iovec fresh_part;      // payload_buffer as a one-part body
+    http_body_t fresh_body;
+    store_t backlog;              // Ring file holding readings that could not be sent
+    struct pipeline* pipeline;    // Threaded mode: readings arrive from here, the task only uploads (NULL = sample itself)
+    spsc_ring_t* queue;           // Records waiting in memory ahead of the backlog (threaded or gateway mode), NULL = none
+    http_body_t batch_bodies[HTTP_PIPELINE_DEPTH];  // Backlog bodies (views into the store), parts carved from arena once
+    char* batch_scratch[HTTP_PIPELINE_DEPTH]; // Delta-encoded binary batches are built here
+    int batch_records[HTTP_PIPELINE_DEPTH];   // Saved objects consumed by each body
+    int batch_count;                          // Bodies pipelined in the current transaction
+    int batch_queued;                         // Leading bodies read from the in-memory queue, the rest from the backlog
+    int batch_max_records;        // Saved readings per POST, always sent as a JSON array (or one batch frame)
+    int batch_limit_records;      // Readings per POST now: halved by a 413, grows back to batch_max_records
+    int batch_max_bytes;          // Size limit of one backlog body
     int attempt_count;
     int result_code;
+    uint64_t state_entered_us;    // When the current state was entered (metrics)
+    uint64_t cycle_started_us;    // When STATE_INITIALIZE last ran (metrics)
 
 
-    uint64_t offline_time;
-    int reconnect_interval;
+    retry_policy_t retry;         // Backoff and circuit breaker shared by fresh sends and the backlog drain
 
     uint64_t last_read_time;      // When the last measurement was taken (ms)
-    int measurement_interval;     // How often to take measurements (seconds)
-    uint64_t last_save_time;      // When last data was saved to file (ms) - for throttling saves
+    wheel_timer_t read_timer;     // Next measurement due, fired = take it
+    wheel_timer_t retry_timer;    // Backoff or Retry-After over - try the backlog again
+    wheel_timer_t flush_timer;    // A partial backlog batch has waited batch_flush_ms
+    wheel_timer_t save_timer;     // Writes out acks held back by SAVE_THROTTLE_MS
+    wheel_timer_t commit_timer;   // Backlog records cached in memory have waited commit_ms - write them
+    int batch_flush_ms;           // Online, hold a partial backlog batch this long for more records (0 = send at once)
+    int measurement_interval;     // How often to post (seconds) - one window when aggregating
+    int interval_override;        // --interval given on the command line, wins over the config file (0 = none)
+    unsigned long config_generation;  // Config snapshot the task runs with
+    uint64_t last_save_time;      // When the backlog position was last written to disk (ms) - for throttling saves
+    int backlog_empty;            // Saved file had nothing to send - sleep until next measurement
 
 } task_context_t;
 
 
-typedef struct {
+#define SMW_MAX_TASKS 32           // Fixed task table - no malloc per task or per cycle
+
+#define SMW_PRIO_HIGH 0
+#define SMW_PRIO_NORMAL 10
+#define SMW_PRIO_LOW 20
+
+
+typedef struct smw_task {
     void* context;
-    void (*callback)(void* context, uint64_t monTime);
+    uint64_t (*callback)(void* context, uint64_t monTime);   // Returns the next deadline (monotonic ms), UINT64_MAX = until woken
     int active;
+    uint64_t next_run;            // Deadline for the next callback (monotonic ms)
+    int priority;                 // Breaks ties between tasks due at the same time (lower runs first)
+    int heap_index;               // Position in the run queue, -1 when not queued
 } smw_task_t;
 
-smw_task_t* Create_Smw_Task(void* ctx, void (*cb)(void*, uint64_t));
-void Execute_Smw_Task(smw_task_t* task, uint64_t timestamp);
+int Smw_Init(void);
+uint64_t Smw_Now_Ms(void);
+uint64_t Smw_Next_Deadline(void);
+void Smw_Wait_Until(uint64_t deadline);
+int Smw_Watch_Fd(smw_task_t* task, int fd, uint32_t events);
+void Smw_Unwatch_Fd(int fd);
+
+void Smw_Timer_Arm(wheel_timer_t* timer, uint64_t deadline);
+void Smw_Timer_Cancel(wheel_timer_t* timer);
+void Smw_Timer_Wake(wheel_timer_t* timer, uint64_t monTime);
+
+smw_task_t* Create_Smw_Task(void* ctx, uint64_t (*cb)(void*, uint64_t), int priority);
+void Reschedule_Smw_Task(smw_task_t* task, uint64_t next_run);
+int Execute_Smw_Task(uint64_t monTime);
 void Free_Smw_Task(smw_task_t* task);
 
 
-void Sensor_State_Machine(task_context_t* context, uint64_t monTime);
+uint64_t Sensor_State_Machine(task_context_t* context, uint64_t monTime);
+void Sensor_Config_Staged(void* context);
+void Sensor_Records_Queued(void* context);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include "../include/arena.h"
+
+#define SPSC_CACHE_LINE 64
+
+/*
+ * Bounded single-producer/single-consumer ring of fixed-size slots. The two
+ * sides share nothing but head and tail, each on its own cache line: the
+ * producer fills a slot in place and publishes it with one release store, the
+ * consumer reads in place and frees it with another. No locks, no copies.
+ *
+ * The consumer may read ahead of what it frees (cursor), so records handed to
+ * an upload stay in the ring until the server took them:
+ *
+ *   head ........ cursor ........ tail
+ *   | handed out | not yet read  | free ...
+ */
+typedef struct {
+    char* slots;
+    uint32_t slot_size;
+    uint32_t mask;                   // Capacity - 1, capacity is a power of two
+    uint64_t head __attribute__((aligned(SPSC_CACHE_LINE)));   // Next slot the consumer frees
+    uint64_t cursor;                 // Next slot the consumer reads (consumer only)
+    uint64_t tail __attribute__((aligned(SPSC_CACHE_LINE)));   // Next slot the producer fills
+} spsc_ring_t;
+
+
+int Spsc_Init(spsc_ring_t* ring, arena_t* arena, uint32_t capacity, uint32_t slot_size);
+
+// Producer side
+void* Spsc_Claim(spsc_ring_t* ring);
+void Spsc_Publish(spsc_ring_t* ring);
+
+// Consumer side
+void* Spsc_Peek(const spsc_ring_t* ring);
+void Spsc_Advance(spsc_ring_t* ring);
+void Spsc_Rewind(spsc_ring_t* ring);
+void Spsc_Release(spsc_ring_t* ring, uint32_t count);
+uint32_t Spsc_Unread(const spsc_ring_t* ring);
+
+uint32_t Spsc_Count(const spsc_ring_t* ring);
+
+#endif // SPSC_H
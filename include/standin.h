@@ -0,0 +1,53 @@
+#ifndef STANDIN_H
+#define STANDIN_H
+
+#include <stdint.h>
+#include "../include/metrics.h"
+
+#define STANDIN_CLIENTS_MAX 4        // Connections served at once, more are closed on accept
+#define STANDIN_BUFFER_SIZE (160 * 1024)   // Request bytes buffered per connection (a full pipeline of gateway batches)
+#define STANDIN_PENDING_MAX 8        // Answers waiting out the latency per connection
+#define STANDIN_OUTAGES_MAX 8
+
+
+// Server unreachable from start_ms until end_ms (ms since Standin_Start)
+typedef struct {
+    uint64_t start_ms;
+    uint64_t end_ms;
+} standin_outage_t;
+
+typedef struct {
+    int latency_ms;                  // Every answer is held back this long
+    double error_rate;               // Share of requests answered 503 (0..1)
+    uint32_t seed;                   // Which requests fail - the same seed fails the same ones
+    standin_outage_t outages[STANDIN_OUTAGES_MAX];
+    int outage_count;
+} standin_config_t;
+
+typedef struct {
+    unsigned long connections;       // Accepted
+    unsigned long requests;          // Complete requests parsed
+    unsigned long errors;            // Answered 503
+    unsigned long dropped;           // Connections cut by an outage
+    unsigned long records;           // Readings in accepted bodies
+    uint64_t bytes;                  // Request bytes received
+    metrics_histogram_t latency;     // Reading timestamp until it was accepted (µs)
+} standin_stats_t;
+
+/*
+ * Local stand-in for the upload server, run as a task on the node's own
+ * scheduler so it follows the same (possibly virtual) clock. It speaks just
+ * enough HTTP/1.1 for the uploader: keep-alive, pipelined POSTs with a
+ * Content-Length, answers in order after latency_ms. During an outage the
+ * listening socket is closed - connects are refused and open connections cut.
+ *
+ * Accepted JSON bodies are scanned for "timestamp" fields to measure how long
+ * each reading took from the sensor to the server.
+ */
+int Standin_Start(const standin_config_t* config);
+int Standin_Port(void);
+int Standin_Active(void);
+const standin_stats_t* Standin_Stats(void);
+void Standin_Stop(void);
+
+#endif // STANDIN_H
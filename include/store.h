@@ -0,0 +1,121 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "../include/arena.h"
+
+// Persistent backlog: fixed-size records in a preallocated ring file
+#define STORE_FILE "bin/backlog.dat"
+#define STORE_CAPACITY 4096          // Records kept while offline
+#define STORE_SLOT_SIZE 256          // Bytes per record on disk, header included
+#define STORE_CACHE_SLOTS 256        // Records held in memory ahead of the file (write-back cache)
+#define STORE_COMMIT_RECORDS 32      // Default group size - written with one write + fdatasync()
+#define STORE_COMMIT_MS 10000        // Default age at which a smaller group is committed anyway
+#define STORE_CHECKPOINT_RECORDS 512 // Header rewritten at least this often - bounds the recovery scan
+
+#define STORE_MAGIC 0x424E5253u      // "SRNB"
+#define STORE_VERSION 2              // 1: no checksums, upgraded on open
+
+#define STORE_TYPE_JSON 1            // Payload is one JSON object
+#define STORE_TYPE_FRAME 2           // Payload is one binary reading frame (encode.h)
+
+
+typedef enum {
+    STORE_OVERWRITE_OLDEST,          // Full ring drops the oldest record
+    STORE_REJECT_NEW,                // Full ring refuses the new record
+} store_policy_t;
+
+typedef enum {
+    STORE_DURABILITY_WRITE,          // One write per group, the kernel flushes it later - survives a crash, not a power cut
+    STORE_DURABILITY_GROUP,          // One write + fdatasync() per group
+    STORE_DURABILITY_RECORD,         // Every record written and synced at once, nothing waits in memory
+} store_durability_t;
+
+
+// On-disk file header: the checkpoint. Rewritten in place by Store_Sync() after acks and by
+// commits every STORE_CHECKPOINT_RECORDS; records committed after it are found again by
+// sequence number and checksum when the file is opened.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;
+    uint64_t head;                   // Sequence number of the oldest live record
+    uint64_t tail;                   // Sequence number the next record gets, as far as it was on disk
+    uint64_t dropped;                // Records lost to STORE_OVERWRITE_OLDEST
+    uint32_t crc;                    // CRC32C of the header with crc = 0
+    uint32_t reserved;
+} store_header_t;
+
+// On-disk record header, the payload follows it inside the slot
+typedef struct {
+    uint64_t seq;                    // Tells a record from an older lap of the ring in the same slot
+    uint16_t length;                 // Payload bytes
+    uint16_t type;
+    uint32_t crc;                    // CRC32C of this header with crc = 0, then the payload
+} store_record_t;
+
+#define STORE_PAYLOAD_MAX (STORE_SLOT_SIZE - (int)sizeof(store_record_t))
+
+
+typedef struct {
+    int fd;
+    uint32_t slot_size;
+    uint32_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    store_policy_t policy;
+    int dirty;                    // Acks not yet written to the header
+
+    const char* map;              // Whole file mapped read-only, records are served from here
+    size_t map_size;
+    uint64_t cursor;              // Next record handed out by Store_Peek_View()/Store_Advance()
+    pthread_mutex_t* lock;        // Set by Store_Share() once a second thread appends, NULL = single thread
+
+    // Write-back cache: records [committed, tail) are in memory only, laid out like their slots
+    arena_t cache_arena;          // STORE_CACHE_SLOTS slots, taken from the heap once
+    char* cache;
+    uint64_t committed;           // Sequence number of the first record not written to the file
+    int gap;                      // committed jumped past records never written - the header must
+                                  // follow before a later record reaches the file
+    uint64_t checkpoint;          // Tail in the header on disk - Store_Open() looks for newer records from here
+    uint64_t pending_since_ms;    // When the oldest uncommitted record was appended
+    uint32_t commit_records;      // A group this large is committed at once
+    uint32_t commit_ms;           // A group this old is committed by Store_Commit_Due()
+    store_durability_t durability;
+} store_t;
+
+// Zero-copy view of one record inside the mapping, or inside the cache while it is not committed.
+// Valid until the record is acked or overwritten by STORE_OVERWRITE_OLDEST
+// (never while it is handed out of a shared store).
+typedef struct {
+    const char* data;
+    int length;
+    uint16_t type;
+    uint64_t seq;
+} store_view_t;
+
+
+int Store_Open(store_t* store, const char* path, uint32_t capacity, store_policy_t policy);
+void Store_Share(store_t* store, pthread_mutex_t* lock);
+int Store_Append(store_t* store, const void* data, int length, uint16_t type);
+int Store_View(const store_t* store, uint32_t index, store_view_t* view);
+int Store_Peek_View(const store_t* store, store_view_t* view);
+void Store_Advance(store_t* store);
+void Store_Rewind(store_t* store);
+int Store_Ack(store_t* store, uint32_t count);
+int Store_Sync(store_t* store);
+void Store_Set_Commit(store_t* store, uint32_t records, uint32_t ms, store_durability_t durability);
+int Store_Commit(store_t* store);
+int Store_Commit_Due(store_t* store, uint64_t now_ms);
+uint64_t Store_Commit_Deadline(const store_t* store);
+int Store_Drop_Oldest(store_t* store, uint32_t max, int (*expired)(const store_view_t*, void*), void* context);
+int Store_Thin_Oldest(store_t* store, uint32_t window, int (*keep)(const store_view_t*, void*), void* context,
+                      char* scratch, size_t scratch_size);
+uint32_t Store_Count(const store_t* store);
+void Store_Close(store_t* store);
+
+#endif // STORE_H
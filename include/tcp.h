@@ -3,12 +3,68 @@
 
 #include <sys/socket.h>
 #include <netdb.h>
+#include <sys/uio.h>
+#include <stdint.h>
 
+#define TCP_HOST_MAX 64
+#define TCP_POOL_SIZE 4
+#define TCP_RX_SIZE 1024
+
+#define TCP_ADDR_MAX 4              // Address candidates kept per host
+#define TCP_ATTEMPT_DELAY_MS 250    // Happy eyeballs: head start of one candidate before the next is tried
+#define TCP_DNS_TTL_MS 300000       // getaddrinfo() has no TTL - cached answers are trusted this long
+#define TCP_DNS_REFRESH_MS 30000    // Refresh in the background this long before expiry
+#define TCP_DNS_RETRY_MS 10000      // Wait after a failed lookup before asking again
+
+
+// One resolved address
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+} tcp_addr_t;
+
+// Kept-alive connection to one host:port. Addresses come from the resolver cache.
+typedef struct {
+    char hostname[TCP_HOST_MAX];
+    int port;
+    int in_use;
+
+    int sockfd;                 // Non-blocking, -1 until a candidate has connected
+    int connecting;             // Handshake attempts in flight
+
+    // Happy eyeballs: candidates (families interleaved) are tried TCP_ATTEMPT_DELAY_MS
+    // apart in parallel, the first to connect wins
+    tcp_addr_t candidates[TCP_ADDR_MAX];
+    int candidate_count;
+    int next_candidate;         // Next candidate to start
+    int attempt_fds[TCP_ADDR_MAX];
+    int attempt_count;          // Handshakes in flight
+    uint64_t next_attempt_at;   // When to start the next candidate (ms), 0 = none left
+    uint64_t connect_started_us;    // First handshake of this attempt started (metrics)
+    int socket_requests;        // Requests sent on the current socket
+    int pending;                // Responses still outstanding (pipelined requests)
+    char rx_buf[TCP_RX_SIZE + 1];   // Received bytes not consumed yet (start of the next response)
+    int rx_len;
+
+    unsigned long lookups;      // Lookups started for this host
+    unsigned long connects;     // New TCP handshakes
+    unsigned long reuses;       // Requests sent on an already open socket
+    unsigned long reconnects;   // Dead or half-closed sockets replaced
+    unsigned long requests;     // Requests sent in total
+} tcp_conn_t;
 
 
-int Tcp_Init(const char* hostname, int port);
-int Tcp_Send(int sockfd, const char* data, int length);
-int Tcp_Recv(int sockfd, char* buffer, int buffer_size);
 void Tcp_Close(int sockfd);
 
-#endif // TCP_H
\ No newline at end of file
+tcp_conn_t* Tcp_Pool_Get(const char* hostname, int port);
+void Tcp_Pool_Release(tcp_conn_t* conn);
+int Tcp_Conn_Resolve(tcp_conn_t* conn, uint64_t now_ms);
+int Tcp_Dns_Wake_Fd(void);
+int Tcp_Conn_Connect(tcp_conn_t* conn, uint64_t now_ms);
+int Tcp_Conn_Wait_Fds(const tcp_conn_t* conn, int* fds, int max);
+int Tcp_Conn_Writev(tcp_conn_t* conn, const struct iovec* iov, int count, int more);
+int Tcp_Conn_Read(tcp_conn_t* conn);
+void Tcp_Conn_Close(tcp_conn_t* conn);
+void Tcp_Conn_Print_Stats(const tcp_conn_t* conn);
+
+#endif // TCP_H
@@ -0,0 +1,59 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdint.h>
+
+#define WHEEL_BITS 6                 // 64 slots per level, one occupancy bit each
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4               // 1 ms, 64 ms, 4.1 s and 4.4 min slots - 4.7 h ahead
+#define WHEEL_SPAN_BITS (WHEEL_BITS * WHEEL_LEVELS)
+
+#define WHEEL_LIST_EXPIRED -1        // Due already, fired by the next Wheel_Advance()
+#define WHEEL_LIST_OVERFLOW -2       // Beyond the top level, re-sorted once per 4.7 h
+#define WHEEL_LIST_NONE -3
+
+
+struct wheel_timer;
+typedef void (*wheel_fire_t)(struct wheel_timer* timer, uint64_t now);
+
+// Embedded in its owner - the wheel never allocates
+typedef struct wheel_timer {
+    struct wheel_timer* next;
+    struct wheel_timer** pprev;      // The pointer that points at this timer, for O(1) unlink
+    uint64_t deadline;               // Monotonic ms
+    int8_t level;                    // Level holding the timer, or one of the WHEEL_LIST_* lists
+    uint8_t slot;
+    int fired;                       // Expired since it was last armed, cleared by arm/cancel
+    wheel_fire_t fire;
+    void* context;
+} wheel_timer_t;
+
+/*
+ * Hierarchical timer wheel. A timer sits in the lowest level whose current
+ * block (64^(level+1) ms) also holds its deadline, in the slot its deadline
+ * picks there. Arm and cancel are O(1) list operations; advancing jumps from
+ * one occupied slot to the next with the occupancy bitmaps and moves a
+ * higher-level slot down once the clock reaches it, so each timer is touched
+ * at most once per level before it fires. Wheel_Next() reports the earliest
+ * deadline itself, so a caller sleeping on it never wakes just to cascade.
+ */
+typedef struct {
+    uint64_t now;                    // Time the wheel has advanced to (ms)
+    uint64_t occupied[WHEEL_LEVELS];
+    wheel_timer_t* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    wheel_timer_t* expired;
+    wheel_timer_t* overflow;
+    wheel_timer_t* firing;           // Due timers Wheel_Advance() is calling back right now
+    int count;                       // Armed timers
+} wheel_t;
+
+
+void Wheel_Init(wheel_t* wheel, uint64_t now);
+void Wheel_Timer_Init(wheel_timer_t* timer, wheel_fire_t fire, void* context);
+void Wheel_Arm(wheel_t* wheel, wheel_timer_t* timer, uint64_t deadline);
+void Wheel_Cancel(wheel_t* wheel, wheel_timer_t* timer);
+int Wheel_Armed(const wheel_timer_t* timer);
+uint64_t Wheel_Next(const wheel_t* wheel);
+int Wheel_Advance(wheel_t* wheel, uint64_t now);
+
+#endif // WHEEL_H
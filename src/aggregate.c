@@ -0,0 +1,115 @@
+#include "../include/aggregate.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+void Aggregate_Reset(aggregate_t* window)
+{
+    memset(window, 0, sizeof(*window));
+}
+
+void Aggregate_Add(aggregate_t* window, int64_t epoch_ms, double value)
+{
+    if (window->count == 0) {
+        window->min = value;
+        window->max = value;
+        window->first_ms = epoch_ms;
+    }
+    if (value < window->min) window->min = value;
+    if (value > window->max) window->max = value;
+    window->last_ms = epoch_ms;
+
+    window->count++;
+    double delta = value - window->mean;
+    window->mean += delta / window->count;
+    window->m2 += delta * (value - window->mean);
+}
+
+        // Population standard deviation of the window
+double Aggregate_Stddev(const aggregate_t* window)
+{
+    return window->count > 1 ? sqrt(window->m2 / window->count) : 0.0;
+}
+
+        // Carves per-channel state from arena. Call before the arena's cycle mark.
+int Aggregator_Init(aggregator_t* aggregator, arena_t* arena, int max_channels,
+                    aggregation_mode_t mode, double deadband, uint64_t now)
+{
+    if (!aggregator || !arena || max_channels <= 0) return -1;
+
+    memset(aggregator, 0, sizeof(*aggregator));
+    aggregator->windows = Arena_Alloc(arena, (size_t)max_channels * sizeof(aggregate_t));
+    aggregator->last_sent = Arena_Alloc(arena, (size_t)max_channels * sizeof(double));
+    aggregator->last_sent_at = Arena_Alloc(arena, (size_t)max_channels * sizeof(uint64_t));
+    if (!aggregator->windows || !aggregator->last_sent || !aggregator->last_sent_at) {
+        LOG_ERROR("ev=aggregation_alloc_failed channels=%d", max_channels);
+        return -1;
+    }
+    memset(aggregator->last_sent_at, 0, (size_t)max_channels * sizeof(uint64_t));
+
+    aggregator->mode = mode;
+    aggregator->deadband = deadband;
+    aggregator->max_channels = max_channels;
+    Aggregator_Reset_Windows(aggregator, now);
+    return 0;
+}
+
+        // Folds every pending row of the ring into the channel windows, column by column
+void Aggregator_Add_Rows(aggregator_t* aggregator, const channel_set_t* channels)
+{
+    uint32_t pending = Channel_Pending(channels);
+
+    for (int c = 0; c < channels->count && c < aggregator->max_channels; c++)
+    {
+        const int64_t* timestamps;
+        const double* values;
+        uint32_t first = 0;
+        int rows;
+
+        while ((rows = Channel_Window(channels, c, first, pending - first, &timestamps, &values)) > 0)
+        {
+            for (int r = 0; r < rows; r++) {
+                Aggregate_Add(&aggregator->windows[c], timestamps[r], values[r]);
+            }
+            first += rows;
+        }
+    }
+}
+
+void Aggregator_Reset_Windows(aggregator_t* aggregator, uint64_t now)
+{
+    for (int c = 0; c < aggregator->max_channels; c++) {
+        Aggregate_Reset(&aggregator->windows[c]);
+    }
+    aggregator->window_start = now;
+}
+
+        // Returns 1 if value should be posted: it moved more than the deadband from the last
+        // posted value, or nothing was posted for heartbeat_ms (a flat signal still reports in)
+int Aggregator_Deadband(aggregator_t* aggregator, int channel, double value, uint64_t now, uint64_t heartbeat_ms)
+{
+    if (channel < 0 || channel >= aggregator->max_channels) return 0;
+
+    uint64_t sent_at = aggregator->last_sent_at[channel];
+    if (sent_at && fabs(value - aggregator->last_sent[channel]) <= aggregator->deadband &&
+        now - sent_at < heartbeat_ms)
+    {
+        return 0;
+    }
+
+    aggregator->last_sent[channel] = value;
+    aggregator->last_sent_at[channel] = now ? now : 1;
+    return 1;
+}
+
+const char* Aggregation_Name(aggregation_mode_t mode)
+{
+    switch (mode)
+    {
+        case AGGREGATE_RAW:      return "raw";
+        case AGGREGATE_WINDOW:   return "window";
+        case AGGREGATE_DEADBAND: return "deadband";
+    }
+    return "unknown";
+}
@@ -0,0 +1,80 @@
+#include "../include/arena.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int Arena_Init(arena_t* arena, size_t size)
+{
+    if (!arena || size == 0) return -1;
+
+    memset(arena, 0, sizeof(*arena));
+    arena->base = malloc(size);
+    if (!arena->base) {
+        LOG_ERROR("ev=arena_alloc_failed bytes=%zu", size);
+        return -1;
+    }
+    arena->size = size;
+    return 0;
+}
+
+void* Arena_Alloc(arena_t* arena, size_t size)
+{
+    if (!arena || !arena->base) return NULL;
+
+    size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start) {
+        LOG_ERROR("ev=arena_exhausted used=%zu size=%zu requested=%zu", arena->used, arena->size, size);
+        return NULL;
+    }
+
+    arena->used = start + size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return arena->base + start;
+}
+
+size_t Arena_Mark(const arena_t* arena)
+{
+    return arena ? arena->used : 0;
+}
+
+void Arena_Reset(arena_t* arena, size_t mark)
+{
+    if (arena && mark <= arena->used) arena->used = mark;
+}
+
+void Arena_Free(arena_t* arena)
+{
+    if (arena) {
+        free(arena->base);
+        memset(arena, 0, sizeof(*arena));
+    }
+}
+
+#ifdef HEAP_COUNT
+
+static unsigned long heap_calls = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)                { heap_calls++; return __real_malloc(size); }
+void* __wrap_calloc(size_t count, size_t size)  { heap_calls++; return __real_calloc(count, size); }
+void* __wrap_realloc(void* ptr, size_t size)    { heap_calls++; return __real_realloc(ptr, size); }
+void __wrap_free(void* ptr)                     { if (ptr) heap_calls++; __real_free(ptr); }
+
+unsigned long Heap_Calls(void)
+{
+    return heap_calls;
+}
+
+#else
+
+unsigned long Heap_Calls(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,1175 @@
+#define _GNU_SOURCE     // sendmmsg()
+#include "../include/smw.h"
+#include "../include/bench.h"
+#include "../include/encode.h"
+#include "../include/standin.h"
+#include "../include/gateway.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static double Bench_Seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+        // Same drifting signal as the node's temperature channel, one reading per second - seeded,
+        // so every run encodes the same values
+static void Bench_Fill_Readings(Sensor_Data_t* readings, int count)
+{
+    arena_t arena;
+    channel_set_t set;
+    if (Arena_Init(&arena, sizeof(channel_t) + sizeof(int64_t) + sizeof(double) + 4 * ARENA_ALIGN) < 0) {
+        return;
+    }
+    if (Channel_Set_Init(&set, &arena, 1, 1) < 0 || Channel_Add(&set, DEFAULT_SENSOR_ID, CHANNEL_TEMPERATURE) < 0) {
+        Arena_Free(&arena);
+        return;
+    }
+    Channel_Seed(&set, BENCH_PIPELINE_SEED);
+
+    time_t start = 1700000000;
+    for (int i = 0; i < count; i++)
+    {
+        Channel_Sample_All(&set, (int64_t)(start + i) * 1000);
+        readings[i].value = set.values[0];
+        readings[i].quantity = "temperature";
+        readings[i].epoch = start + i;
+        readings[i].timestamp = NULL;
+        readings[i].sensor_id = DEFAULT_SENSOR_ID;
+    }
+    Arena_Free(&arena);
+}
+
+        // Single readings: bytes on the wire and encode rate for one backend
+static void Bench_Encoder(const encoder_t* encoder, Sensor_Data_t* readings, int count)
+{
+    char buffer[BUFFER_JSON_SIZE];
+    long total_bytes = 0;
+
+    double start = Bench_Seconds();
+    for (int i = 0; i < count; i++)
+    {
+        // Sensor_JSON prints the timestamp text, the binary frame uses epoch
+        readings[i].timestamp = Format_Timestamp(readings[i].epoch);
+        int length = encoder->encode(&readings[i], buffer, sizeof(buffer));
+        if (length < 0) {
+            printf("❌ %s: encode failed at reading %d\n", encoder->name, i);
+            return;
+        }
+        total_bytes += length;
+    }
+    double elapsed = Bench_Seconds() - start;
+
+    printf("  %-6s single   %7.1f bytes/reading  %10.0f readings/sec\n",
+           encoder->name, (double)total_bytes / count, elapsed > 0 ? count / elapsed : 0.0);
+}
+
+        // Backlog batches of BATCH_MAX_RECORDS: a JSON array vs a delta-encoded frame
+static void Bench_Batches(Sensor_Data_t* readings, int count)
+{
+    char record[BUFFER_JSON_SIZE];
+    char* batch_buffer = malloc(BATCH_MAX_BYTES);
+    if (!batch_buffer) {
+        printf("❌ Failed to allocate batch buffer\n");
+        return;
+    }
+
+    long json_bytes = 0;
+    double start = Bench_Seconds();
+    for (int i = 0; i < count; i += BATCH_MAX_RECORDS)
+    {
+        json_bytes += 2;    // "[" and "]"
+        for (int j = i; j < i + BATCH_MAX_RECORDS && j < count; j++)
+        {
+            readings[j].timestamp = Format_Timestamp(readings[j].epoch);
+            json_bytes += Sensor_JSON(&readings[j], record, sizeof(record)) + (j > i ? 1 : 0);
+        }
+    }
+    double json_elapsed = Bench_Seconds() - start;
+
+    long frame_bytes = 0;
+    frame_batch_t batch;
+    start = Bench_Seconds();
+    for (int i = 0; i < count; i += BATCH_MAX_RECORDS)
+    {
+        Frame_Batch_Begin(&batch, batch_buffer, BATCH_MAX_BYTES);
+        for (int j = i; j < i + BATCH_MAX_RECORDS && j < count; j++)
+        {
+            int length = Frame_Encode(&readings[j], record, sizeof(record));
+            if (length < 0 || Frame_Batch_Add(&batch, record, length) != 0) {
+                printf("❌ frame batch rejected reading %d\n", j);
+                free(batch_buffer);
+                return;
+            }
+        }
+        frame_bytes += Frame_Batch_End(&batch);
+    }
+    double frame_elapsed = Bench_Seconds() - start;
+
+    printf("  json   batch    %7.1f bytes/reading  %10.0f readings/sec\n",
+           (double)json_bytes / count, json_elapsed > 0 ? count / json_elapsed : 0.0);
+    printf("  frame  batch    %7.1f bytes/reading  %10.0f readings/sec\n",
+           (double)frame_bytes / count, frame_elapsed > 0 ? count / frame_elapsed : 0.0);
+    printf("  Backlog batch size: %.1f%% of JSON\n", json_bytes ? 100.0 * frame_bytes / json_bytes : 0.0);
+
+    free(batch_buffer);
+}
+
+        // BENCH_CHANNELS channels sampled at BENCH_CHANNEL_HZ into the columnar ring. Every full
+        // window is serialized channel by channel, as an upload would. Time is simulated, so the
+        // run measures how much of each tick's budget sampling and encoding take.
+static void Bench_Channels(void)
+{
+    arena_t arena;
+    channel_set_t set;
+    size_t size = (size_t)BENCH_CHANNELS * (sizeof(channel_t) + CHANNEL_ROWS * sizeof(double)) +
+                  CHANNEL_ROWS * sizeof(int64_t) + 4 * ARENA_ALIGN;
+    if (Arena_Init(&arena, size) < 0) {
+        return;
+    }
+    char* window = malloc(BATCH_MAX_BYTES * 4);
+    if (!window || Channel_Set_Init(&set, &arena, BENCH_CHANNELS, CHANNEL_ROWS) < 0) {
+        printf("❌ Failed to set up %d channels\n", BENCH_CHANNELS);
+        free(window);
+        Arena_Free(&arena);
+        return;
+    }
+
+    static const channel_kind_t kinds[] = { CHANNEL_TEMPERATURE, CHANNEL_HUMIDITY, CHANNEL_PRESSURE };
+    char id[CHANNEL_ID_MAX + 1];
+    for (int c = 0; c < BENCH_CHANNELS; c++) {
+        snprintf(id, sizeof(id), "probe_%04d", c);
+        Channel_Add(&set, id, kinds[c % 3]);
+    }
+
+    const encoder_t* encoders[] = { Encoder_Get(ENCODING_JSON), Encoder_Get(ENCODING_FRAME) };
+    long encoded_bytes[2] = {0, 0};
+    long encoded_samples = 0;
+    double encode_seconds[2] = {0, 0};
+    int ticks = BENCH_CHANNEL_HZ * BENCH_CHANNEL_SECONDS;
+    int64_t epoch_ms = 1700000000000LL;
+    double sample_seconds = 0;
+    double worst_tick = 0;
+
+    for (int t = 0; t < ticks; t++, epoch_ms += 1000 / BENCH_CHANNEL_HZ)
+    {
+        double start = Bench_Seconds();
+        Channel_Sample_All(&set, epoch_ms);
+        double elapsed = Bench_Seconds() - start;
+        sample_seconds += elapsed;
+        if (elapsed > worst_tick) worst_tick = elapsed;
+
+        if (Channel_Pending(&set) < set.rows) continue;
+
+        for (int e = 0; e < 2; e++)
+        {
+            start = Bench_Seconds();
+            for (int c = 0; c < set.count; c++)
+            {
+                const int64_t* timestamps;
+                const double* values;
+                int rows = Channel_Window(&set, c, 0, set.rows, &timestamps, &values);
+                int length = encoders[e]->encode_window(set.channels[c].id, Channel_Quantity(set.channels[c].kind),
+                                                        timestamps, values, rows, window, BATCH_MAX_BYTES * 4);
+                if (length > 0) encoded_bytes[e] += length;
+            }
+            encode_seconds[e] += Bench_Seconds() - start;
+        }
+        encoded_samples += (long)set.rows * set.count;
+        Channel_Consume(&set, set.rows);
+    }
+
+    long samples = (long)ticks * set.count;
+    double budget = 1.0 / BENCH_CHANNEL_HZ;
+    printf("Channel benchmark: %d channels at %d Hz for %d s (%ld samples, %u-row windows)\n",
+           set.count, BENCH_CHANNEL_HZ, BENCH_CHANNEL_SECONDS, samples, set.rows);
+    printf("  sample pass %8.1f us/tick (worst %.1f us)  %5.2f%% of the %.0f ms budget  %10.0f samples/sec\n",
+           1e6 * sample_seconds / ticks, 1e6 * worst_tick, 100.0 * sample_seconds / ticks / budget,
+           1000 * budget, sample_seconds > 0 ? samples / sample_seconds : 0.0);
+    for (int e = 0; e < 2; e++) {
+        printf("  %-6s window %7.1f bytes/sample  %10.0f samples/sec\n", encoders[e]->name,
+               encoded_samples ? (double)encoded_bytes[e] / encoded_samples : 0.0,
+               encode_seconds[e] > 0 ? encoded_samples / encode_seconds[e] : 0.0);
+    }
+
+    free(window);
+    Arena_Free(&arena);
+}
+
+        // Upload volume of the same BENCH_CHANNELS x BENCH_CHANNEL_HZ signal in each aggregation
+        // mode: every sample as a frame, one summary frame per channel per window, or deadband posts
+static void Bench_Aggregation(void)
+{
+    arena_t arena;
+    channel_set_t set;
+    aggregator_t aggregator;
+    size_t size = (size_t)BENCH_CHANNELS * (sizeof(channel_t) + sizeof(double) + sizeof(aggregate_t) + 2 * sizeof(double) +
+                  sizeof(uint64_t)) + sizeof(int64_t) + 8 * ARENA_ALIGN;
+    if (Arena_Init(&arena, size) < 0) {
+        return;
+    }
+    if (Channel_Set_Init(&set, &arena, BENCH_CHANNELS, 1) < 0 ||
+        Aggregator_Init(&aggregator, &arena, BENCH_CHANNELS, AGGREGATE_WINDOW, DEADBAND_DEFAULT, 0) < 0)
+    {
+        Arena_Free(&arena);
+        return;
+    }
+
+    static const channel_kind_t kinds[] = { CHANNEL_TEMPERATURE, CHANNEL_HUMIDITY, CHANNEL_PRESSURE };
+    char id[CHANNEL_ID_MAX + 1];
+    for (int c = 0; c < BENCH_CHANNELS; c++) {
+        snprintf(id, sizeof(id), "probe_%04d", c);
+        Channel_Add(&set, id, kinds[c % 3]);
+    }
+
+    char frame[BUFFER_JSON_SIZE];
+    long raw_bytes = 0, window_bytes = 0, deadband_bytes = 0;
+    long windows = 0, deadband_posts = 0;
+    int ticks = BENCH_CHANNEL_HZ * BENCH_CHANNEL_SECONDS;
+    int window_ticks = BENCH_CHANNEL_HZ * BENCH_WINDOW_SECONDS;
+    int64_t epoch_ms = 1700000000000LL;
+    uint64_t now = 1;
+
+    for (int t = 1; t <= ticks; t++, epoch_ms += 1000 / BENCH_CHANNEL_HZ, now += 1000 / BENCH_CHANNEL_HZ)
+    {
+        // One-row ring: values[c] is channel c's sample of this tick
+        Channel_Sample_All(&set, epoch_ms);
+        for (int c = 0; c < set.count; c++)
+        {
+            Sensor_Data_t reading = { .value = set.values[c], .epoch = (time_t)(epoch_ms / 1000),
+                                      .sensor_id = set.channels[c].id };
+            int length = Frame_Encode(&reading, frame, sizeof(frame));
+            raw_bytes += length;
+            Aggregate_Add(&aggregator.windows[c], epoch_ms, set.values[c]);
+            if (Aggregator_Deadband(&aggregator, c, set.values[c], now, (uint64_t)BENCH_WINDOW_SECONDS * 1000)) {
+                deadband_bytes += length;
+                deadband_posts++;
+            }
+        }
+        Channel_Consume(&set, 1);
+
+        if (t % window_ticks == 0)
+        {
+            for (int c = 0; c < set.count; c++)
+            {
+                Sensor_Data_t summary = { .sensor_id = set.channels[c].id, .summary = &aggregator.windows[c] };
+                window_bytes += Frame_Encode(&summary, frame, sizeof(frame));
+                windows++;
+            }
+            Aggregator_Reset_Windows(&aggregator, now);
+        }
+    }
+
+    long samples = (long)ticks * set.count;
+    printf("Aggregation benchmark: %d channels at %d Hz for %d s, %d s windows, deadband %.2f\n",
+           set.count, BENCH_CHANNEL_HZ, BENCH_CHANNEL_SECONDS, BENCH_WINDOW_SECONDS, DEADBAND_DEFAULT);
+    printf("  raw       %8ld posts  %10ld bytes\n", samples, raw_bytes);
+    printf("  window    %8ld posts  %10ld bytes  %6.1fx smaller\n", windows, window_bytes,
+           window_bytes ? (double)raw_bytes / window_bytes : 0.0);
+    printf("  deadband  %8ld posts  %10ld bytes  %6.1fx smaller\n", deadband_posts, deadband_bytes,
+           deadband_bytes ? (double)raw_bytes / deadband_bytes : 0.0);
+
+    Arena_Free(&arena);
+}
+
+/* ---- Pipeline benchmark: the sensor task against a stand-in server, on a virtual clock ---- */
+
+#ifdef SYSCALL_COUNT
+// make bench links with -Wl,--wrap for each call below, like heapcheck does for malloc.
+// Only calls made from our own code are seen, counted apart for the node and the stand-in.
+static unsigned long bench_syscalls[2];
+static unsigned long bench_disk_writes;   // pwrite()/pwritev() calls - only the backlog writes files
+static unsigned long bench_disk_syncs;
+
+#define BENCH_WRAP(type, name, params, args)                      \
+    type __real_##name params;                                    \
+    type __wrap_##name params                                     \
+    {                                                             \
+        bench_syscalls[Standin_Active()]++;                       \
+        return __real_##name args;                                \
+    }
+
+#define BENCH_WRAP_DISK(counter, type, name, params, args)        \
+    type __real_##name params;                                    \
+    type __wrap_##name params                                     \
+    {                                                             \
+        bench_syscalls[Standin_Active()]++;                       \
+        counter++;                                                \
+        return __real_##name args;                                \
+    }
+
+BENCH_WRAP(int, socket, (int domain, int type, int protocol), (domain, type, protocol))
+BENCH_WRAP(int, connect, (int fd, const struct sockaddr* addr, socklen_t len), (fd, addr, len))
+BENCH_WRAP(int, accept, (int fd, struct sockaddr* addr, socklen_t* len), (fd, addr, len))
+BENCH_WRAP(int, accept4, (int fd, struct sockaddr* addr, socklen_t* len, int flags), (fd, addr, len, flags))
+BENCH_WRAP(int, bind, (int fd, const struct sockaddr* addr, socklen_t len), (fd, addr, len))
+BENCH_WRAP(int, listen, (int fd, int backlog), (fd, backlog))
+BENCH_WRAP(int, setsockopt, (int fd, int level, int name, const void* value, socklen_t len), (fd, level, name, value, len))
+BENCH_WRAP(int, getsockopt, (int fd, int level, int name, void* value, socklen_t* len), (fd, level, name, value, len))
+BENCH_WRAP(int, getsockname, (int fd, struct sockaddr* addr, socklen_t* len), (fd, addr, len))
+BENCH_WRAP(ssize_t, send, (int fd, const void* buf, size_t len, int flags), (fd, buf, len, flags))
+BENCH_WRAP(ssize_t, sendmsg, (int fd, const struct msghdr* msg, int flags), (fd, msg, flags))
+BENCH_WRAP(ssize_t, recv, (int fd, void* buf, size_t len, int flags), (fd, buf, len, flags))
+BENCH_WRAP(ssize_t, read, (int fd, void* buf, size_t len), (fd, buf, len))
+BENCH_WRAP(ssize_t, write, (int fd, const void* buf, size_t len), (fd, buf, len))
+BENCH_WRAP(ssize_t, writev, (int fd, const struct iovec* iov, int count), (fd, iov, count))
+BENCH_WRAP(ssize_t, pread, (int fd, void* buf, size_t len, off_t offset), (fd, buf, len, offset))
+BENCH_WRAP_DISK(bench_disk_writes, ssize_t, pwrite, (int fd, const void* buf, size_t len, off_t offset), (fd, buf, len, offset))
+BENCH_WRAP_DISK(bench_disk_writes, ssize_t, pwritev, (int fd, const struct iovec* iov, int count, off_t offset), (fd, iov, count, offset))
+BENCH_WRAP_DISK(bench_disk_syncs, int, fsync, (int fd), (fd))
+BENCH_WRAP_DISK(bench_disk_syncs, int, fdatasync, (int fd), (fd))
+BENCH_WRAP(int, ftruncate, (int fd, off_t length), (fd, length))
+BENCH_WRAP(int, posix_fallocate, (int fd, off_t offset, off_t length), (fd, offset, length))
+BENCH_WRAP(int, close, (int fd), (fd))
+BENCH_WRAP(int, epoll_wait, (int fd, struct epoll_event* events, int max, int timeout), (fd, events, max, timeout))
+BENCH_WRAP(int, epoll_ctl, (int fd, int op, int target, struct epoll_event* event), (fd, op, target, event))
+BENCH_WRAP(int, rename, (const char* from, const char* to), (from, to))
+BENCH_WRAP(int, unlink, (const char* path), (path))
+BENCH_WRAP(int, clock_nanosleep, (clockid_t id, int flags, const struct timespec* request, struct timespec* remain),
+           (id, flags, request, remain))
+
+// Variadic - the optional argument is an int or a pointer, passed on as a long
+int __real_fcntl(int fd, int cmd, ...);
+int __wrap_fcntl(int fd, int cmd, ...)
+{
+    va_list args;
+    va_start(args, cmd);
+    long arg = va_arg(args, long);
+    va_end(args);
+    bench_syscalls[Standin_Active()]++;
+    return __real_fcntl(fd, cmd, arg);
+}
+
+int __real_open(const char* path, int flags, ...);
+int __wrap_open(const char* path, int flags, ...)
+{
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = va_arg(args, mode_t);
+    va_end(args);
+    bench_syscalls[Standin_Active()]++;
+    return __real_open(path, flags, mode);
+}
+#endif
+
+typedef struct {
+    const char* source;              // "prng", "replay" or "max"
+    const char* replay_file;
+    double hours;
+    int interval;
+    int readings;                    // --source max: stop after this many
+    uint32_t seed;
+    int log;                         // Keep the node's log (virtual time stamps) instead of discarding it
+    int retention_max_bytes;         // Node's retention_* settings for the run
+    int retention_max_age_s;
+    retention_policy_t retention_policy;
+    standin_config_t standin;
+} bench_pipeline_t;
+
+// Recorded values, one row per sampling instant and one column per channel
+typedef struct {
+    double* values;
+    int rows;
+    int columns;
+    int row;                         // Row being replayed, wraps around at the end
+} bench_replay_t;
+
+// Backlog around one outage: the level before it, how high it got, when it was back down
+typedef struct {
+    uint32_t before;
+    uint32_t peak;
+    unsigned long accepted;          // Stand-in's accepted readings when the outage ended
+    int resumed;
+    uint64_t resumed_ms;             // Since the outage ended: first reading accepted again
+    int drained;
+    uint64_t drained_ms;             // Since the outage ended: back to the level before it
+} bench_drain_t;
+
+        // Replays the file's rows in order at the node's own cadence - the recorded
+        // timestamps are not used. Channels beyond the file's columns reuse its columns.
+static double Bench_Replay_Sample(void* state, const channel_t* channel, int index, int64_t epoch_ms)
+{
+    bench_replay_t* replay = state;
+    (void)channel;
+    (void)epoch_ms;
+    if (index == 0) {
+        replay->row = (replay->row + 1) % replay->rows;
+    }
+    return replay->values[(size_t)replay->row * replay->columns + index % replay->columns];
+}
+
+        // CSV with one numeric column per channel. Lines that do not start with a number
+        // (a header) are skipped, so is a first column holding epoch seconds or milliseconds.
+static int Bench_Replay_Load(bench_replay_t* replay, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("❌ Cannot open replay file %s\n", path);
+        return -1;
+    }
+
+    char line[1024];
+    int capacity = 0;
+    int skip_first = -1;
+    memset(replay, 0, sizeof(*replay));
+
+    while (fgets(line, sizeof(line), file) && replay->rows < BENCH_REPLAY_ROWS_MAX)
+    {
+        char* at = line;
+        while (*at == ' ' || *at == '\t') at++;
+        if (!((*at >= '0' && *at <= '9') || *at == '-' || *at == '+' || *at == '.')) {
+            continue;
+        }
+
+        double fields[CHANNEL_DEFAULT_MAX + 1];
+        int count = 0;
+        while (count < CHANNEL_DEFAULT_MAX + 1)
+        {
+            char* end;
+            fields[count] = strtod(at, &end);
+            if (end == at) break;
+            count++;
+            at = strchr(end, ',');
+            if (!at) break;
+            at++;
+        }
+        if (skip_first < 0) {
+            skip_first = count > 1 && fields[0] > 1e9;
+            replay->columns = count - skip_first;
+        }
+        if (replay->columns <= 0 || count - skip_first < replay->columns) {
+            continue;                // Short row
+        }
+
+        if (replay->rows == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            double* grown = realloc(replay->values, (size_t)capacity * replay->columns * sizeof(double));
+            if (!grown) break;
+            replay->values = grown;
+        }
+        memcpy(replay->values + (size_t)replay->rows * replay->columns, fields + skip_first,
+               replay->columns * sizeof(double));
+        replay->rows++;
+    }
+    fclose(file);
+
+    if (replay->rows == 0) {
+        printf("❌ No readings in replay file %s\n", path);
+        free(replay->values);
+        return -1;
+    }
+    replay->row = replay->rows - 1;  // The first sample advances to row 0
+    return 0;
+}
+
+static int Bench_Pipeline_Options(bench_pipeline_t* options, int argc, char** argv)
+{
+    memset(options, 0, sizeof(*options));
+    options->source = "prng";
+    options->hours = BENCH_PIPELINE_HOURS;
+    options->interval = BENCH_PIPELINE_INTERVAL;
+    options->readings = BENCH_PIPELINE_READINGS;
+    options->seed = BENCH_PIPELINE_SEED;
+    options->standin.latency_ms = BENCH_PIPELINE_LATENCY_MS;
+
+    for (int i = 0; i < argc; i++)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--log") == 0) {
+            options->log = 1;
+            continue;
+        }
+        if (!value) {
+            printf("❌ %s needs a value\n", argv[i]);
+            return -1;
+        }
+        i++;
+
+        if (strcmp(argv[i - 1], "--source") == 0) {
+            options->source = value;
+            if (strcmp(value, "replay") == 0 && i + 1 < argc) {
+                options->replay_file = argv[++i];
+            }
+            else if (strcmp(value, "prng") != 0 && strcmp(value, "max") != 0) {
+                printf("❌ Unknown source %s (prng, max or replay <file.csv>)\n", value);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i - 1], "--hours") == 0) options->hours = atof(value);
+        else if (strcmp(argv[i - 1], "--interval") == 0) options->interval = atoi(value);
+        else if (strcmp(argv[i - 1], "--readings") == 0) options->readings = atoi(value);
+        else if (strcmp(argv[i - 1], "--seed") == 0) options->seed = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(argv[i - 1], "--latency") == 0) options->standin.latency_ms = atoi(value);
+        else if (strcmp(argv[i - 1], "--errors") == 0) options->standin.error_rate = atof(value);
+        else if (strcmp(argv[i - 1], "--retention-bytes") == 0) options->retention_max_bytes = atoi(value);
+        else if (strcmp(argv[i - 1], "--retention-age") == 0) options->retention_max_age_s = atoi(value);
+        else if (strcmp(argv[i - 1], "--retention") == 0)
+        {
+            if (strcmp(value, "drop") == 0) options->retention_policy = RETENTION_DROP_OLDEST;
+            else if (strcmp(value, "downsample") == 0) options->retention_policy = RETENTION_DOWNSAMPLE_OLDEST;
+            else {
+                printf("❌ Unknown retention policy %s (drop or downsample)\n", value);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i - 1], "--outage") == 0)
+        {
+            // Minutes from the start: --outage 60-90
+            double from, to;
+            if (options->standin.outage_count >= STANDIN_OUTAGES_MAX ||
+                sscanf(value, "%lf-%lf", &from, &to) != 2 || from < 0 || to <= from) {
+                printf("❌ Invalid outage %s (minutes from-to, at most %d)\n", value, STANDIN_OUTAGES_MAX);
+                return -1;
+            }
+            standin_outage_t* outage = &options->standin.outages[options->standin.outage_count++];
+            outage->start_ms = (uint64_t)(from * 60000);
+            outage->end_ms = (uint64_t)(to * 60000);
+        }
+        else {
+            printf("❌ Unknown pipeline option %s\n", argv[i - 1]);
+            return -1;
+        }
+    }
+
+    if (options->hours <= 0 || options->interval <= 0 || options->readings <= 0 ||
+        options->standin.latency_ms < 0 || options->standin.error_rate < 0 || options->standin.error_rate > 1 ||
+        options->retention_max_bytes < 0 || options->retention_max_age_s < 0 ||
+        (strcmp(options->source, "replay") == 0 && !options->replay_file))
+    {
+        printf("❌ Invalid pipeline options\n");
+        return -1;
+    }
+    options->standin.seed = options->seed;
+    return 0;
+}
+
+        // "850 us", "20.0 ms", "3.1 s", "32.0 min"
+static const char* Bench_Duration(char* out, size_t size, uint64_t us)
+{
+    if (us < 1000) snprintf(out, size, "%llu us", (unsigned long long)us);
+    else if (us < 1000000) snprintf(out, size, "%.1f ms", us / 1e3);
+    else if (us < 120000000) snprintf(out, size, "%.1f s", us / 1e6);
+    else snprintf(out, size, "%.1f min", us / 6e7);
+    return out;
+}
+
+        // Runs the real sensor task - state machine, encoder, backlog file, HTTP over loopback -
+        // against the stand-in server. The clock is virtual: whenever nothing is ready the
+        // scheduler jumps to the next deadline, so the run takes as long as the work does.
+static int Bench_Pipeline(int argc, char** argv)
+{
+    bench_pipeline_t options;
+    if (Bench_Pipeline_Options(&options, argc, argv) < 0) {
+        return 1;
+    }
+
+    bench_replay_t replay;
+    channel_source_t replay_source = { "replay", Bench_Replay_Sample, &replay };
+    const channel_source_t* source = NULL;
+    int max_rate = strcmp(options.source, "max") == 0;
+    if (max_rate) {
+        source = &channel_source_synthetic;
+    }
+    else if (options.replay_file) {
+        if (Bench_Replay_Load(&replay, options.replay_file) < 0) return 1;
+        source = &replay_source;
+    }
+
+    // Time starts on a whole second, so readings sampled on the interval carry exact timestamps
+    Log_Flush();
+    Clock_Use_Virtual(1000000, BENCH_START_EPOCH_MS);
+    Log_Init(options.log ? STDOUT_FILENO : -1);
+
+    Smw_Init();
+    if (Standin_Start(&options.standin) < 0) {
+        printf("❌ Stand-in server did not start\n");
+        return 1;
+    }
+
+    config_t config;
+    Config_Defaults(&config);
+    snprintf(config.server_host, sizeof(config.server_host), "127.0.0.1");
+    config.server_port = Standin_Port();
+    config.measurement_interval = options.interval;
+    config.payload_encoding = ENCODING_JSON;     // The stand-in reads the timestamps
+    config.aggregation = AGGREGATE_RAW;
+    config.retention_max_bytes = options.retention_max_bytes;
+    config.retention_max_age_s = options.retention_max_age_s;
+    config.retention_policy = options.retention_policy;
+    Config_Publish(&config);
+
+    task_context_t ctx = {0};
+    ctx.state = STATE_INITIALIZE;
+    ctx.measurement_interval = config.measurement_interval;
+    ctx.batch_max_records = BATCH_MAX_RECORDS;
+    ctx.batch_max_bytes = BATCH_MAX_BYTES;
+    ctx.encoder = Encoder_Get(config.payload_encoding);
+    ctx.aggregation = config.aggregation;
+    ctx.deadband = config.deadband;
+    ctx.sample_interval_ms = config.sample_interval_ms;
+    ctx.source = source;
+    ctx.seed = options.seed;
+    Retry_Init(&ctx.retry, RETRY_BASE_MS, RETRY_CAP_MS, BREAKER_THRESHOLD, options.seed);
+
+    unlink(BENCH_STORE_FILE);
+    if (Store_Open(&ctx.backlog, BENCH_STORE_FILE, STORE_CAPACITY, STORE_OVERWRITE_OLDEST) < 0) {
+        printf("❌ Cannot open %s\n", BENCH_STORE_FILE);
+        return 1;
+    }
+    ctx.task = Create_Smw_Task(&ctx, (uint64_t (*)(void*, uint64_t))Sensor_State_Machine, SMW_PRIO_NORMAL);
+    if (!ctx.task) {
+        printf("❌ Failed to create the sensor task\n");
+        return 1;
+    }
+    if (Retention_Start(&ctx.backlog) < 0) {
+        printf("❌ Failed to create the retention task\n");
+        return 1;
+    }
+
+    bench_drain_t drains[STANDIN_OUTAGES_MAX];
+    memset(drains, 0, sizeof(drains));
+    uint64_t started_ms = Smw_Now_Ms();
+    uint64_t end_ms = started_ms + (uint64_t)(options.hours * 3600000);
+#ifdef SYSCALL_COUNT
+    memset(bench_syscalls, 0, sizeof(bench_syscalls));
+    bench_disk_writes = bench_disk_syncs = 0;
+#endif
+    double real_start = Bench_Seconds();
+
+    while (Smw_Now_Ms() < end_ms)
+    {
+        uint64_t now = Smw_Now_Ms();
+        Execute_Smw_Task(now);
+        Log_Flush();
+
+        // Max rate: the next reading is due as soon as the last one and its backlog are through
+        uint64_t sampled = ctx.channels.tail * (uint64_t)ctx.channels.count;
+        if (max_rate)
+        {
+            if (sampled >= (uint64_t)options.readings) break;
+            if (ctx.state == STATE_INITIALIZE && ctx.backlog_empty && ctx.task->next_run > now) {
+                Smw_Timer_Arm(&ctx.read_timer, now);
+            }
+        }
+
+        uint32_t backlog = Store_Count(&ctx.backlog);
+        for (int i = 0; i < options.standin.outage_count; i++)
+        {
+            const standin_outage_t* outage = &options.standin.outages[i];
+            bench_drain_t* drain = &drains[i];
+            uint64_t since = now - started_ms;
+
+            if (since < outage->start_ms) {
+                drain->before = backlog;
+            }
+            else if (since < outage->end_ms) {
+                if (backlog > drain->peak) drain->peak = backlog;
+                drain->accepted = Standin_Stats()->records;
+            }
+            else if (!drain->drained) {
+                if (backlog > drain->peak) drain->peak = backlog;
+                if (!drain->resumed && Standin_Stats()->records > drain->accepted) {
+                    drain->resumed = 1;
+                    drain->resumed_ms = since - outage->end_ms;
+                }
+                if (backlog <= drain->before) {
+                    drain->drained = 1;
+                    drain->drained_ms = since - outage->end_ms;
+                }
+            }
+        }
+
+        uint64_t deadline = Smw_Next_Deadline();
+        Smw_Wait_Until(deadline < end_ms ? deadline : end_ms);
+    }
+
+    double real_seconds = Bench_Seconds() - real_start;
+    double virtual_hours = (Smw_Now_Ms() - started_ms) / 3600000.0;
+    const standin_stats_t* stats = Standin_Stats();
+    uint64_t sampled = ctx.channels.tail * (uint64_t)ctx.channels.count;
+    char p50[24], p99[24], worst[24];
+
+    printf("Pipeline benchmark: source=%s", options.source);
+    if (max_rate) printf(", next reading when the last one is through");
+    else printf(", %d s interval", options.interval);
+    printf(", %.1f h simulated in %.2f s (%.0fx real time)\n", virtual_hours, real_seconds,
+           real_seconds > 0 ? virtual_hours * 3600 / real_seconds : 0.0);
+    printf("  stand-in     latency %d ms, %.1f%% errors, %d outage(s)\n",
+           options.standin.latency_ms, 100.0 * options.standin.error_rate, options.standin.outage_count);
+    printf("  readings     %llu sampled, %lu accepted (resends included), %.0f readings/sec\n", (unsigned long long)sampled,
+           stats->records, real_seconds > 0 ? stats->records / real_seconds : 0.0);
+    printf("  latency      p50 %s, p99 %s, max %s (sampled until the server took it, virtual time)\n",
+           Bench_Duration(p50, sizeof(p50), Metrics_Percentile(&stats->latency, 0.50)),
+           Bench_Duration(p99, sizeof(p99), Metrics_Percentile(&stats->latency, 0.99)),
+           Bench_Duration(worst, sizeof(worst), stats->latency.max_us));
+#ifdef SYSCALL_COUNT
+    printf("  syscalls     %.1f per accepted reading (%lu from the node, %lu from the stand-in)\n",
+           stats->records ? (double)bench_syscalls[0] / stats->records : 0.0, bench_syscalls[0], bench_syscalls[1]);
+    printf("  storage      %llu records to the backlog, %lu writes, %lu syncs\n",
+           (unsigned long long)ctx.backlog.tail, bench_disk_writes, bench_disk_syncs);
+#else
+    printf("  syscalls     not counted - run through make bench\n");
+#endif
+    printf("  requests     %lu on %lu connection(s), %lu answered 503, %lu connection(s) cut by outages\n",
+           stats->requests, stats->connections, stats->errors, stats->dropped);
+    for (int i = 0; i < options.standin.outage_count; i++)
+    {
+        const standin_outage_t* outage = &options.standin.outages[i];
+        const bench_drain_t* drain = &drains[i];
+        uint32_t backlog = drain->peak > drain->before ? drain->peak - drain->before : 0;
+
+        printf("  backlog      outage %.0f-%.0f min: %u records queued, ", outage->start_ms / 60000.0,
+               outage->end_ms / 60000.0, backlog);
+        if (drain->drained) {
+            uint64_t draining_ms = drain->drained_ms - drain->resumed_ms;
+            printf("resumed %.1f s after it ended, drained in %.1f s (%.0f records/sec)\n",
+                   drain->resumed_ms / 1000.0, draining_ms / 1000.0,
+                   draining_ms ? backlog * 1000.0 / draining_ms : (double)backlog);
+        }
+        else {
+            printf("not drained by the end of the run\n");
+        }
+    }
+    if (options.retention_max_bytes || options.retention_max_age_s || options.retention_policy != RETENTION_DROP_OLDEST)
+    {
+        const retention_stats_t* retention = Retention_Stats();
+        printf("  retention    %lu records expired, %lu dropped, %lu downsampled in %lu runs\n",
+               retention->expired, retention->dropped, retention->downsampled, retention->runs);
+    }
+
+    // The task table and timer wheel outlive this frame
+    Smw_Timer_Cancel(&ctx.read_timer);
+    Smw_Timer_Cancel(&ctx.phase_timer);
+    Smw_Timer_Cancel(&ctx.retry_timer);
+    Smw_Timer_Cancel(&ctx.flush_timer);
+    Smw_Timer_Cancel(&ctx.save_timer);
+    Smw_Timer_Cancel(&ctx.commit_timer);
+    Free_Smw_Task(ctx.task);
+    Retention_Stop();
+    Standin_Stop();
+    Store_Close(&ctx.backlog);
+    unlink(BENCH_STORE_FILE);
+    if (options.replay_file) free(replay.values);
+    return 0;
+}
+
+// Downstream nodes of the gateway benchmark, all behind one UDP socket
+typedef struct {
+    int fd;
+    int nodes;
+    int readings;                    // To send, resends not included
+    int rate;                        // Readings per second, all nodes together (virtual time)
+    double duplicates;               // Share of datagrams sent twice
+    uint64_t started_ms;
+    int sent;                        // Readings sent
+    unsigned long datagrams;         // Datagrams sent, resends included
+    unsigned long resent;
+    uint32_t random;
+} bench_senders_t;
+
+        // The readings due by now at the configured rate, in bursts of up to GATEWAY_DATAGRAMS,
+        // each node taking its turn. Never more than GATEWAY_EVENTS bursts ahead of the
+        // gateway, so the socket buffer never drops one.
+static uint64_t Bench_Gateway_Send(void* context, uint64_t monTime)
+{
+    bench_senders_t* senders = context;
+    char texts[GATEWAY_DATAGRAMS][BUFFER_JSON_SIZE];
+    struct mmsghdr messages[GATEWAY_DATAGRAMS];
+    struct iovec parts[GATEWAY_DATAGRAMS];
+    int count = 0;
+
+    uint64_t due = (monTime - senders->started_ms + 1) * (uint64_t)senders->rate / 1000;
+    if (due > (uint64_t)senders->readings) due = senders->readings;
+    if (senders->sent >= senders->readings) {
+        return UINT64_MAX;
+    }
+    if ((uint64_t)senders->sent >= due) {
+        return monTime + 1;
+    }
+    if (senders->datagrams - Gateway_Stats()->datagrams > GATEWAY_EVENTS * GATEWAY_DATAGRAMS) {
+        return monTime;
+    }
+
+    memset(messages, 0, sizeof(messages));
+    const char* timestamp = Format_Timestamp((time_t)(Clock_Wall_Ms() / 1000));
+    while (count < GATEWAY_DATAGRAMS && (uint64_t)senders->sent < due)
+    {
+        // xorshift32 picks the resends
+        uint32_t x = senders->random;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        senders->random = x;
+
+        if (count > 0 && x / 4294967296.0 < senders->duplicates)
+        {
+            parts[count] = parts[count - 1];
+            senders->resent++;
+        }
+        else
+        {
+            int n = senders->sent++;
+            int length = snprintf(texts[count], sizeof(texts[count]),
+                                  "{\"sensor_id\": \"node_%03d\", \"temperature\": %.2f, \"seq\": %d, \"timestamp\": \"%s\"}",
+                                  n % senders->nodes, 20.0 + (n % 1000) / 100.0, n / senders->nodes, timestamp);
+            parts[count].iov_base = texts[count];
+            parts[count].iov_len = length;
+        }
+        messages[count].msg_hdr.msg_iov = &parts[count];
+        messages[count].msg_hdr.msg_iovlen = 1;
+        count++;
+    }
+
+    int sent = sendmmsg(senders->fd, messages, count, 0);
+    if (sent != count) {
+        printf("❌ sendmmsg sent %d of %d datagrams\n", sent, count);
+    }
+    senders->datagrams += sent > 0 ? sent : 0;
+    return monTime;
+}
+
+static int Bench_Gateway_Options(bench_senders_t* senders, standin_config_t* standin, int argc, char** argv)
+{
+    memset(senders, 0, sizeof(*senders));
+    memset(standin, 0, sizeof(*standin));
+    senders->fd = -1;
+    senders->nodes = BENCH_GATEWAY_NODES;
+    senders->readings = BENCH_GATEWAY_READINGS;
+    senders->rate = BENCH_GATEWAY_RATE;
+    senders->duplicates = BENCH_GATEWAY_DUPLICATES;
+    senders->random = BENCH_PIPELINE_SEED;
+    standin->latency_ms = BENCH_PIPELINE_LATENCY_MS;
+    standin->seed = BENCH_PIPELINE_SEED;
+
+    for (int i = 0; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--readings") == 0) senders->readings = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--rate") == 0) senders->rate = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--nodes") == 0) senders->nodes = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--duplicates") == 0) senders->duplicates = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--latency") == 0) standin->latency_ms = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--errors") == 0) standin->error_rate = atof(argv[i + 1]);
+        else {
+            printf("❌ Unknown gateway option %s\n", argv[i]);
+            return -1;
+        }
+    }
+    if (argc % 2 != 0 || senders->readings <= 0 || senders->rate <= 0 || senders->nodes <= 0 || senders->nodes > 1000 ||
+        senders->duplicates < 0 || senders->duplicates >= 1 || standin->latency_ms < 0 ||
+        standin->error_rate < 0 || standin->error_rate > 1)
+    {
+        printf("❌ Invalid gateway options\n");
+        return -1;
+    }
+    return 0;
+}
+
+        // Gateway mode under load: simulated nodes send JSON readings over UDP at a fixed rate
+        // (some twice), the node forwards them through the real uploader to the stand-in.
+        // Everything runs on this one thread on the virtual clock, so real time over virtual
+        // time is the share of one core that receiving, deduplicating, batching and uploading
+        // take at that rate - sending and serving included.
+static int Bench_Gateway(int argc, char** argv)
+{
+    bench_senders_t senders;
+    standin_config_t standin;
+    if (Bench_Gateway_Options(&senders, &standin, argc, argv) < 0) {
+        return 1;
+    }
+
+    Log_Flush();
+    Clock_Use_Virtual(1000000, BENCH_START_EPOCH_MS);
+    Log_Init(-1);
+
+    Smw_Init();
+    if (Standin_Start(&standin) < 0) {
+        printf("❌ Stand-in server did not start\n");
+        return 1;
+    }
+
+    config_t config;
+    Config_Defaults(&config);
+    snprintf(config.server_host, sizeof(config.server_host), "127.0.0.1");
+    config.server_port = Standin_Port();
+    config.payload_encoding = ENCODING_JSON;
+    config.aggregation = AGGREGATE_RAW;
+    Config_Publish(&config);
+
+    task_context_t ctx = {0};
+    ctx.state = STATE_INITIALIZE;
+    ctx.measurement_interval = config.measurement_interval;
+    ctx.batch_max_records = GATEWAY_BATCH_MAX_RECORDS;
+    ctx.batch_max_bytes = GATEWAY_BATCH_MAX_BYTES;
+    ctx.encoder = Encoder_Get(config.payload_encoding);
+    ctx.aggregation = config.aggregation;
+    ctx.sample_interval_ms = config.sample_interval_ms;
+    ctx.seed = BENCH_PIPELINE_SEED;
+    Retry_Init(&ctx.retry, RETRY_BASE_MS, RETRY_CAP_MS, BREAKER_THRESHOLD, ctx.seed);
+
+    unlink(BENCH_STORE_FILE);
+    if (Store_Open(&ctx.backlog, BENCH_STORE_FILE, STORE_CAPACITY, STORE_OVERWRITE_OLDEST) < 0) {
+        printf("❌ Cannot open %s\n", BENCH_STORE_FILE);
+        return 1;
+    }
+    ctx.task = Create_Smw_Task(&ctx, (uint64_t (*)(void*, uint64_t))Sensor_State_Machine, SMW_PRIO_NORMAL);
+    if (!ctx.task || Gateway_Start(0, &ctx.backlog, Sensor_Records_Queued, &ctx) < 0) {
+        printf("❌ Gateway did not start\n");
+        return 1;
+    }
+    ctx.queue = Gateway_Queue();
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)Gateway_Port());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    senders.fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    smw_task_t* sender_task = Create_Smw_Task(&senders, Bench_Gateway_Send, SMW_PRIO_LOW);
+    if (senders.fd < 0 || connect(senders.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || !sender_task) {
+        printf("❌ Cannot set up the senders\n");
+        return 1;
+    }
+
+    const gateway_stats_t* gateway = Gateway_Stats();
+    const standin_stats_t* stats = Standin_Stats();
+    uint32_t peak_queue = 0;
+    uint32_t peak_backlog = 0;
+    uint64_t started_ms = Smw_Now_Ms();
+    double real_start = Bench_Seconds();
+    senders.started_ms = started_ms;
+
+    // Done once every reading sent was taken by the gateway and is gone from queue and backlog
+    while (senders.sent < senders.readings || gateway->datagrams < senders.datagrams ||
+           Spsc_Count(ctx.queue) > 0 || Store_Count(&ctx.backlog) > 0)
+    {
+        Execute_Smw_Task(Smw_Now_Ms());
+        Log_Flush();
+
+        uint32_t queued = Spsc_Count(ctx.queue);
+        uint32_t backlog = Store_Count(&ctx.backlog);
+        if (queued > peak_queue) peak_queue = queued;
+        if (backlog > peak_backlog) peak_backlog = backlog;
+        Smw_Wait_Until(Smw_Next_Deadline());
+    }
+
+    double real_seconds = Bench_Seconds() - real_start;
+    double virtual_seconds = (Smw_Now_Ms() - started_ms) / 1000.0;
+    char p50[24], p99[24];
+
+    printf("Gateway benchmark: %d nodes over UDP at %d readings/sec, %.1f%% sent twice, stand-in latency %d ms, %.1f%% errors\n",
+           senders.nodes, senders.rate, 100.0 * senders.duplicates, standin.latency_ms, 100.0 * standin.error_rate);
+    printf("  readings     %d sent in %lu datagrams, %lu accepted, %lu duplicates dropped, %lu rejected, %lu lost\n",
+           senders.sent, senders.datagrams, gateway->accepted, gateway->duplicates, gateway->rejected, gateway->lost);
+    printf("  cpu          %.1f s virtual in %.2f s real: %.0f%% of one core (senders and stand-in included),"
+           " %.0f readings/sec at most\n", virtual_seconds, real_seconds,
+           virtual_seconds > 0 ? 100.0 * real_seconds / virtual_seconds : 0.0,
+           real_seconds > 0 ? senders.sent / real_seconds : 0.0);
+    printf("  upstream     %lu requests, %.1f readings each (%lu with resends), %lu answered 503\n",
+           stats->requests, stats->requests ? (double)stats->records / stats->requests : 0.0, stats->records, stats->errors);
+    printf("  memory       queue peak %u of %d, backlog peak %u of %d (%lu spilled, %lu overwritten)\n",
+           peak_queue, GATEWAY_QUEUE_SLOTS, peak_backlog, STORE_CAPACITY, gateway->spilled, ctx.backlog.dropped);
+    printf("  latency      p50 %s, p99 %s (sent until the server took it, virtual time)\n",
+           Bench_Duration(p50, sizeof(p50), Metrics_Percentile(&stats->latency, 0.50)),
+           Bench_Duration(p99, sizeof(p99), Metrics_Percentile(&stats->latency, 0.99)));
+
+    Smw_Timer_Cancel(&ctx.read_timer);
+    Smw_Timer_Cancel(&ctx.phase_timer);
+    Smw_Timer_Cancel(&ctx.retry_timer);
+    Smw_Timer_Cancel(&ctx.flush_timer);
+    Smw_Timer_Cancel(&ctx.save_timer);
+    Smw_Timer_Cancel(&ctx.commit_timer);
+    Free_Smw_Task(sender_task);
+    Free_Smw_Task(ctx.task);
+    close(senders.fd);
+    Gateway_Stop();
+    Standin_Stop();
+    Store_Close(&ctx.backlog);
+    unlink(BENCH_STORE_FILE);
+    return 0;
+}
+
+/* ---- Backlog recovery ---- */
+
+// One crash: what the node did before it, and the records a restart must find
+typedef struct {
+    const char* name;
+    uint32_t (*before_crash)(store_t* store);
+    uint64_t untouched_seq;          // A record after the end of the log that must stay on disk, 0 = none
+} bench_crash_t;
+
+static void Bench_Crash_Append(store_t* store, int count)
+{
+    char reading[64];
+    for (int i = 0; i < count; i++)
+    {
+        int length = snprintf(reading, sizeof(reading), "{\"sensor_id\": \"bench\", \"seq\": %d}", i);
+        Store_Append(store, reading, length, STORE_TYPE_JSON);
+    }
+}
+
+        // A batch acked while still cached never reaches its slots; the next group is synced
+static uint32_t Bench_Crash_Acked_Cache(store_t* store)
+{
+    Bench_Crash_Append(store, BENCH_RECOVERY_GROUP - 1);
+    Store_Ack(store, BENCH_RECOVERY_GROUP - 1);
+    Bench_Crash_Append(store, BENCH_RECOVERY_GROUP);
+    return BENCH_RECOVERY_GROUP;
+}
+
+        // Groups synced after the last checkpoint are found by the scan
+static uint32_t Bench_Crash_After_Checkpoint(store_t* store)
+{
+    Bench_Crash_Append(store, 5 * BENCH_RECOVERY_GROUP);
+    Store_Commit(store);
+    return 5 * BENCH_RECOVERY_GROUP;
+}
+
+        // One record of a group torn on disk: the log ends before it, the rest of the group goes
+static uint32_t Bench_Crash_Torn(store_t* store)
+{
+    Bench_Crash_Append(store, 2 * BENCH_RECOVERY_GROUP);
+    Store_Commit(store);
+
+    char torn = 'X';
+    off_t offset = (off_t)sizeof(store_header_t) + 10 * store->slot_size + sizeof(store_record_t);
+    return pwrite(store->fd, &torn, 1, offset) == 1 ? 10 : UINT32_MAX;
+}
+
+        // A slot that was never written ends the log without proving the records after it torn
+static uint32_t Bench_Crash_Unwritten(store_t* store)
+{
+    Bench_Crash_Append(store, 2 * BENCH_RECOVERY_GROUP);
+    Store_Commit(store);
+
+    store_record_t never = {0};
+    off_t offset = (off_t)sizeof(store_header_t) + 10 * store->slot_size;
+    return pwrite(store->fd, &never, sizeof(never), offset) == (ssize_t)sizeof(never) ? 10 : UINT32_MAX;
+}
+
+        // A header damaged along with its capacity: the geometry comes from the file size
+static uint32_t Bench_Crash_Header_Capacity(store_t* store)
+{
+    Bench_Crash_Append(store, 2 * BENCH_RECOVERY_GROUP);
+    Store_Commit(store);
+
+    uint32_t capacity = 0x7fffffff;
+    off_t offset = offsetof(store_header_t, capacity);
+    return pwrite(store->fd, &capacity, sizeof(capacity), offset) == (ssize_t)sizeof(capacity) ? 2 * BENCH_RECOVERY_GROUP : UINT32_MAX;
+}
+
+        // A file cut short behind a good header: the missing slots come back empty and end the log
+static uint32_t Bench_Crash_File_Short(store_t* store)
+{
+    Bench_Crash_Append(store, 2 * BENCH_RECOVERY_GROUP);
+    Store_Commit(store);
+
+    off_t size = (off_t)sizeof(store_header_t) + 12 * store->slot_size;
+    return ftruncate(store->fd, size) == 0 ? 12 : UINT32_MAX;
+}
+
+        // Crashes the backlog at known points - the file is reopened beside the running store,
+        // which is what a restart would find as both share the page cache. Returns the failures.
+static int Bench_Recovery(void)
+{
+    static const bench_crash_t crashes[] = {
+        { "acked from the cache, next group synced", Bench_Crash_Acked_Cache, 0 },
+        { "groups synced after the checkpoint", Bench_Crash_After_Checkpoint, 0 },
+        { "record torn inside its group", Bench_Crash_Torn, 0 },
+        { "slot never written", Bench_Crash_Unwritten, 11 },
+        { "header capacity damaged", Bench_Crash_Header_Capacity, 0 },
+        { "file cut short", Bench_Crash_File_Short, 0 },
+    };
+    int failures = 0;
+
+    Log_Flush();
+    Log_Init(-1);
+    printf("Backlog recovery: %d slots, groups of %d\n", BENCH_RECOVERY_CAPACITY, BENCH_RECOVERY_GROUP);
+    for (size_t i = 0; i < sizeof(crashes) / sizeof(crashes[0]); i++)
+    {
+        store_t store, restarted;
+        unlink(BENCH_STORE_FILE);
+        if (Store_Open(&store, BENCH_STORE_FILE, BENCH_RECOVERY_CAPACITY, STORE_OVERWRITE_OLDEST) < 0) {
+            printf("❌ Cannot open %s\n", BENCH_STORE_FILE);
+            return 1;
+        }
+        Store_Set_Commit(&store, BENCH_RECOVERY_GROUP, 0, STORE_DURABILITY_GROUP);
+
+        uint32_t expected = crashes[i].before_crash(&store);
+        uint32_t found = UINT32_MAX;
+        int untouched = 1;
+        if (Store_Open(&restarted, BENCH_STORE_FILE, BENCH_RECOVERY_CAPACITY, STORE_OVERWRITE_OLDEST) == 0)
+        {
+            found = Store_Count(&restarted);
+            if (crashes[i].untouched_seq)
+            {
+                store_record_t record;
+                off_t offset = (off_t)sizeof(store_header_t) + (off_t)crashes[i].untouched_seq * restarted.slot_size;
+                untouched = pread(restarted.fd, &record, sizeof(record), offset) == (ssize_t)sizeof(record) &&
+                            record.seq == crashes[i].untouched_seq;
+            }
+            Store_Close(&restarted);
+        }
+        Store_Close(&store);
+
+        int ok = found == expected && untouched;
+        failures += !ok;
+        printf("  %s %-42s %u of %u records found%s\n", ok ? "✅" : "❌", crashes[i].name, found, expected,
+               untouched ? "" : ", later records cleared");
+    }
+    unlink(BENCH_STORE_FILE);
+    return failures;
+}
+
+int Run_Benchmarks(int argc, char** argv)
+{
+    if (argc >= 3 && strcmp(argv[2], "recovery") == 0) {
+        return Bench_Recovery() > 0;
+    }
+    if (argc >= 3 && strcmp(argv[2], "pipeline") == 0) {
+        return Bench_Pipeline(argc - 3, argv + 3);
+    }
+    if (argc >= 3 && strcmp(argv[2], "gateway") == 0) {
+        return Bench_Gateway(argc - 3, argv + 3);
+    }
+
+    int count = BENCH_READINGS;
+    if (argc >= 3) {
+        count = atoi(argv[2]);
+        if (count <= 0) {
+            printf("❌ Invalid reading count %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    Sensor_Data_t* readings = malloc(count * sizeof(Sensor_Data_t));
+    if (!readings) {
+        printf("❌ Failed to allocate %d readings\n", count);
+        return 1;
+    }
+    Bench_Fill_Readings(readings, count);
+
+    printf("Encoder benchmark: %d readings\n", count);
+    Bench_Encoder(Encoder_Get(ENCODING_JSON), readings, count);
+    Bench_Encoder(Encoder_Get(ENCODING_FRAME), readings, count);
+    Bench_Batches(readings, count);
+    Bench_Channels();
+    Bench_Aggregation();
+
+    free(readings);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include "../include/channel.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Simulated sources, one row per kind: start value, noise and drift amplitude, valid range
+typedef struct {
+    const char* quantity;
+    const char* unit;
+    double start;
+    double noise;
+    double drift;
+    double min;
+    double max;
+} channel_kind_info_t;
+
+static const channel_kind_info_t channel_kinds[] = {
+    [CHANNEL_TEMPERATURE] = { "temperature", "°C",    23.0, 1.0, 0.1, -15.0,   35.0 },
+    [CHANNEL_HUMIDITY]    = { "humidity",    "%RH",   45.0, 2.0, 0.2,   0.0,  100.0 },
+    [CHANNEL_PRESSURE]    = { "pressure",    "hPa", 1013.0, 0.5, 0.1, 950.0, 1050.0 },
+};
+
+        // Carves the registry and the ring from arena. Call before the arena's cycle mark.
+int Channel_Set_Init(channel_set_t* set, arena_t* arena, int max_channels, uint32_t rows)
+{
+    if (!set || !arena || max_channels <= 0 || rows == 0) return -1;
+
+    memset(set, 0, sizeof(*set));
+    set->channels = Arena_Alloc(arena, (size_t)max_channels * sizeof(channel_t));
+    set->timestamps = Arena_Alloc(arena, (size_t)rows * sizeof(int64_t));
+    set->values = Arena_Alloc(arena, (size_t)max_channels * rows * sizeof(double));
+    if (!set->channels || !set->timestamps || !set->values) {
+        LOG_ERROR("ev=channel_ring_alloc_failed channels=%d rows=%u", max_channels, rows);
+        return -1;
+    }
+    set->max_channels = max_channels;
+    set->rows = rows;
+    Channel_Seed(set, 0);
+    return 0;
+}
+
+        // Restarts the simulated signal's PRNG. Seed 0 picks a fixed default.
+void Channel_Seed(channel_set_t* set, uint64_t seed)
+{
+    if (set) {
+        set->random = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    }
+}
+
+        // Replaces the simulated signal, NULL goes back to it
+void Channel_Set_Source(channel_set_t* set, const channel_source_t* source)
+{
+    if (!set) return;
+    if (source) {
+        set->source = *source;
+    } else {
+        memset(&set->source, 0, sizeof(set->source));
+    }
+}
+
+        // xorshift64*: uniform in [0, 1), cheap and the same on every platform
+static double Channel_Random(channel_set_t* set)
+{
+    uint64_t x = set->random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    set->random = x;
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+        // Sawtooth around the kind's start value, 0.1 units per step - no state, no randomness
+static double Channel_Synthetic(void* state, const channel_t* channel, int index, int64_t epoch_ms)
+{
+    (void)state;
+    return channel_kinds[channel->kind].start + (double)((epoch_ms / 100 + index) % 50) / 10.0;
+}
+
+const channel_source_t channel_source_synthetic = { "synthetic", Channel_Synthetic, NULL };
+
+        // Registers a channel. Returns its index, or -1 when the registry is full.
+        // Channels are added before sampling starts - rows already taken have no value for it.
+int Channel_Add(channel_set_t* set, const char* id, channel_kind_t kind)
+{
+    if (!set || !id || (int)kind < 0 || kind >= (int)(sizeof(channel_kinds) / sizeof(channel_kinds[0]))) return -1;
+
+    if (set->count >= set->max_channels) {
+        LOG_ERROR("ev=channel_registry_full max=%d id=%s", set->max_channels, id);
+        return -1;
+    }
+
+    channel_t* channel = &set->channels[set->count];
+    snprintf(channel->id, sizeof(channel->id), "%s", id);
+    channel->kind = kind;
+    channel->level = channel_kinds[kind].start;
+    channel->min = channel_kinds[kind].min;
+    channel->max = channel_kinds[kind].max;
+    return set->count++;
+}
+
+        // Renames a channel and sets its range in place - its samples in the ring are kept
+int Channel_Configure(channel_set_t* set, int channel, const char* id, double min, double max)
+{
+    if (!set || !id || channel < 0 || channel >= set->count || min >= max) return -1;
+
+    channel_t* target = &set->channels[channel];
+    snprintf(target->id, sizeof(target->id), "%s", id);
+    target->min = min;
+    target->max = max;
+    if (target->level < min || target->level > max) {
+        target->level = (min + max) / 2;
+    }
+    return 0;
+}
+
+        // One pass over every channel: takes a sample of each into a new row.
+        // Returns the row's index among the pending rows.
+int Channel_Sample_All(channel_set_t* set, int64_t epoch_ms)
+{
+    if (!set || set->count == 0) return -1;
+
+    if (set->tail - set->head >= set->rows) {
+        set->head++;
+        set->dropped++;
+    }
+
+    uint32_t slot = (uint32_t)(set->tail % set->rows);
+    set->timestamps[slot] = epoch_ms;
+
+    double* column = set->values + slot;
+    for (int c = 0; c < set->count; c++, column += set->rows)
+    {
+        channel_t* channel = &set->channels[c];
+        if (set->source.sample) {
+            *column = set->source.sample(set->source.state, channel, c, epoch_ms);
+            continue;
+        }
+        const channel_kind_info_t* kind = &channel_kinds[channel->kind];
+
+        double noise = (Channel_Random(set) - 0.5) * kind->noise;
+        channel->level += (Channel_Random(set) - 0.5) * kind->drift;
+        if (channel->level < channel->min || channel->level > channel->max) {
+            channel->level = (kind->start >= channel->min && kind->start <= channel->max)
+                           ? kind->start : (channel->min + channel->max) / 2;
+        }
+        *column = channel->level + noise;
+    }
+
+    set->tail++;
+    return (int)(set->tail - set->head - 1);
+}
+
+uint32_t Channel_Pending(const channel_set_t* set)
+{
+    return set ? (uint32_t)(set->tail - set->head) : 0;
+}
+
+        // Points at count pending rows of one channel starting at pending row first.
+        // The ring may wrap inside the window: returns how many rows are contiguous
+        // (call again from first + returned for the rest), 0 when there is nothing.
+int Channel_Window(const channel_set_t* set, int channel, uint32_t first, uint32_t count,
+                   const int64_t** timestamps, const double** values)
+{
+    if (!set || channel < 0 || channel >= set->count || first >= Channel_Pending(set)) return 0;
+
+    if (count > Channel_Pending(set) - first) {
+        count = Channel_Pending(set) - first;
+    }
+    uint32_t slot = (uint32_t)((set->head + first) % set->rows);
+    if (count > set->rows - slot) {
+        count = set->rows - slot;
+    }
+
+    *timestamps = set->timestamps + slot;
+    *values = set->values + (size_t)channel * set->rows + slot;
+    return (int)count;
+}
+
+        // Forgets the oldest count rows, for all channels at once
+void Channel_Consume(channel_set_t* set, uint32_t count)
+{
+    if (!set) return;
+    if (count > Channel_Pending(set)) count = Channel_Pending(set);
+    set->head += count;
+}
+
+const char* Channel_Quantity(channel_kind_t kind)
+{
+    return channel_kinds[kind].quantity;
+}
+
+const char* Channel_Unit(channel_kind_t kind)
+{
+    return channel_kinds[kind].unit;
+}
@@ -0,0 +1,57 @@
+#define _POSIX_C_SOURCE 200112L
+#include "../include/clock.h"
+#include <time.h>
+
+static int clock_virtual = 0;
+static uint64_t clock_virtual_us = 0;    // Virtual monotonic time, only ever moves forward
+static uint64_t clock_virtual_start_us = 0;
+static int64_t clock_virtual_wall_ms = 0;   // Wall time at clock_virtual_start_us
+
+uint64_t Clock_Now_Us(void)
+{
+    if (clock_virtual) {
+        return __atomic_load_n(&clock_virtual_us, __ATOMIC_RELAXED);
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+uint64_t Clock_Now_Ms(void)
+{
+    return Clock_Now_Us() / 1000;
+}
+
+        // Epoch milliseconds for reading timestamps
+int64_t Clock_Wall_Ms(void)
+{
+    if (clock_virtual) {
+        return clock_virtual_wall_ms + (int64_t)((Clock_Now_Us() - clock_virtual_start_us) / 1000);
+    }
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    return (int64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000;
+}
+
+        // Freezes time at start_us (monotonic) / wall_ms (epoch). Call before anything
+        // reads the clock - deadlines taken from the real clock mean nothing afterwards.
+void Clock_Use_Virtual(uint64_t start_us, int64_t wall_ms)
+{
+    clock_virtual_start_us = start_us;
+    clock_virtual_wall_ms = wall_ms;
+    __atomic_store_n(&clock_virtual_us, start_us, __ATOMIC_RELAXED);
+    clock_virtual = 1;
+}
+
+int Clock_Is_Virtual(void)
+{
+    return clock_virtual;
+}
+
+        // Moves virtual time forward to to_us; earlier times are ignored
+void Clock_Advance(uint64_t to_us)
+{
+    if (clock_virtual && to_us > __atomic_load_n(&clock_virtual_us, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&clock_virtual_us, to_us, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,401 @@
+#define _DEFAULT_SOURCE
+#include "../include/smw.h"
+#include "../include/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+
+#define CONFIG_POLL_MS 1000          // Event check interval when epoll is not available
+
+// Two slots: the published snapshot and the one a reload parses into
+static config_t config_slots[2];
+static const config_t* config_current = NULL;
+static int config_staged = 0;        // The other slot holds a validated snapshot waiting for Config_Apply()
+static unsigned long config_generation = 0;
+static char config_path[CONFIG_PATH_MAX];
+
+static int config_signal_fd = -1;
+static int config_inotify_fd = -1;
+static smw_task_t* config_task = NULL;
+static void (*config_on_staged)(void*) = NULL;   // Told when a snapshot is waiting
+static void* config_on_staged_context = NULL;
+
+void Config_Defaults(config_t* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->measurement_interval = DEFAULT_MEASUREMENT_INTERVAL;
+    snprintf(config->device_id, sizeof(config->device_id), "%s", DEFAULT_SENSOR_ID);
+    snprintf(config->server_host, sizeof(config->server_host), "%s", DEFAULT_SERVER_HOST);
+    config->server_port = DEFAULT_SERVER_PORT;
+    config->connection_timeout = DEFAULT_CONNECTION_TIMEOUT;
+    snprintf(config->backup_file, sizeof(config->backup_file), "%s", DEFAULT_BACKUP_FILE);
+    config->temperature_min = -15.0;
+    config->temperature_max = 35.0;
+    config->payload_encoding = DEFAULT_ENCODING;
+    config->aggregation = DEFAULT_AGGREGATION;
+    config->sample_interval_ms = SAMPLE_INTERVAL_MS;
+    config->deadband = DEADBAND_DEFAULT;
+    config->batch_flush_ms = DEFAULT_BATCH_FLUSH_MS;
+    config->commit_records = DEFAULT_COMMIT_RECORDS;
+    config->commit_ms = DEFAULT_COMMIT_MS;
+    config->durability = DEFAULT_DURABILITY;
+    config->retention_max_bytes = DEFAULT_RETENTION_MAX_BYTES;
+    config->retention_max_age_s = DEFAULT_RETENTION_MAX_AGE_S;
+    config->retention_policy = DEFAULT_RETENTION_POLICY;
+    config->threaded = DEFAULT_THREADED;
+    config->gateway_port = DEFAULT_GATEWAY_PORT;
+}
+
+/* ---- Parsing ---- */
+
+static char* Config_Trim(char* text)
+{
+    while (*text == ' ' || *text == '\t') text++;
+
+    char* end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return text;
+}
+
+static int Config_Int(const char* value, int min, int max, int* out)
+{
+    char* end;
+    errno = 0;
+    long number = strtol(value, &end, 10);
+    if (errno || end == value || *end != '\0' || number < min || number > max) {
+        return -1;
+    }
+    *out = (int)number;
+    return 0;
+}
+
+static int Config_Double(const char* value, double min, double max, double* out)
+{
+    char* end;
+    errno = 0;
+    double number = strtod(value, &end);
+    if (errno || end == value || *end != '\0' || number < min || number > max) {
+        return -1;
+    }
+    *out = number;
+    return 0;
+}
+
+static int Config_String(const char* value, char* out, size_t size)
+{
+    size_t length = strlen(value);
+    if (length == 0 || length >= size) {
+        return -1;
+    }
+    memcpy(out, value, length + 1);
+    return 0;
+}
+
+        // Applies one key. Returns 0, -1 for a bad value, 1 for a key we do not know.
+static int Config_Set(config_t* config, const char* key, const char* value)
+{
+    if (strcmp(key, "measurement_interval") == 0)
+        return Config_Int(value, CONFIG_INTERVAL_MIN, CONFIG_INTERVAL_MAX, &config->measurement_interval);
+    if (strcmp(key, "device_id") == 0)
+        return Config_String(value, config->device_id, sizeof(config->device_id));
+    if (strcmp(key, "server_host") == 0)
+        return Config_String(value, config->server_host, sizeof(config->server_host));
+    if (strcmp(key, "server_port") == 0)
+        return Config_Int(value, 1, 65535, &config->server_port);
+    if (strcmp(key, "connection_timeout") == 0)
+        return Config_Int(value, CONFIG_TIMEOUT_MIN, CONFIG_TIMEOUT_MAX, &config->connection_timeout);
+    if (strcmp(key, "backup_file") == 0)
+        return Config_String(value, config->backup_file, sizeof(config->backup_file));
+    if (strcmp(key, "temperature_min") == 0)
+        return Config_Double(value, -100.0, 200.0, &config->temperature_min);
+    if (strcmp(key, "temperature_max") == 0)
+        return Config_Double(value, -100.0, 200.0, &config->temperature_max);
+    if (strcmp(key, "sample_interval_ms") == 0)
+        return Config_Int(value, CONFIG_SAMPLE_MS_MIN, CONFIG_SAMPLE_MS_MAX, &config->sample_interval_ms);
+    if (strcmp(key, "deadband") == 0)
+        return Config_Double(value, 0.0, 1000.0, &config->deadband);
+    if (strcmp(key, "batch_flush_ms") == 0)
+        return Config_Int(value, 0, CONFIG_BATCH_FLUSH_MS_MAX, &config->batch_flush_ms);
+    if (strcmp(key, "commit_records") == 0)
+        return Config_Int(value, 1, STORE_CACHE_SLOTS, &config->commit_records);
+    if (strcmp(key, "commit_ms") == 0)
+        return Config_Int(value, 0, CONFIG_COMMIT_MS_MAX, &config->commit_ms);
+    if (strcmp(key, "retention_max_bytes") == 0)
+        return Config_Int(value, 0, CONFIG_RETENTION_BYTES_MAX, &config->retention_max_bytes);
+    if (strcmp(key, "retention_max_age_s") == 0)
+        return Config_Int(value, 0, CONFIG_RETENTION_AGE_MAX, &config->retention_max_age_s);
+    if (strcmp(key, "threaded") == 0)
+        return Config_Int(value, 0, 1, &config->threaded);
+    if (strcmp(key, "gateway_port") == 0)
+        return Config_Int(value, 0, 65535, &config->gateway_port);
+
+    if (strcmp(key, "payload_encoding") == 0)
+    {
+        if (strcasecmp(value, "json") == 0) config->payload_encoding = ENCODING_JSON;
+        else if (strcasecmp(value, "frame") == 0) config->payload_encoding = ENCODING_FRAME;
+        else return -1;
+        return 0;
+    }
+    if (strcmp(key, "durability") == 0)
+    {
+        if (strcasecmp(value, "write") == 0) config->durability = STORE_DURABILITY_WRITE;
+        else if (strcasecmp(value, "group") == 0) config->durability = STORE_DURABILITY_GROUP;
+        else if (strcasecmp(value, "record") == 0) config->durability = STORE_DURABILITY_RECORD;
+        else return -1;
+        return 0;
+    }
+    if (strcmp(key, "retention_policy") == 0)
+    {
+        if (strcasecmp(value, "drop") == 0) config->retention_policy = RETENTION_DROP_OLDEST;
+        else if (strcasecmp(value, "downsample") == 0) config->retention_policy = RETENTION_DOWNSAMPLE_OLDEST;
+        else return -1;
+        return 0;
+    }
+    if (strcmp(key, "aggregation") == 0)
+    {
+        if (strcasecmp(value, "raw") == 0) config->aggregation = AGGREGATE_RAW;
+        else if (strcasecmp(value, "window") == 0) config->aggregation = AGGREGATE_WINDOW;
+        else if (strcasecmp(value, "deadband") == 0) config->aggregation = AGGREGATE_DEADBAND;
+        else return -1;
+        return 0;
+    }
+    return 1;
+}
+
+        // Parses path over the defaults into config. Returns 0 for a valid snapshot, -1 if the
+        // file cannot be read or any value is out of range (config is then unusable).
+int Config_Load(const char* path, config_t* config)
+{
+    char text[CONFIG_MAX_SIZE];
+
+    Config_Defaults(config);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_WARN("ev=config_missing path=%s", path);
+        return -1;
+    }
+    ssize_t length = 0, n;
+    while ((n = read(fd, text + length, sizeof(text) - length)) > 0 && length + n < (ssize_t)sizeof(text)) {
+        length += n;
+    }
+    close(fd);
+    if (n < 0 || length + n >= (ssize_t)sizeof(text)) {
+        LOG_ERROR("ev=config_unreadable path=%s max_bytes=%d", path, CONFIG_MAX_SIZE);
+        return -1;
+    }
+    text[length] = '\0';
+
+    int errors = 0;
+    int line_number = 0;
+    char* line = text;
+    while (line)
+    {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        line_number++;
+
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        line = Config_Trim(line);
+
+        if (*line)
+        {
+            char* equals = strchr(line, '=');
+            if (!equals) {
+                LOG_ERROR("ev=config_invalid path=%s line=%d reason=not_key_value", path, line_number);
+                errors++;
+            }
+            else {
+                *equals = '\0';
+                char* key = Config_Trim(line);
+                char* value = Config_Trim(equals + 1);
+                int rc = Config_Set(config, key, value);
+                if (rc < 0) {
+                    LOG_ERROR("ev=config_invalid path=%s line=%d key=%s value=\"%s\"", path, line_number, key, value);
+                    errors++;
+                }
+                else if (rc > 0) {
+                    LOG_WARN("ev=config_unknown_key path=%s line=%d key=%s", path, line_number, key);
+                }
+            }
+        }
+        line = next;
+    }
+
+    if (config->temperature_min >= config->temperature_max) {
+        LOG_ERROR("ev=config_invalid path=%s reason=temperature_min_not_below_max", path);
+        errors++;
+    }
+    return errors ? -1 : 0;
+}
+
+/* ---- Snapshots ---- */
+
+        // Loads the startup snapshot. A missing or invalid file leaves the built-in defaults.
+int Config_Init(const char* path)
+{
+    snprintf(config_path, sizeof(config_path), "%s", path);
+
+    config_t* slot = &config_slots[0];
+    int rc = Config_Load(config_path, slot);
+    if (rc < 0) {
+        LOG_INFO("ev=config_defaults");
+        Config_Defaults(slot);
+    }
+    else {
+        LOG_INFO("ev=config_loaded path=%s", config_path);
+    }
+    slot->generation = ++config_generation;
+    config_current = slot;
+    config_staged = 0;
+    return rc;
+}
+
+const config_t* Config_Current(void)
+{
+    if (!config_current) {
+        Config_Defaults(&config_slots[0]);
+        config_current = &config_slots[0];
+    }
+    return config_current;
+}
+
+        // Parses the file into the spare slot. The published snapshot is untouched, and an
+        // invalid file is rejected as a whole - the running configuration stays in force.
+int Config_Stage(void)
+{
+    config_t* spare = (config_current == &config_slots[0]) ? &config_slots[1] : &config_slots[0];
+
+    config_staged = 0;
+    if (Config_Load(config_path, spare) < 0) {
+        LOG_ERROR("ev=config_rejected keeping_generation=%lu", Config_Current()->generation);
+        return -1;
+    }
+    spare->generation = config_generation + 1;
+    config_staged = 1;
+    LOG_INFO("ev=config_staged generation=%lu", spare->generation);
+    return 0;
+}
+
+        // Publishes a staged snapshot. Called by the sensor task between cycles; returns the
+        // new snapshot, or NULL if nothing changed.
+const config_t* Config_Apply(void)
+{
+    if (!config_staged) {
+        return NULL;
+    }
+    config_staged = 0;
+    config_current = (config_current == &config_slots[0]) ? &config_slots[1] : &config_slots[0];
+    config_generation = config_current->generation;
+    LOG_INFO("ev=config_active generation=%lu", config_generation);
+    return config_current;
+}
+
+        // Publishes a snapshot built in code instead of read from a file (the benchmark
+        // harness). Not range-checked, so an interval of 0 samples as fast as the loop runs.
+        // Call before the sensor task starts.
+const config_t* Config_Publish(const config_t* config)
+{
+    config_t* slot = (config_current == &config_slots[0]) ? &config_slots[1] : &config_slots[0];
+    *slot = *config;
+    slot->generation = ++config_generation;
+    config_current = slot;
+    config_staged = 0;
+    LOG_INFO("ev=config_active generation=%lu source=code", config_generation);
+    return config_current;
+}
+
+/* ---- Reload triggers: SIGHUP and the file changing ---- */
+
+        // Drains both descriptors and stages a reload if either fired
+static uint64_t Config_Task(void* context, uint64_t monTime)
+{
+    (void)context;
+    int reload = 0;
+
+    struct signalfd_siginfo info;
+    while (config_signal_fd >= 0 && read(config_signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+        LOG_INFO("ev=sighup path=%s", config_path);
+        reload = 1;
+    }
+
+    // Editors replace the file (rename) or rewrite it - watch the directory for both
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const char* name = strrchr(config_path, '/');
+    name = name ? name + 1 : config_path;
+    ssize_t n;
+    while (config_inotify_fd >= 0 && (n = read(config_inotify_fd, events, sizeof(events))) > 0)
+    {
+        for (char* p = events; p < events + n; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->len > 0 && strcmp(event->name, name) == 0) {
+                reload = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (reload && Config_Stage() == 0 && config_on_staged) {
+        config_on_staged(config_on_staged_context);
+    }
+
+    if (config_task && Smw_Watch_Fd(config_task, config_signal_fd, EPOLLIN) == 0 &&
+        (config_inotify_fd < 0 || Smw_Watch_Fd(config_task, config_inotify_fd, EPOLLIN) == 0))
+    {
+        return UINT64_MAX;     // Woken by the descriptors only
+    }
+    return monTime + CONFIG_POLL_MS;
+}
+
+        // Blocks SIGHUP into a signalfd, watches the config directory with inotify and hands
+        // both to a low-priority task. Call after Smw_Init(). on_staged (optional) is called
+        // with context whenever a valid snapshot is staged.
+int Config_Watch(void (*on_staged)(void*), void* context)
+{
+    config_on_staged = on_staged;
+    config_on_staged_context = context;
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0 ||
+        (config_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    {
+        LOG_ERROR("ev=sighup_setup_failed errno=%d", errno);
+        return -1;
+    }
+
+    char dir[CONFIG_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", config_path);
+    char* slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+
+    config_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (config_inotify_fd >= 0 && inotify_add_watch(config_inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(config_inotify_fd);
+        config_inotify_fd = -1;
+    }
+    if (config_inotify_fd < 0) {
+        LOG_WARN("ev=inotify_unavailable reload=sighup_only");
+    }
+
+    config_task = Create_Smw_Task(NULL, Config_Task, SMW_PRIO_LOW);
+    if (!config_task) {
+        LOG_ERROR("ev=task_create_failed task=config");
+        return -1;
+    }
+    LOG_INFO("ev=config_watch path=%s", config_path);
+    return 0;
+}
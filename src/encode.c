@@ -0,0 +1,514 @@
+#define _GNU_SOURCE     // memmem(), timegm()
+#include "../include/encode.h"
+#include "../include/store.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const encoder_t encoders[] = {
+    [ENCODING_JSON]  = { "json",  JSON_CONTENT_TYPE,  STORE_TYPE_JSON,  Sensor_JSON,  Sensor_JSON_Window },
+    [ENCODING_FRAME] = { "frame", FRAME_CONTENT_TYPE, STORE_TYPE_FRAME, Frame_Encode, Frame_Encode_Window },
+};
+
+const encoder_t* Encoder_Get(encoding_t encoding)
+{
+    if ((int)encoding < 0 || encoding >= (int)(sizeof(encoders) / sizeof(encoders[0]))) {
+        return &encoders[DEFAULT_ENCODING];
+    }
+    return &encoders[encoding];
+}
+
+const encoder_t* Encoder_For_Store_Type(uint16_t store_type)
+{
+    for (size_t i = 0; i < sizeof(encoders) / sizeof(encoders[0]); i++)
+    {
+        if (encoders[i].store_type == store_type) {
+            return &encoders[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---- Little-endian helpers ---- */
+
+static void Put_Le(char* out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint64_t Get_Le(const char* in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)(unsigned char)in[i] << (8 * i);
+    }
+    return value;
+}
+
+        // Zigzag varint: small positive and negative deltas both take one or two bytes
+static int Put_Varint(char* out, int size, int64_t value)
+{
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    int n = 0;
+
+    do {
+        if (n >= size) return -1;
+        unsigned char byte = zigzag & 0x7F;
+        zigzag >>= 7;
+        out[n++] = (char)(zigzag ? (byte | 0x80) : byte);
+    } while (zigzag);
+
+    return n;
+}
+
+        // Reads one zigzag varint. Returns its bytes, 0 if available ends inside it, -1 if too long.
+static int Get_Varint(const char* in, int available, int64_t* value)
+{
+    uint64_t zigzag = 0;
+    for (int n = 0; n < 10; n++)
+    {
+        if (n >= available) return 0;
+        unsigned char byte = (unsigned char)in[n];
+        zigzag |= (uint64_t)(byte & 0x7F) << (7 * n);
+        if (!(byte & 0x80)) {
+            *value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            return n + 1;
+        }
+    }
+    return -1;
+}
+
+static int32_t Scale_Value(double value)
+{
+    return (int32_t)(value * 100.0 + (value >= 0 ? 0.5 : -0.5));
+}
+
+/* ---- Single reading frame ---- */
+
+static int Frame_Encode_Summary(const Sensor_Data_t* data, const char* id, int id_len, char* out, int out_size)
+{
+    const aggregate_t* window = data->summary;
+    int length = 3 + id_len + 8 + 4 + 4 + 4 * 4;
+    if (length > out_size) {
+        LOG_ERROR("ev=buffer_too_small what=frame needed=%d available=%d", length, out_size);
+        return -1;
+    }
+
+    char* p = out + 3 + id_len;
+    out[0] = FRAME_VERSION;
+    out[1] = FRAME_KIND_SUMMARY;
+    out[2] = (char)id_len;
+    memcpy(out + 3, id, id_len);
+    Put_Le(p, (uint64_t)window->first_ms, 8);
+    Put_Le(p + 8, (uint32_t)(window->last_ms - window->first_ms), 4);
+    Put_Le(p + 12, window->count, 4);
+    Put_Le(p + 16, (uint32_t)Scale_Value(window->min), 4);
+    Put_Le(p + 20, (uint32_t)Scale_Value(window->max), 4);
+    Put_Le(p + 24, (uint32_t)Scale_Value(window->mean), 4);
+    Put_Le(p + 28, (uint32_t)Scale_Value(Aggregate_Stddev(window)), 4);
+    return length;
+}
+
+int Frame_Encode(const Sensor_Data_t* data, char* out, int out_size)
+{
+    if (!data || !out) {
+        return -1;
+    }
+
+    const char* id = data->sensor_id ? data->sensor_id : "unknown";
+    int id_len = strlen(id);
+    if (id_len > FRAME_ID_MAX) id_len = FRAME_ID_MAX;
+
+    if (data->summary) {
+        return Frame_Encode_Summary(data, id, id_len, out, out_size);
+    }
+
+    int length = 3 + id_len + 8 + 4;
+    if (length > out_size) {
+        LOG_ERROR("ev=buffer_too_small what=frame needed=%d available=%d", length, out_size);
+        return -1;
+    }
+
+    out[0] = FRAME_VERSION;
+    out[1] = FRAME_KIND_READING;
+    out[2] = (char)id_len;
+    memcpy(out + 3, id, id_len);
+    Put_Le(out + 3 + id_len, (uint64_t)((int64_t)data->epoch * 1000), 8);
+    Put_Le(out + 3 + id_len + 8, (uint32_t)Scale_Value(data->value), 4);
+
+    return length;
+}
+
+        // The single reading frame Frame_Encode() builds, from a decoded reading (epoch in ms)
+int Frame_Encode_Reading(const frame_reading_t* reading, char* out, int out_size)
+{
+    int id_len = strlen(reading->sensor_id);
+    int length = 3 + id_len + 8 + 4;
+    if (length > out_size) {
+        return -1;
+    }
+
+    out[0] = FRAME_VERSION;
+    out[1] = FRAME_KIND_READING;
+    out[2] = (char)id_len;
+    memcpy(out + 3, reading->sensor_id, id_len);
+    Put_Le(out + 3 + id_len, (uint64_t)reading->epoch_ms, 8);
+    Put_Le(out + 3 + id_len + 8, (uint32_t)reading->value, 4);
+    return length;
+}
+
+int Frame_Decode(const char* frame, int length, frame_reading_t* reading)
+{
+    if (!frame || !reading || length < 3) {
+        return -1;
+    }
+
+    int id_len = (unsigned char)frame[2];
+    if (frame[0] != FRAME_VERSION || frame[1] != FRAME_KIND_READING || id_len > FRAME_ID_MAX ||
+        length != 3 + id_len + 12) {
+        return -1;
+    }
+
+    memcpy(reading->sensor_id, frame + 3, id_len);
+    reading->sensor_id[id_len] = '\0';
+    reading->epoch_ms = (int64_t)Get_Le(frame + 3 + id_len, 8);
+    reading->value = (int32_t)Get_Le(frame + 3 + id_len + 8, 4);
+    return 0;
+}
+
+        // Kind byte of a stored frame, -1 if it is too short to have one
+int Frame_Kind(const char* frame, int length)
+{
+    if (!frame || length < 3 || frame[0] != FRAME_VERSION) {
+        return -1;
+    }
+    return (unsigned char)frame[1];
+}
+
+        // Length of the frame data starts with, for frames arriving on a byte stream. Returns
+        // 0 while more bytes are needed, -1 if data does not start with a frame we know.
+int Frame_Length(const char* data, int available)
+{
+    if (available < 3) return available > 0 && data[0] != FRAME_VERSION ? -1 : 0;
+    if (data[0] != FRAME_VERSION) return -1;
+
+    int id_len = (unsigned char)data[2];
+    if (id_len > FRAME_ID_MAX) return -1;
+
+    int length;
+    switch ((unsigned char)data[1])
+    {
+        case FRAME_KIND_READING:
+            length = 3 + id_len + 8 + 4;
+            break;
+
+        case FRAME_KIND_SUMMARY:
+            length = 3 + id_len + 8 + 4 + 4 + 4 * 4;
+            break;
+
+        case FRAME_KIND_BATCH:
+        {
+            length = 3 + id_len + 2 + 8 + 4;
+            if (available < length) return 0;
+
+            int count = (int)Get_Le(data + 3 + id_len, 2);
+            if (count == 0) return -1;
+
+            for (int i = 0; i < 2 * (count - 1); i++)    // A pair of deltas per later reading
+            {
+                int64_t delta;
+                int n = Get_Varint(data + length, available - length, &delta);
+                if (n <= 0) return n;
+                length += n;
+            }
+            return length;
+        }
+
+        default:
+            return -1;
+    }
+    return available < length ? 0 : length;
+}
+
+/* ---- Delta-encoded batch frame ---- */
+
+        // A channel window in one pass over its columns - the same batch frame
+        // Frame_Batch_Add() builds, without a single frame per reading in between
+int Frame_Encode_Window(const char* sensor_id, const char* quantity, const int64_t* timestamps,
+                        const double* values, int count, char* out, int out_size)
+{
+    (void)quantity;     // The sensor id tells channels apart on the wire
+
+    if (!timestamps || !values || !out || count <= 0 || count > 0xFFFF) {
+        return -1;
+    }
+
+    const char* id = sensor_id ? sensor_id : "unknown";
+    int id_len = strlen(id);
+    if (id_len > FRAME_ID_MAX) id_len = FRAME_ID_MAX;
+
+    int used = 3 + id_len + 2 + 8 + 4;
+    if (used > out_size) {
+        return -1;
+    }
+
+    int32_t last_value = Scale_Value(values[0]);
+    out[0] = FRAME_VERSION;
+    out[1] = FRAME_KIND_BATCH;
+    out[2] = (char)id_len;
+    memcpy(out + 3, id, id_len);
+    Put_Le(out + 3 + id_len, (uint16_t)count, 2);
+    Put_Le(out + 3 + id_len + 2, (uint64_t)timestamps[0], 8);
+    Put_Le(out + 3 + id_len + 10, (uint32_t)last_value, 4);
+
+    for (int i = 1; i < count; i++)
+    {
+        int32_t value = Scale_Value(values[i]);
+        int n1 = Put_Varint(out + used, out_size - used, timestamps[i] - timestamps[i - 1]);
+        if (n1 < 0) return -1;
+        int n2 = Put_Varint(out + used + n1, out_size - used - n1, (int64_t)value - last_value);
+        if (n2 < 0) return -1;
+        used += n1 + n2;
+        last_value = value;
+    }
+    return used;
+}
+
+void Frame_Batch_Begin(frame_batch_t* batch, char* buffer, int size)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->buffer = buffer;
+    batch->size = size;
+}
+
+        // Appends one reading frame. Returns 0 when added, -1 when it does not fit or belongs
+        // to another sensor (start a new batch), -2 for a frame that cannot be decoded.
+int Frame_Batch_Add(frame_batch_t* batch, const char* frame, int length)
+{
+    frame_reading_t reading;
+    if (Frame_Decode(frame, length, &reading) < 0) {
+        return -2;
+    }
+
+    if (batch->count == 0)
+    {
+        int id_len = strlen(reading.sensor_id);
+        int header = 3 + id_len + 2 + 8 + 4;
+        if (header > batch->size) return -1;
+
+        char* out = batch->buffer;
+        out[0] = FRAME_VERSION;
+        out[1] = FRAME_KIND_BATCH;
+        out[2] = (char)id_len;
+        memcpy(out + 3, reading.sensor_id, id_len);
+        batch->count_offset = 3 + id_len;
+        Put_Le(out + batch->count_offset + 2, (uint64_t)reading.epoch_ms, 8);
+        Put_Le(out + batch->count_offset + 10, (uint32_t)reading.value, 4);
+        batch->used = header;
+    }
+    else
+    {
+        if (batch->count >= 0xFFFF || strcmp(reading.sensor_id, batch->last.sensor_id) != 0) {
+            return -1;
+        }
+
+        int n1 = Put_Varint(batch->buffer + batch->used, batch->size - batch->used,
+                            reading.epoch_ms - batch->last.epoch_ms);
+        if (n1 < 0) return -1;
+        int n2 = Put_Varint(batch->buffer + batch->used + n1, batch->size - batch->used - n1,
+                            (int64_t)reading.value - batch->last.value);
+        if (n2 < 0) return -1;
+        batch->used += n1 + n2;
+    }
+
+    batch->last = reading;
+    batch->count++;
+    return 0;
+}
+
+int Frame_Batch_End(frame_batch_t* batch)
+{
+    if (batch->count == 0) {
+        return 0;
+    }
+    Put_Le(batch->buffer + batch->count_offset, (uint16_t)batch->count, 2);
+    return batch->used;
+}
+
+        // Starts walking the readings of a reading or batch frame. Returns -1 for anything else.
+int Frame_Reader_Begin(frame_reader_t* reader, const char* frame, int length)
+{
+    memset(reader, 0, sizeof(*reader));
+    int kind = Frame_Kind(frame, length);
+    int id_len = length >= 3 ? (unsigned char)frame[2] : 0;
+
+    if (kind == FRAME_KIND_READING) {
+        if (Frame_Decode(frame, length, &reader->last) < 0) return -1;
+        reader->left = 1;
+        return 0;
+    }
+    if (kind != FRAME_KIND_BATCH || id_len > FRAME_ID_MAX || length < 3 + id_len + 2 + 8 + 4) {
+        return -1;
+    }
+
+    memcpy(reader->last.sensor_id, frame + 3, id_len);
+    reader->last.sensor_id[id_len] = '\0';
+    reader->left = (int)Get_Le(frame + 3 + id_len, 2);
+    reader->last.epoch_ms = (int64_t)Get_Le(frame + 3 + id_len + 2, 8);
+    reader->last.value = (int32_t)Get_Le(frame + 3 + id_len + 10, 4);
+    reader->frame = frame;
+    reader->length = length;
+    reader->offset = 3 + id_len + 2 + 8 + 4;
+    return 0;
+}
+
+        // Next reading: 1 when one was returned, 0 at the end, -1 for a truncated batch
+int Frame_Reader_Next(frame_reader_t* reader, frame_reading_t* reading)
+{
+    if (reader->left <= 0) return 0;
+
+    // The first reading is whole in the header, every later one is a pair of deltas
+    if (reader->started)
+    {
+        int64_t delta_ms, delta_value;
+        int n1 = Get_Varint(reader->frame + reader->offset, reader->length - reader->offset, &delta_ms);
+        if (n1 <= 0) return -1;
+        int n2 = Get_Varint(reader->frame + reader->offset + n1, reader->length - reader->offset - n1, &delta_value);
+        if (n2 <= 0) return -1;
+        reader->offset += n1 + n2;
+        reader->last.epoch_ms += delta_ms;
+        reader->last.value = (int32_t)(reader->last.value + delta_value);
+    }
+    reader->started = 1;
+    reader->left--;
+    *reading = reader->last;
+    return 1;
+}
+
+/* ---- Stored records ---- */
+
+        // The string value of key (quotes included, "\"timestamp\"") in a JSON object that need
+        // not be terminated. Returns its length, -1 if the object has none.
+static int Json_String_Value(const char* data, int length, const char* key, const char** value)
+{
+    const char* end = data + length;
+    const char* at = memmem(data, length, key, strlen(key));
+    if (!at) return -1;
+
+    at += strlen(key);
+    while (at < end && (*at == ' ' || *at == ':' || *at == '\t' || *at == '\r' || *at == '\n')) at++;
+    if (at >= end || *at != '"') return -1;
+
+    const char* start = ++at;
+    while (at < end && *at != '"') at++;
+    if (at >= end) return -1;
+
+    *value = start;
+    return (int)(at - start);
+}
+
+static uint32_t Record_Source(const char* id, int length)
+{
+    uint32_t hash = 0x811c9dc5u;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)id[i];
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+        // Time of the oldest reading in a backlog record and which sensor took it, without
+        // decoding the rest. Returns 0, or -1 for a record that tells neither.
+int Record_Info(const char* data, int length, uint16_t store_type, record_info_t* info)
+{
+    if (!data || !info || length <= 0) return -1;
+
+    if (store_type == STORE_TYPE_FRAME)
+    {
+        // Every kind carries its first time right after the id - a batch after its count
+        int kind = Frame_Kind(data, length);
+        if (kind < 0 || Frame_Length(data, length) != length) return -1;
+
+        int id_len = (unsigned char)data[2];
+        info->epoch_ms = (int64_t)Get_Le(data + 3 + id_len + (kind == FRAME_KIND_BATCH ? 2 : 0), 8);
+        info->source = Record_Source(data + 3, id_len);
+        return 0;
+    }
+    if (store_type != STORE_TYPE_JSON) return -1;
+
+    // Sensor_JSON() and Sensor_JSON_Window() write the oldest reading first
+    const char* value;
+    char text[32];
+    int text_len = Json_String_Value(data, length, "\"timestamp\"", &value);
+    if (text_len <= 0 || text_len >= (int)sizeof(text)) return -1;
+    memcpy(text, value, text_len);
+    text[text_len] = '\0';
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    info->epoch_ms = (int64_t)timegm(&tm) * 1000;
+
+    int id_len = Json_String_Value(data, length, "\"sensor_id\"", &value);
+    info->source = Record_Source(value, id_len > 0 ? id_len : 0);
+    return 0;
+}
+
+        // A JSON object as Sensor_JSON() writes it: a sensor_id, a timestamp and a quantity
+        // holding a number (a reading) or an object (a window summary). Returns 1 if it is one.
+int Record_Is_Reading(const char* data, int length)
+{
+    record_info_t info;
+    const char* id;
+    if (Record_Info(data, length, STORE_TYPE_JSON, &info) < 0 ||
+        Json_String_Value(data, length, "\"sensor_id\"", &id) <= 0) {
+        return 0;
+    }
+
+    // The key is the last string before a top-level colon
+    static const char window_key[] = "window_s";
+    const char* key = NULL;
+    int key_len = 0;
+    int depth = 0;
+    int in_string = 0;
+
+    for (int i = 0; i < length; i++)
+    {
+        char c = data[i];
+        if (in_string) {
+            if (c == '\\') i++;
+            else if (c == '"') {
+                in_string = 0;
+                if (depth == 1) key_len = (int)(data + i - key);
+            }
+            continue;
+        }
+        if (c == '"') {
+            in_string = 1;
+            if (depth == 1) key = data + i + 1;
+        }
+        else if (c == '{' || c == '[') depth++;
+        else if (c == '}' || c == ']') depth--;
+        else if (c == ':' && depth == 1 && key)
+        {
+            int at = i + 1;
+            while (at < length && (data[at] == ' ' || data[at] == '\t' || data[at] == '\r' || data[at] == '\n')) at++;
+            if (at >= length) return 0;
+
+            int is_window = key_len == (int)sizeof(window_key) - 1 && memcmp(key, window_key, key_len) == 0;
+            if (!is_window && (data[at] == '{' || data[at] == '-' || (data[at] >= '0' && data[at] <= '9'))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,539 @@
+#define _GNU_SOURCE     // recvmmsg(), accept4(), memmem()
+#include "../include/smw.h"
+#include "../include/gateway.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#define GATEWAY_OK "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"
+#define GATEWAY_BAD_REQUEST "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n"
+#define GATEWAY_LENGTH_REQUIRED "HTTP/1.1 411 Length Required\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+#define GATEWAY_TOO_LARGE "HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+#define GATEWAY_UNAVAILABLE "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n"
+
+// epoll data of the two listening sockets - connections use their index
+#define GATEWAY_SOCKET_LISTEN GATEWAY_CLIENTS_MAX
+#define GATEWAY_SOCKET_DATAGRAM (GATEWAY_CLIENTS_MAX + 1)
+
+typedef enum {
+    GATEWAY_PROTOCOL_UNKNOWN,        // Not enough bytes yet to tell
+    GATEWAY_PROTOCOL_HTTP,           // Starts with "POST " - every request gets an answer
+    GATEWAY_PROTOCOL_STREAM,         // Bare items, no answers
+} gateway_protocol_t;
+
+typedef struct {
+    int fd;                          // -1 = free
+    gateway_protocol_t protocol;
+    char buffer[GATEWAY_BUFFER_SIZE];
+    int used;
+} gateway_client_t;
+
+// What one request, datagram or stream chunk came to
+typedef struct {
+    int accepted;
+    int duplicates;
+    int rejected;
+    int lost;
+} gateway_tally_t;
+
+static gateway_stats_t gateway_stats;
+static gateway_client_t gateway_clients[GATEWAY_CLIENTS_MAX];
+static uint64_t gateway_seen[GATEWAY_DEDUPE_SLOTS];
+static char gateway_datagrams[GATEWAY_DATAGRAMS][GATEWAY_DATAGRAM_MAX];
+static arena_t gateway_arena;
+static spsc_ring_t gateway_queue;    // Producer and consumer are both the main loop
+static store_t* gateway_backlog;
+static smw_task_t* gateway_task = NULL;
+static int gateway_epoll_fd = -1;
+static int gateway_listen_fd = -1;
+static int gateway_datagram_fd = -1;
+static int gateway_port = 0;
+static void (*gateway_on_queued)(void*) = NULL;
+static void* gateway_context = NULL;
+
+/* ---- Readings ---- */
+
+        // FNV-1a over type and bytes: a node sending the same reading again gives the same value
+static uint64_t Gateway_Fingerprint(const char* data, int length, uint16_t type)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL ^ type;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;          // 0 marks an empty table slot
+}
+
+        // One reading into the queue, or the backlog once the queue is full
+static void Gateway_Put(const char* data, int length, uint16_t type, gateway_tally_t* tally)
+{
+    if (length > STORE_PAYLOAD_MAX) {
+        tally->rejected++;
+        return;
+    }
+
+    uint64_t fingerprint = Gateway_Fingerprint(data, length, type);
+    uint64_t* seen = &gateway_seen[fingerprint & (GATEWAY_DEDUPE_SLOTS - 1)];
+    if (*seen == fingerprint) {
+        tally->duplicates++;
+        return;
+    }
+
+    pipeline_record_t* record = Spsc_Claim(&gateway_queue);
+    if (record)
+    {
+        memcpy(record->data, data, length);
+        record->length = (uint16_t)length;
+        record->type = type;
+        Spsc_Publish(&gateway_queue);
+    }
+    else if (Save_Sensor_Data_To_File(gateway_backlog, data, length, type) == 0)
+    {
+        gateway_stats.spilled++;
+        Metrics_Count(METRIC_QUEUE_SPILLED, 1);
+    }
+    else
+    {
+        tally->lost++;               // Not remembered - the sender may try it again
+        return;
+    }
+    *seen = fingerprint;
+    tally->accepted++;
+}
+
+        // Reading and summary frames are queued as they are, a batch frame reading by reading
+static void Gateway_Put_Frame(const char* frame, int length, gateway_tally_t* tally)
+{
+    if (Frame_Kind(frame, length) == FRAME_KIND_SUMMARY) {
+        Gateway_Put(frame, length, STORE_TYPE_FRAME, tally);
+        return;
+    }
+
+    frame_reader_t reader;
+    frame_reading_t reading;
+    char single[STORE_PAYLOAD_MAX];
+    int rc;
+
+    if (Frame_Reader_Begin(&reader, frame, length) < 0) {
+        tally->rejected++;
+        return;
+    }
+    while ((rc = Frame_Reader_Next(&reader, &reading)) > 0)
+    {
+        int single_length = Frame_Encode_Reading(&reading, single, sizeof(single));
+        Gateway_Put(single, single_length, STORE_TYPE_FRAME, tally);
+    }
+    if (rc < 0) {
+        tally->rejected++;
+    }
+}
+
+        // Length of the JSON object data starts with (braces outside strings balance),
+        // 0 if data ends before it does
+static int Gateway_Object_Length(const char* data, int available)
+{
+    int depth = 0;
+    int in_string = 0;
+
+    for (int i = 0; i < available; i++)
+    {
+        char c = data[i];
+        if (in_string) {
+            if (c == '\\') i++;
+            else if (c == '"') in_string = 0;
+        }
+        else if (c == '"') in_string = 1;
+        else if (c == '{') depth++;
+        else if (c == '}' && --depth == 0) return i + 1;
+    }
+    return 0;
+}
+
+        // Queues every complete item in data. Separators, brackets and whitespace between
+        // items are skipped. Returns the bytes consumed - an item cut off at the end waits for
+        // more unless final - or -1 once data holds something that is no item.
+static int Gateway_Items(const char* data, int available, int final, gateway_tally_t* tally)
+{
+    int used = 0;
+
+    while (used < available)
+    {
+        char c = data[used];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == '[' || c == ']') {
+            used++;
+            continue;
+        }
+
+        int length = -1;
+        if (c == '{') length = Gateway_Object_Length(data + used, available - used);
+        else if (c == FRAME_VERSION) length = Frame_Length(data + used, available - used);
+
+        if (length == 0 && !final) {
+            break;
+        }
+        if (length <= 0) {
+            tally->rejected++;
+            return -1;
+        }
+
+        // An object that is no reading would share an upstream batch with good ones, and
+        // a 400 for it drops them all
+        if (c == '{' && !Record_Is_Reading(data + used, length)) tally->rejected++;
+        else if (c == '{') Gateway_Put(data + used, length, STORE_TYPE_JSON, tally);
+        else Gateway_Put_Frame(data + used, length, tally);
+        used += length;
+    }
+    return used;
+}
+
+static void Gateway_Count(const gateway_tally_t* tally)
+{
+    gateway_stats.accepted += tally->accepted;
+    gateway_stats.duplicates += tally->duplicates;
+    gateway_stats.rejected += tally->rejected;
+    gateway_stats.lost += tally->lost;
+
+    if (tally->accepted) Metrics_Count(METRIC_GATEWAY_ACCEPTED, tally->accepted);
+    if (tally->duplicates) Metrics_Count(METRIC_GATEWAY_DUPLICATES, tally->duplicates);
+    if (tally->rejected || tally->lost) Metrics_Count(METRIC_GATEWAY_REJECTED, tally->rejected + tally->lost);
+}
+
+/* ---- TCP ---- */
+
+static void Gateway_Close(gateway_client_t* client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);           // Leaves the epoll set with it
+    }
+    client->fd = -1;
+    client->used = 0;
+}
+
+static void Gateway_Reply(gateway_client_t* client, const char* answer)
+{
+    size_t length = strlen(answer);
+    if (send(client->fd, answer, length, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)length) {
+        Gateway_Close(client);       // A few dozen bytes not fitting means the peer is gone
+    }
+}
+
+        // Answers every complete POST at the front of the buffer: 200 once its readings are
+        // queued (or known already), 503 if some found no room - the node keeps the body and
+        // sends it again, and what did get through is a duplicate then. Returns the bytes consumed.
+static int Gateway_Http(gateway_client_t* client)
+{
+    int consumed = 0;
+
+    while (client->fd >= 0)
+    {
+        const char* request = client->buffer + consumed;
+        int left = client->used - consumed;
+        const char* header_end = memmem(request, left, "\r\n\r\n", 4);
+        if (!header_end) {
+            break;
+        }
+        int header_length = (int)(header_end - request) + 4;
+        long content_length = Http_Request_Length(request, header_length);
+        if (content_length == HTTP_LENGTH_CHUNKED)
+        {
+            // Its chunk lines would be read as the next request - nothing after it can be framed
+            LOG_WARN("ev=gateway_request_chunked action=close");
+            Gateway_Reply(client, GATEWAY_LENGTH_REQUIRED);
+            Gateway_Close(client);
+            break;
+        }
+        if (content_length < 0 || content_length > GATEWAY_BUFFER_SIZE - header_length)
+        {
+            LOG_WARN("ev=gateway_request_too_large bytes=%ld", content_length);
+            Gateway_Reply(client, GATEWAY_TOO_LARGE);
+            Gateway_Close(client);
+            break;
+        }
+        if (left < header_length + content_length) {
+            break;
+        }
+
+        gateway_tally_t tally = {0};
+        Gateway_Items(request + header_length, (int)content_length, 1, &tally);
+        Gateway_Count(&tally);
+        gateway_stats.requests++;
+
+        if (tally.lost) Gateway_Reply(client, GATEWAY_UNAVAILABLE);
+        else if (tally.accepted || tally.duplicates) Gateway_Reply(client, GATEWAY_OK);
+        else Gateway_Reply(client, GATEWAY_BAD_REQUEST);
+        consumed += header_length + (int)content_length;
+    }
+    return consumed;
+}
+
+static void Gateway_Parse(gateway_client_t* client)
+{
+    static const char post[] = "POST ";
+
+    if (client->protocol == GATEWAY_PROTOCOL_UNKNOWN)
+    {
+        int n = client->used < (int)sizeof(post) - 1 ? client->used : (int)sizeof(post) - 1;
+        if (memcmp(client->buffer, post, n) != 0) client->protocol = GATEWAY_PROTOCOL_STREAM;
+        else if (n == (int)sizeof(post) - 1) client->protocol = GATEWAY_PROTOCOL_HTTP;
+        else return;
+    }
+
+    int consumed;
+    if (client->protocol == GATEWAY_PROTOCOL_HTTP) {
+        consumed = Gateway_Http(client);
+    }
+    else {
+        gateway_tally_t tally = {0};
+        consumed = Gateway_Items(client->buffer, client->used, 0, &tally);
+        Gateway_Count(&tally);
+    }
+
+    if (consumed < 0) {
+        LOG_WARN("ev=gateway_stream_invalid action=close");
+        Gateway_Close(client);
+    }
+    if (client->fd < 0) {
+        return;
+    }
+    memmove(client->buffer, client->buffer + consumed, client->used - consumed);
+    client->used -= consumed;
+
+    if (client->used == GATEWAY_BUFFER_SIZE) {
+        LOG_WARN("ev=gateway_item_too_large bytes=%d action=close", client->used);
+        Gateway_Close(client);
+    }
+}
+
+        // One recv() per readiness: the epoll set is level-triggered, so whatever is left
+        // is reported again on the next dispatch and a busy node cannot starve the others
+static void Gateway_Read(gateway_client_t* client)
+{
+    ssize_t n = recv(client->fd, client->buffer + client->used, GATEWAY_BUFFER_SIZE - client->used, MSG_DONTWAIT);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (n <= 0) {
+        Gateway_Close(client);
+        return;
+    }
+    client->used += (int)n;
+    Gateway_Parse(client);
+}
+
+static void Gateway_Accept(void)
+{
+    int fd;
+    while ((fd = accept4(gateway_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        int index = -1;
+        for (int i = 0; i < GATEWAY_CLIENTS_MAX && index < 0; i++) {
+            if (gateway_clients[i].fd < 0) index = i;
+        }
+
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)index;
+        if (index < 0 || epoll_ctl(gateway_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOG_WARN("ev=gateway_connection_refused clients=%d", GATEWAY_CLIENTS_MAX);
+            close(fd);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        gateway_client_t* client = &gateway_clients[index];
+        client->fd = fd;
+        client->protocol = GATEWAY_PROTOCOL_UNKNOWN;
+        client->used = 0;
+        gateway_stats.connections++;
+    }
+}
+
+/* ---- UDP ---- */
+
+static void Gateway_Receive(void)
+{
+    struct mmsghdr messages[GATEWAY_DATAGRAMS];
+    struct iovec parts[GATEWAY_DATAGRAMS];
+
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < GATEWAY_DATAGRAMS; i++)
+    {
+        parts[i].iov_base = gateway_datagrams[i];
+        parts[i].iov_len = GATEWAY_DATAGRAM_MAX;
+        messages[i].msg_hdr.msg_iov = &parts[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int count = recvmmsg(gateway_datagram_fd, messages, GATEWAY_DATAGRAMS, MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+        return;
+    }
+
+    gateway_tally_t tally = {0};
+    for (int i = 0; i < count; i++)
+    {
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            tally.rejected++;
+            continue;
+        }
+        Gateway_Items(gateway_datagrams[i], (int)messages[i].msg_len, 1, &tally);
+    }
+    gateway_stats.datagrams += count;
+    Gateway_Count(&tally);
+}
+
+/* ---- Task ---- */
+
+static uint64_t Gateway_Task(void* context, uint64_t monTime)
+{
+    (void)context;
+    struct epoll_event events[GATEWAY_EVENTS];
+    unsigned long accepted = gateway_stats.accepted;
+
+    int count = epoll_wait(gateway_epoll_fd, events, GATEWAY_EVENTS, 0);
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t which = events[i].data.u32;
+        if (which == GATEWAY_SOCKET_LISTEN) {
+            Gateway_Accept();
+        }
+        else if (which == GATEWAY_SOCKET_DATAGRAM) {
+            Gateway_Receive();
+        }
+        else if (gateway_clients[which].fd >= 0) {
+            Gateway_Read(&gateway_clients[which]);
+        }
+    }
+
+    if (gateway_stats.accepted != accepted)
+    {
+        Metrics_Gauge(METRIC_QUEUE_RECORDS, Spsc_Count(&gateway_queue));
+        if (gateway_on_queued) gateway_on_queued(gateway_context);
+    }
+
+    // A full set of events means more may be ready - run again after the other due tasks
+    return count == GATEWAY_EVENTS ? monTime : UINT64_MAX;
+}
+
+static int Gateway_Socket(int type, struct sockaddr_in* addr)
+{
+    int one = 1;
+    int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(fd, (struct sockaddr*)addr, sizeof(*addr)) < 0 ||
+        (type == SOCK_STREAM && listen(fd, 128) < 0))
+    {
+        LOG_ERROR("ev=gateway_listen_failed port=%d errno=%d", ntohs(addr->sin_port), errno);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int Gateway_Watch(int fd, uint32_t which)
+{
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.u32 = which;
+    return epoll_ctl(gateway_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+        // Listens on TCP and UDP port (0 = a port the kernel picks, see Gateway_Port()) on
+        // every interface. on_queued is called after readings were queued or spilled to
+        // backlog. Call after Smw_Init().
+int Gateway_Start(int port, store_t* backlog, void (*on_queued)(void*), void* context)
+{
+    memset(&gateway_stats, 0, sizeof(gateway_stats));
+    memset(gateway_seen, 0, sizeof(gateway_seen));
+    for (int i = 0; i < GATEWAY_CLIENTS_MAX; i++) {
+        gateway_clients[i].fd = -1;
+    }
+    gateway_backlog = backlog;
+    gateway_on_queued = on_queued;
+    gateway_context = context;
+
+    if (Arena_Init(&gateway_arena, GATEWAY_ARENA_SIZE) < 0 ||
+        Spsc_Init(&gateway_queue, &gateway_arena, GATEWAY_QUEUE_SLOTS, sizeof(pipeline_record_t)) < 0)
+    {
+        LOG_ERROR("ev=gateway_queue_failed slots=%d", GATEWAY_QUEUE_SLOTS);
+        Arena_Free(&gateway_arena);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t addr_len = sizeof(addr);
+
+    // The datagram socket takes whichever port the listener got
+    gateway_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    gateway_listen_fd = gateway_epoll_fd >= 0 ? Gateway_Socket(SOCK_STREAM, &addr) : -1;
+    if (gateway_listen_fd >= 0 && getsockname(gateway_listen_fd, (struct sockaddr*)&addr, &addr_len) == 0) {
+        gateway_datagram_fd = Gateway_Socket(SOCK_DGRAM, &addr);
+    }
+    gateway_task = Create_Smw_Task(NULL, Gateway_Task, SMW_PRIO_NORMAL);
+
+    if (gateway_datagram_fd < 0 || !gateway_task ||
+        Gateway_Watch(gateway_listen_fd, GATEWAY_SOCKET_LISTEN) < 0 ||
+        Gateway_Watch(gateway_datagram_fd, GATEWAY_SOCKET_DATAGRAM) < 0 ||
+        Smw_Watch_Fd(gateway_task, gateway_epoll_fd, EPOLLIN) < 0)
+    {
+        LOG_ERROR("ev=gateway_start_failed port=%d", port);
+        Gateway_Stop();
+        return -1;
+    }
+
+    gateway_port = ntohs(addr.sin_port);
+    LOG_INFO("ev=gateway_listen port=%d clients=%d queue=%d", gateway_port, GATEWAY_CLIENTS_MAX, GATEWAY_QUEUE_SLOTS);
+    return 0;
+}
+
+int Gateway_Port(void)
+{
+    return gateway_port;
+}
+
+        // Received readings for the uploader, released once the server took them
+spsc_ring_t* Gateway_Queue(void)
+{
+    return &gateway_queue;
+}
+
+const gateway_stats_t* Gateway_Stats(void)
+{
+    return &gateway_stats;
+}
+
+void Gateway_Stop(void)
+{
+    if (!gateway_arena.base) {
+        return;                      // Never started
+    }
+    for (int i = 0; i < GATEWAY_CLIENTS_MAX; i++) {
+        Gateway_Close(&gateway_clients[i]);
+    }
+    if (gateway_epoll_fd >= 0) {
+        Smw_Unwatch_Fd(gateway_epoll_fd);
+        close(gateway_epoll_fd);
+    }
+    if (gateway_listen_fd >= 0) close(gateway_listen_fd);
+    if (gateway_datagram_fd >= 0) close(gateway_datagram_fd);
+    gateway_epoll_fd = gateway_listen_fd = gateway_datagram_fd = -1;
+
+    if (gateway_task) {
+        Free_Smw_Task(gateway_task);
+        gateway_task = NULL;
+    }
+    Arena_Free(&gateway_arena);
+}
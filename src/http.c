@@ -1,43 +1,550 @@
+#define _GNU_SOURCE     // strcasestr(), timegm()
 #include "../include/http.h"
+#include "../include/log.h"
+#include "../include/clock.h"
+#include <errno.h>
+#include <strings.h>
+#include <time.h>
 
 
-char* build_http_request(const char *path, const char *hostname, const char *body)
+static http_template_t http_templates[HTTP_TEMPLATE_MAX];
+static int http_template_count = 0;
+
+        // Forgets every cached header, e.g. after the server host changed. No transaction may be in flight.
+void Http_Template_Reset(void)
 {
-    char *request = malloc(BUFFER_SIZE +1);
-    if (!request) {
-        return NULL;
+    http_template_count = 0;
+}
+
+        // Everything in a POST header except the Content-Length value is the same for every
+        // request to one path/host/content type - it is formatted once and reused
+const http_template_t* Http_Template(const char* path, const char* hostname, const char* content_type)
+{
+    if (!content_type) {
+        content_type = "application/json";
     }
-    if (!body) {
-        body = "";
+
+    for (int i = 0; i < http_template_count; i++)
+    {
+        const http_template_t* tpl = &http_templates[i];
+        if (tpl->path == path && tpl->content_type == content_type && strcmp(tpl->hostname, hostname) == 0) {
+            return tpl;
+        }
     }
-    int content_length = strlen(body);
-    int total_size = BUFFER_SIZE;
 
-        snprintf(request, total_size,
+    if (http_template_count >= HTTP_TEMPLATE_MAX) {
+        LOG_ERROR("ev=http_template_full max=%d", HTTP_TEMPLATE_MAX);
+        return NULL;
+    }
+
+    http_template_t* tpl = &http_templates[http_template_count];
+    int length = snprintf(tpl->text, sizeof(tpl->text),
                  "POST %s HTTP/1.1\r\n"
                  "Host: %s\r\n"
-                 "Content-Type: application/json\r\n"        
-                 "Content-Length: %d\r\n"                   
-                 "User-Agent: SensorNode2.0/1.0\r\n"         
-                 "Connection: close\r\n"                      
-                 "\r\n"
-                 "%s",
-                 path, hostname, content_length, body);
+                 "Content-Type: %s\r\n"
+                 "User-Agent: SensorNode2.0/1.0\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Content-Length: ",
+                 path, hostname, content_type);
+    if (length < 0 || length >= (int)sizeof(tpl->text)) {
+        LOG_ERROR("ev=http_header_too_large max=%d", HTTP_HEADER_SIZE);
+        return NULL;
+    }
+
+    tpl->length = length;
+    tpl->path = path;
+    tpl->content_type = content_type;
+    snprintf(tpl->hostname, sizeof(tpl->hostname), "%s", hostname);
+    http_template_count++;
+    return tpl;
+}
+
+        // Writes "<length>\r\n\r\n", the only part of the header that changes per request
+static int Http_Format_Length(char* out, size_t length)
+{
+    char digits[20];
+    int n = 0;
 
-    return request;
+    do {
+        digits[n++] = (char)('0' + length % 10);
+        length /= 10;
+    } while (length > 0);
+
+    int used = 0;
+    while (n > 0) {
+        out[used++] = digits[--n];
+    }
+    memcpy(out + used, "\r\n\r\n", 4);
+    return used + 4;
 }
 
-void Print_HTTP_Status(const char* response)
+void Http_Body_Reset(http_body_t* body)
 {
-    if (!response) return;
+    body->count = 0;
+    body->length = 0;
+}
 
-    // Make a copy since strtok modifies the string
-    char temp_buffer[256];
-    strncpy(temp_buffer, response, sizeof(temp_buffer) - 1);
-    temp_buffer[sizeof(temp_buffer) - 1] = '\0';
+int Http_Body_Add(http_body_t* body, const void* data, size_t length)
+{
+    if (body->count >= body->capacity) {
+        return -1;
+    }
+    body->parts[body->count].iov_base = (void*)data;
+    body->parts[body->count].iov_len = length;
+    body->count++;
+    body->length += length;
+    return 0;
+}
 
-    char* first_line = strtok(temp_buffer, "\r\n");
-    if (first_line) {
-        printf("HTTP Status: %s\n", first_line);
+        // The value of header name in a complete request header block, copied into value (cut to
+        // its size). Returns 1 if the block has the header.
+static int Http_Request_Header(const char* headers, int length, const char* name, char* value, int size)
+{
+    int name_len = (int)strlen(name);
+    for (int i = 0; i + 2 + name_len < length; i++)
+    {
+        if (headers[i] != '\r' || headers[i + 1] != '\n' || headers[i + 2 + name_len] != ':' ||
+            strncasecmp(headers + i + 2, name, name_len) != 0) {
+            continue;
+        }
+        int at = i + 3 + name_len;
+        int used = 0;
+        while (at < length && (headers[at] == ' ' || headers[at] == '\t')) at++;
+        while (at < length && headers[at] != '\r' && used < size - 1) value[used++] = headers[at++];
+        value[used] = '\0';
+        return 1;
     }
-}
\ No newline at end of file
+    return 0;
+}
+
+        // Body length of a request whose header block is complete (blank line included): its
+        // Content-Length, 0 when there is none, or HTTP_LENGTH_CHUNKED - a chunked body is not
+        // taken apart, so the caller cannot tell where the next request starts.
+long Http_Request_Length(const char* headers, int length)
+{
+    char value[HTTP_LINE_MAX];
+
+    if (Http_Request_Header(headers, length, "Transfer-Encoding", value, sizeof(value)) &&
+        strcasestr(value, "chunked")) {
+        return HTTP_LENGTH_CHUNKED;
+    }
+    if (Http_Request_Header(headers, length, "Content-Length", value, sizeof(value))) {
+        return strtol(value, NULL, 10);
+    }
+    return 0;
+}
+
+        // Prepares a pipelined transaction: every request is header template, length line and
+        // body parts, written back-to-back by Http_Txn_Send() before Http_Txn_Recv() collects
+        // the responses in order.
+int Http_Txn_Begin(http_txn_t* txn, tcp_conn_t* conn, const char* path, const http_body_t* bodies, int count)
+{
+    if (!txn || !conn || !bodies || count <= 0 || count > HTTP_PIPELINE_DEPTH) return -1;
+
+    memset(txn, 0, sizeof(*txn));
+    txn->conn = conn;
+    txn->bodies = bodies;
+    txn->retry_after = -1;
+    Http_Parser_Init(&txn->parser);
+
+    for (int i = 0; i < count; i++)
+    {
+        txn->status_codes[i] = -1;
+        txn->templates[i] = Http_Template(path, conn->hostname, bodies[i].content_type);
+        if (!txn->templates[i]) {
+            return -1;
+        }
+        txn->length_line_lengths[i] = Http_Format_Length(txn->length_lines[i], bodies[i].length);
+    }
+    txn->count = count;
+    return 0;
+}
+
+        // Piece number piece of request req: 0 = header template, 1 = length line, 2.. = body parts.
+        // Returns 0 past the last piece.
+static int Http_Txn_Piece(const http_txn_t* txn, int req, int piece, struct iovec* out)
+{
+    if (piece == 0) {
+        out->iov_base = (void*)txn->templates[req]->text;
+        out->iov_len = txn->templates[req]->length;
+    } else if (piece == 1) {
+        out->iov_base = (void*)txn->length_lines[req];
+        out->iov_len = txn->length_line_lengths[req];
+    } else if (piece - 2 < txn->bodies[req].count) {
+        *out = txn->bodies[req].parts[piece - 2];
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+        // Moves the write cursor past bytes written, finishing requests on the way
+static void Http_Txn_Advance(http_txn_t* txn, size_t bytes)
+{
+    tcp_conn_t* conn = txn->conn;
+
+    while (txn->sent < txn->count)
+    {
+        struct iovec piece;
+        if (Http_Txn_Piece(txn, txn->sent, txn->piece, &piece))
+        {
+            size_t left = piece.iov_len - txn->offset;
+            if (bytes < left) {
+                txn->offset += bytes;
+                return;
+            }
+            bytes -= left;
+            txn->offset = 0;
+            txn->piece++;
+            continue;
+        }
+
+        // Request complete
+        const http_body_t* body = &txn->bodies[txn->sent];
+        LOG_DEBUG("ev=request_sent bytes=%zu parts=%d",
+                  txn->templates[txn->sent]->length + txn->length_line_lengths[txn->sent] + body->length, body->count);
+        conn->requests++;
+        if (conn->socket_requests > 0) conn->reuses++;
+        conn->socket_requests++;
+        conn->pending++;
+        txn->sent++;
+        txn->piece = 0;
+    }
+}
+
+        // Writes as much as the socket takes with one sendmsg() per HTTP_IOV_BATCH pieces,
+        // resuming mid-piece after a partial write. Bodies go out from their own buffers.
+        // Returns 1 when every request is out, 0 when the socket is full, -1 on error.
+int Http_Txn_Send(http_txn_t* txn)
+{
+    while (txn->sent < txn->count)
+    {
+        struct iovec iov[HTTP_IOV_BATCH];
+        int n = 0;
+        int req = txn->sent;
+        int piece = txn->piece;
+        size_t offset = txn->offset;
+
+        while (n < HTTP_IOV_BATCH && req < txn->count)
+        {
+            struct iovec part;
+            if (!Http_Txn_Piece(txn, req, piece, &part)) {
+                req++;
+                piece = 0;
+                continue;
+            }
+            if (part.iov_len > offset) {
+                iov[n].iov_base = (char*)part.iov_base + offset;
+                iov[n].iov_len = part.iov_len - offset;
+                n++;
+            }
+            offset = 0;
+            piece++;
+        }
+
+        if (n > 0)
+        {
+            int written = Tcp_Conn_Writev(txn->conn, iov, n, req < txn->count);
+            if (written < 0) {
+                LOG_WARN("ev=send_failed errno=%d", errno);
+                return -1;
+            }
+            if (written == 0) {
+                return 0;
+            }
+            txn->bytes_sent += written;
+            Http_Txn_Advance(txn, written);
+        }
+        else
+        {
+            Http_Txn_Advance(txn, 0);   // Only empty pieces left
+        }
+    }
+    return 1;
+}
+
+/* ---- Incremental response parser ---- */
+
+void Http_Parser_Init(http_parser_t* parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = HTTP_PARSE_STATUS;
+    parser->content_length = -1;
+    parser->retry_after = -1;
+}
+
+        // Retry-After is either delay-seconds or an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT")
+static int Http_Parse_Retry_After(const char* value)
+{
+    if (*value >= '0' && *value <= '9') {
+        long seconds = strtol(value, NULL, 10);
+        return seconds > HTTP_RETRY_AFTER_MAX ? HTTP_RETRY_AFTER_MAX : (int)seconds;
+    }
+
+    static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month[4];
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(value, "%*3s, %d %3s %d %d:%d:%d GMT", &tm.tm_mday, month, &tm.tm_year,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return -1;
+    }
+    const char* found = strstr(months, month);
+    if (!found || (found - months) % 3 != 0) {
+        return -1;
+    }
+    tm.tm_mon = (found - months) / 3;
+    tm.tm_year -= 1900;
+
+    long seconds = (long)(timegm(&tm) - Clock_Wall_Ms() / 1000);
+    if (seconds < 0) return 0;
+    return seconds > HTTP_RETRY_AFTER_MAX ? HTTP_RETRY_AFTER_MAX : (int)seconds;
+}
+
+static int Http_Parse_Status_Line(http_parser_t* parser)
+{
+    int minor = 0;
+    int status = 0;
+    if (sscanf(parser->line, "HTTP/1.%d %3d", &minor, &status) != 2 || status < 100 || status > 999) {
+        LOG_WARN("ev=http_malformed what=status_line");
+        return -1;
+    }
+    parser->status = status;
+    parser->keep_alive = minor >= 1;      // HTTP/1.0 closes unless it says otherwise
+    int length = parser->line_len < (int)sizeof(parser->status_line) ? parser->line_len : (int)sizeof(parser->status_line) - 1;
+    memcpy(parser->status_line, parser->line, length);
+    parser->status_line[length] = '\0';
+    return 0;
+}
+
+static void Http_Parse_Header_Line(http_parser_t* parser)
+{
+    char* value = strchr(parser->line, ':');
+    if (!value) return;
+
+    *value++ = '\0';
+    while (*value == ' ' || *value == '\t') value++;
+
+    if (strcasecmp(parser->line, "Content-Length") == 0) {
+        parser->content_length = strtoll(value, NULL, 10);
+    } else if (strcasecmp(parser->line, "Transfer-Encoding") == 0) {
+        parser->chunked = strcasestr(value, "chunked") != NULL;
+    } else if (strcasecmp(parser->line, "Connection") == 0) {
+        if (strcasestr(value, "close")) parser->keep_alive = 0;
+        else if (strcasestr(value, "keep-alive")) parser->keep_alive = 1;
+    } else if (strcasecmp(parser->line, "Retry-After") == 0) {
+        parser->retry_after = Http_Parse_Retry_After(value);
+    }
+}
+
+        // Decides how the body is framed once the header block is complete
+static void Http_Headers_Done(http_parser_t* parser)
+{
+    if (parser->status < 200 && parser->status != 101)
+    {
+        // Interim response (100 Continue, 103 Early Hints) - the real one follows
+        Http_Parser_Init(parser);
+        return;
+    }
+
+    if (parser->status == 204 || parser->status == 304 || parser->status == 101) {
+        parser->state = HTTP_PARSE_DONE;
+    } else if (parser->chunked) {
+        parser->state = HTTP_PARSE_CHUNK_SIZE;
+    } else if (parser->content_length >= 0) {
+        parser->body_left = parser->content_length;
+        parser->state = parser->body_left > 0 ? HTTP_PARSE_BODY : HTTP_PARSE_DONE;
+    } else {
+        // No framing - the body runs until the server closes
+        parser->keep_alive = 0;
+        parser->state = HTTP_PARSE_UNTIL_CLOSE;
+    }
+}
+
+        // One complete line (CR stripped) in the current state. Returns -1 if malformed.
+static int Http_Parse_Line(http_parser_t* parser)
+{
+    switch (parser->state)
+    {
+        case HTTP_PARSE_STATUS:
+            if (parser->line_len == 0) return 0;    // Stray CRLF between responses
+            if (Http_Parse_Status_Line(parser) < 0) return -1;
+            parser->state = HTTP_PARSE_HEADERS;
+            return 0;
+
+        case HTTP_PARSE_HEADERS:
+            if (parser->line_len == 0) {
+                Http_Headers_Done(parser);
+            } else {
+                Http_Parse_Header_Line(parser);
+            }
+            return 0;
+
+        case HTTP_PARSE_CHUNK_SIZE:
+        {
+            char* end;
+            unsigned long long size = strtoull(parser->line, &end, 16);
+            if (end == parser->line) {
+                LOG_WARN("ev=http_malformed what=chunk_size");
+                return -1;
+            }
+            parser->body_left = size;
+            parser->state = size > 0 ? HTTP_PARSE_CHUNK_DATA : HTTP_PARSE_TRAILERS;
+            return 0;
+        }
+
+        case HTTP_PARSE_CHUNK_END:
+            if (parser->line_len != 0) {
+                LOG_WARN("ev=http_malformed what=chunk_terminator");
+                return -1;
+            }
+            parser->state = HTTP_PARSE_CHUNK_SIZE;
+            return 0;
+
+        case HTTP_PARSE_TRAILERS:
+            if (parser->line_len == 0) parser->state = HTTP_PARSE_DONE;
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+        // Consumes bytes of one response, which may arrive in pieces of any size. Bodies are
+        // counted and dropped, never buffered. Stops at the end of the response so a
+        // pipelined response behind it stays in data. Returns bytes consumed, -1 if malformed.
+int Http_Parser_Feed(http_parser_t* parser, const char* data, size_t length)
+{
+    size_t used = 0;
+
+    while (used < length && parser->state != HTTP_PARSE_DONE)
+    {
+        if (parser->state == HTTP_PARSE_BODY || parser->state == HTTP_PARSE_CHUNK_DATA)
+        {
+            size_t take = length - used;
+            if (take > parser->body_left) take = parser->body_left;
+            parser->body_left -= take;
+            parser->body_bytes += take;
+            used += take;
+
+            if (parser->body_left == 0) {
+                parser->state = parser->state == HTTP_PARSE_BODY ? HTTP_PARSE_DONE : HTTP_PARSE_CHUNK_END;
+            }
+            continue;
+        }
+
+        if (parser->state == HTTP_PARSE_UNTIL_CLOSE)
+        {
+            parser->body_bytes += length - used;
+            return (int)length;
+        }
+
+        // Line-oriented states: collect up to LF, long lines keep only their start
+        char c = data[used++];
+        if (c == '\n')
+        {
+            if (parser->line_len > 0 && parser->line[parser->line_len - 1] == '\r') {
+                parser->line_len--;
+            }
+            parser->line[parser->line_len] = '\0';
+            if (Http_Parse_Line(parser) < 0) {
+                parser->state = HTTP_PARSE_ERROR;
+                return -1;
+            }
+            parser->line_len = 0;
+        }
+        else if (parser->line_len < HTTP_LINE_MAX - 1)
+        {
+            parser->line[parser->line_len++] = c;
+        }
+    }
+    return (int)used;
+}
+
+        // The server closed the connection. Returns 0 if that ended the response, -1 if it was cut short.
+int Http_Parser_Finish(http_parser_t* parser)
+{
+    if (parser->state == HTTP_PARSE_UNTIL_CLOSE) {
+        parser->state = HTTP_PARSE_DONE;
+    }
+    return parser->state == HTTP_PARSE_DONE ? 0 : -1;
+}
+
+        // How the uploader should treat a response
+http_status_class_t Http_Status_Class(int status)
+{
+    if (status >= 200 && status <= 299) return HTTP_CLASS_SUCCESS;
+
+    switch (status)
+    {
+        case 400:   // Bad Request
+        case 413:   // Content Too Large
+        case 415:   // Unsupported Media Type
+        case 422:   // Unprocessable Content
+            return HTTP_CLASS_REJECTED;
+        default:
+            // 408, 429, 5xx and everything else (auth, missing route, redirects) are
+            // server-side conditions - the data is fine, try again later
+            return status > 0 ? HTTP_CLASS_RETRY : HTTP_CLASS_NONE;
+    }
+}
+
+static void Http_Txn_Response_Done(http_txn_t* txn)
+{
+    http_parser_t* parser = &txn->parser;
+
+    LOG_INFO("ev=http_status code=%d", parser->status);
+    txn->status_codes[txn->received++] = parser->status;
+    if (parser->retry_after > txn->retry_after) {
+        txn->retry_after = parser->retry_after;
+    }
+    txn->keep_alive = parser->keep_alive;
+    txn->conn->pending--;
+    Http_Parser_Init(parser);
+}
+
+        // Feeds whatever responses have arrived to the parser.
+        // Returns 1 when every sent request is answered, 0 to wait for more data,
+        // -1 if the connection broke (it is then closed).
+int Http_Txn_Recv(http_txn_t* txn)
+{
+    tcp_conn_t* conn = txn->conn;
+
+    while (txn->received < txn->sent)
+    {
+        if (conn->rx_len > 0)
+        {
+            int used = Http_Parser_Feed(&txn->parser, conn->rx_buf, conn->rx_len);
+            if (used < 0) {
+                Tcp_Conn_Close(conn);
+                return -1;
+            }
+            memmove(conn->rx_buf, conn->rx_buf + used, conn->rx_len - used);
+            conn->rx_len -= used;
+
+            if (txn->parser.state == HTTP_PARSE_DONE)
+            {
+                Http_Txn_Response_Done(txn);
+                if (!txn->keep_alive) {
+                    // Server closes after this response - the rest cannot be answered on this socket
+                    Tcp_Conn_Close(conn);
+                    return txn->received == txn->sent ? 1 : -1;
+                }
+                continue;
+            }
+        }
+
+        int n = Tcp_Conn_Read(conn);
+        if (n == 0) return 0;
+        if (n < 0)
+        {
+            // Close-delimited body ends here, anything else was cut short
+            if (Http_Parser_Finish(&txn->parser) == 0) {
+                Http_Txn_Response_Done(txn);
+            }
+            Tcp_Conn_Close(conn);
+            return txn->received == txn->sent ? 1 : -1;
+        }
+    }
+    return 1;
+}
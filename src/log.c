@@ -0,0 +1,172 @@
+#define _DEFAULT_SOURCE
+#include "../include/log.h"
+#include "../include/clock.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define LOG_FLUSH_BATCH 16           // Records gathered into one writev()
+
+/*
+ * Bounded multi-producer ring (Vyukov): a slot's sequence says whose turn it is.
+ * sequence == position      - free, a producer may claim it
+ * sequence == position + 1  - filled, the drain may read it
+ * Producers claim a position with one compare-and-swap, so any thread may log.
+ */
+typedef struct {
+    uint64_t sequence;
+    uint16_t length;
+    char text[LOG_SLOT_SIZE];
+} log_slot_t;
+
+static log_slot_t log_ring[LOG_SLOTS];
+static uint64_t log_tail = 0;        // Next position producers claim
+static uint64_t log_head = 0;        // Next position the drain reads (drain side only)
+static uint32_t log_partial = 0;     // Bytes of the head record already written
+static uint64_t log_dropped = 0;     // Records lost to a full ring
+static uint64_t log_dropped_reported = 0;
+static int log_fd = 1;
+static uint64_t log_started_ms = 0;
+
+static const char* const log_level_names[] = { "error", "warn", "info", "debug" };
+
+        // Sets up the ring and the output. A terminal, serial line or pipe is reopened
+        // non-blocking, so a slow console can only delay the log, never the loop.
+        // fd -1 formats and discards (the benchmark harness). Calling it again switches the
+        // output and drops whatever is still queued - no other thread may be logging then.
+int Log_Init(int fd)
+{
+    log_tail = log_head = 0;
+    log_partial = 0;
+    for (uint64_t i = 0; i < LOG_SLOTS; i++) {
+        __atomic_store_n(&log_ring[i].sequence, i, __ATOMIC_RELAXED);
+    }
+    log_started_ms = Clock_Now_Ms();
+    log_fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && !S_ISREG(st.st_mode))
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+        int nonblocking = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (nonblocking >= 0) {
+            log_fd = nonblocking;
+        }
+    }
+    return 0;
+}
+
+void Log_Write(int level, const char* format, ...)
+{
+    uint64_t position = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+    log_slot_t* slot;
+
+    while (1)
+    {
+        slot = &log_ring[position & (LOG_SLOTS - 1)];
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == position) {
+            if (__atomic_compare_exchange_n(&log_tail, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (sequence < position) {
+            __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);   // Full - never wait for the drain
+            return;
+        }
+        else {
+            position = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    uint64_t ms = Clock_Now_Ms() - log_started_ms;
+    int length = snprintf(slot->text, LOG_SLOT_SIZE, "t=%llu.%03llu lvl=%s ",
+                          (unsigned long long)(ms / 1000), (unsigned long long)(ms % 1000),
+                          log_level_names[level & 3]);
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(slot->text + length, LOG_SLOT_SIZE - length, format, args);
+    va_end(args);
+
+    length = (n < 0) ? length : (length + n < LOG_SLOT_SIZE - 1 ? length + n : LOG_SLOT_SIZE - 2);
+    slot->text[length++] = '\n';
+    slot->length = (uint16_t)length;
+
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+        // Writes queued records without blocking. Call from one thread only (the main loop
+        // before it sleeps). Returns the number of records still queued.
+int Log_Flush(void)
+{
+    fflush(stdout);                  // Plain printf output (help, bench) keeps its place
+
+    uint64_t dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+    if (dropped != log_dropped_reported)
+    {
+        log_dropped_reported = dropped;
+        LOG_WARN("ev=log_dropped total=%llu", (unsigned long long)dropped);
+    }
+
+    while (1)
+    {
+        struct iovec iov[LOG_FLUSH_BATCH];
+        int count = 0;
+
+        for (uint64_t position = log_head; count < LOG_FLUSH_BATCH; position++)
+        {
+            log_slot_t* slot = &log_ring[position & (LOG_SLOTS - 1)];
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+                break;
+            }
+            uint32_t skip = count == 0 ? log_partial : 0;
+            iov[count].iov_base = slot->text + skip;
+            iov[count].iov_len = slot->length - skip;
+            count++;
+        }
+        if (count == 0) {
+            return 0;
+        }
+
+        ssize_t written = 0;
+        if (log_fd < 0) {
+            for (int i = 0; i < count; i++) written += (ssize_t)iov[i].iov_len;   // Discarding
+        } else {
+            written = writev(log_fd, iov, count);
+        }
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            break;                   // Would block (or the output is gone) - keep the rest queued
+        }
+
+        // Release every record written in full, remember how far into the next one we got
+        for (int i = 0; i < count && written > 0; i++)
+        {
+            if ((size_t)written < iov[i].iov_len) {
+                log_partial += (uint32_t)written;
+                break;
+            }
+            written -= (ssize_t)iov[i].iov_len;
+            log_slot_t* slot = &log_ring[log_head & (LOG_SLOTS - 1)];
+            log_partial = 0;
+            __atomic_store_n(&slot->sequence, log_head + LOG_SLOTS, __ATOMIC_RELEASE);
+            log_head++;
+        }
+    }
+
+    return (int)(__atomic_load_n(&log_tail, __ATOMIC_RELAXED) - log_head);
+}
+
+uint64_t Log_Dropped(void)
+{
+    return __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+}
@@ -1,36 +1,116 @@
 #define _DEFAULT_SOURCE
 #include "../include/smw.h"
+#include "../include/bench.h"
+#include "../include/gateway.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 
+static pipeline_t pipeline;       // Threaded mode only
+
 
 
 int main(int argc, char **argv) {
-    int measurment_interval = parse_interval(argc, argv);
+    // Everything logs through the ring - drained below whenever the loop goes idle
+    Log_Init(STDOUT_FILENO);
+
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        int rc = Run_Benchmarks(argc, argv);
+        Log_Flush();
+        return rc;
+    }
+
+    int interval_override = parse_interval(argc, argv);
+
+    // One immutable snapshot; the sensor task takes over reloads between cycles
+    Config_Init(CONFIG_FILE);
+    const config_t* config = Config_Current();
     
     task_context_t ctx = {0};
     ctx.state = STATE_INITIALIZE;
-    ctx.sockfd = -1;
-    ctx.measurement_interval = measurment_interval;
+    ctx.interval_override = interval_override;
+    ctx.measurement_interval = interval_override ? interval_override : config->measurement_interval;
     ctx.last_read_time = 0;  // Force first read immediately
+    ctx.batch_max_records = BATCH_MAX_RECORDS;
+    ctx.batch_max_bytes = BATCH_MAX_BYTES;
+    ctx.encoder = Encoder_Get(config->payload_encoding);
+    ctx.aggregation = config->aggregation;
+    ctx.deadband = config->deadband;
+    ctx.sample_interval_ms = config->sample_interval_ms;
+
+    // Seeded per node so a fleet that lost the backend together does not retry in step
+    ctx.seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    Retry_Init(&ctx.retry, RETRY_BASE_MS, RETRY_CAP_MS, BREAKER_THRESHOLD, ctx.seed);
+
+    // Backlog survives restarts - pick up readings left over from a previous run
+    if (Store_Open(&ctx.backlog, STORE_FILE, STORE_CAPACITY, STORE_OVERWRITE_OLDEST) == 0) {
+        Import_Saved_Text_File(&ctx.backlog, config->backup_file);
+    }
+
+    Smw_Init();
+    Metrics_State_Names(sensor_state_names, SENSOR_STATE_COUNT);
+    Metrics_Serve(METRICS_PORT, METRICS_DUMP_FILE, METRICS_DUMP_MS);
+
+    // Created once and kept across cycles - the state machine resets itself in STATE_DONE
+    smw_task_t* sensor_task = Create_Smw_Task(&ctx, (uint64_t (*)(void*, uint64_t))Sensor_State_Machine, SMW_PRIO_NORMAL);
+    if (!sensor_task) {
+        LOG_ERROR("ev=task_create_failed task=sensor");
+        Log_Flush();
+        return 1;
+    }
+    ctx.task = sensor_task;
+    Config_Watch(Sensor_Config_Staged, &ctx);
+
+    // Keeps a backlog that grows while offline within its size and age limits
+    Retention_Start(&ctx.backlog);
+
+    // Gateway mode: other nodes' readings share the uploader, which sends fewer and larger
+    // batches. Its queue is filled from the main loop, so there is no encoder thread.
+    if (config->gateway_port)
+    {
+        if (config->threaded) {
+            LOG_WARN("ev=threaded_unavailable reason=gateway action=single_thread");
+        }
+        if (Gateway_Start(config->gateway_port, &ctx.backlog, Sensor_Records_Queued, &ctx) == 0) {
+            ctx.queue = Gateway_Queue();
+            ctx.batch_max_records = GATEWAY_BATCH_MAX_RECORDS;
+            ctx.batch_max_bytes = GATEWAY_BATCH_MAX_BYTES;
+        }
+        else {
+            LOG_WARN("ev=gateway_unavailable port=%d action=node_only", config->gateway_port);
+        }
+    }
+    // Started after Config_Watch() blocked SIGHUP, so the threads inherit the mask
+    else if (config->threaded && config->aggregation != AGGREGATE_RAW) {
+        LOG_WARN("ev=threaded_unavailable aggregation=%s action=single_thread", Aggregation_Name(config->aggregation));
+    }
+    else if (config->threaded && Pipeline_Start(&pipeline, config, &ctx.backlog, ctx.seed, ctx.measurement_interval * 1000) == 0) {
+        ctx.pipeline = &pipeline;
+        ctx.queue = Pipeline_Queue(&pipeline);
+    }
+    else if (config->threaded) {
+        LOG_WARN("ev=threaded_unavailable action=single_thread");
+    }
 
     while (1)
     { 
-        smw_task_t* sensor_task = Create_Smw_Task(&ctx, (void (*)(void*, uint64_t))Sensor_State_Machine);
-        
-        do
-        {
-            Execute_Smw_Task(sensor_task, time(NULL));
-        } while (ctx.state != STATE_DONE && ctx.state != STATE_FAILED);
-        
-        Free_Smw_Task(sensor_task);
-        
-        // Reset state for next cycle
-        ctx.state = STATE_INITIALIZE;
-        ctx.sockfd = -1;
+        Execute_Smw_Task(Smw_Now_Ms());
+
+        // Idle: write out the log, then block until the earliest task deadline instead of
+        // spinning. Output that would block is retried shortly rather than waited for.
+        uint64_t deadline = Smw_Next_Deadline();
+        if (Log_Flush() > 0 && deadline > Smw_Now_Ms() + LOG_RETRY_MS) {
+            deadline = Smw_Now_Ms() + LOG_RETRY_MS;
+        }
+        Smw_Wait_Until(deadline);
     }
     
+    Pipeline_Stop(&pipeline);
+    Gateway_Stop();
+    Retention_Stop();
+    Free_Smw_Task(sensor_task);
+    Arena_Free(&ctx.arena);
     return 0;
 }
\ No newline at end of file
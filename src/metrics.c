@@ -0,0 +1,538 @@
+#define _DEFAULT_SOURCE
+#include "../include/smw.h"
+#include "../include/metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define METRICS_HEADER_MAX 160       // Room for the HTTP response header in front of the page
+#define METRICS_REQUEST_MAX 1024
+#define METRICS_CLIENT_TIMEOUT_MS 2000
+#define METRICS_POLL_MS 100          // Re-check interval when epoll is not available
+
+// Everything is static - recording never allocates and the heap check stays at zero
+static metrics_histogram_t metrics_timers[METRIC_TIMER_COUNT];
+static metrics_histogram_t metrics_states[METRICS_STATES_MAX];
+static uint64_t metrics_counters[METRIC_COUNTER_COUNT];
+static uint64_t metrics_gauges[METRIC_GAUGE_COUNT];
+static uint64_t metrics_results[METRICS_RESULTS];
+static const char* const* metrics_state_names = NULL;
+static int metrics_state_count = 0;
+static uint64_t metrics_started_us = 0;
+
+static const char* const metrics_timer_names[METRIC_TIMER_COUNT] = {
+    "connect", "send", "recv", "encode", "cycle", "commit",
+};
+
+// Prometheus bucket bounds in µs - coarse on purpose, the compact dump has the quantiles
+static const uint64_t metrics_bounds_us[] = {
+    100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000, 10000000, 60000000,
+};
+#define METRICS_BOUND_COUNT (int)(sizeof(metrics_bounds_us) / sizeof(metrics_bounds_us[0]))
+
+uint64_t Metrics_Now_Us(void)
+{
+    return Clock_Now_Us();
+}
+
+/* ---- Histograms ---- */
+
+static int Metrics_Bucket(uint64_t us)
+{
+    if (us < METRICS_SUB_COUNT) {
+        return (int)us;
+    }
+    int exponent = 63 - __builtin_clzll(us);
+    if (exponent > METRICS_MAX_EXPONENT) {
+        return METRICS_BUCKETS - 1;
+    }
+    int sub = (int)(us >> (exponent - METRICS_SUB_BITS)) & (METRICS_SUB_COUNT - 1);
+    return (exponent - METRICS_SUB_BITS + 1) * METRICS_SUB_COUNT + sub;
+}
+
+        // Highest value a bucket holds
+static uint64_t Metrics_Bucket_Top(int bucket)
+{
+    if (bucket < METRICS_SUB_COUNT) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / METRICS_SUB_COUNT - 1;
+    uint64_t sub = (uint64_t)(bucket % METRICS_SUB_COUNT);
+    return ((METRICS_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void Metrics_Record(metrics_histogram_t* histogram, uint64_t us)
+{
+    __atomic_fetch_add(&histogram->counts[Metrics_Bucket(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_us, us, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&histogram->max_us, __ATOMIC_RELAXED);
+    while (us > max && !__atomic_compare_exchange_n(&histogram->max_us, &max, us, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+        // Value at or below which quantile (0..1) of the samples fall, to bucket precision
+uint64_t Metrics_Percentile(const metrics_histogram_t* histogram, double quantile)
+{
+    uint64_t count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&histogram->max_us, __ATOMIC_RELAXED);
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(quantile * count + 0.5);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++)
+    {
+        seen += __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            uint64_t top = Metrics_Bucket_Top(b);
+            return top < max ? top : max;
+        }
+    }
+    return max;
+}
+
+/* ---- Recording ---- */
+
+void Metrics_Time(metrics_timer_t timer, uint64_t us)
+{
+    if (timer >= 0 && timer < METRIC_TIMER_COUNT) {
+        Metrics_Record(&metrics_timers[timer], us);
+    }
+}
+
+        // Time spent in a state machine state, recorded when the task leaves it
+void Metrics_State_Time(int state, uint64_t us)
+{
+    if (state >= 0 && state < METRICS_STATES_MAX) {
+        Metrics_Record(&metrics_states[state], us);
+    }
+}
+
+void Metrics_Count(metrics_counter_t counter, uint64_t n)
+{
+    if (counter >= 0 && counter < METRIC_COUNTER_COUNT) {
+        __atomic_fetch_add(&metrics_counters[counter], n, __ATOMIC_RELAXED);
+    }
+}
+
+void Metrics_Gauge(metrics_gauge_t gauge, uint64_t value)
+{
+    if (gauge >= 0 && gauge < METRIC_GAUGE_COUNT) {
+        __atomic_store_n(&metrics_gauges[gauge], value, __ATOMIC_RELAXED);
+    }
+}
+
+        // Counts an outcome: 0 for success, the task's negative result_code for a failure
+void Metrics_Result(int result_code)
+{
+    int index = result_code < 0 ? -result_code : result_code;
+    if (index < METRICS_RESULTS) {
+        __atomic_fetch_add(&metrics_results[index], 1, __ATOMIC_RELAXED);
+    }
+}
+
+        // Labels for the per-state histograms, indexed by state. names must outlive the program.
+void Metrics_State_Names(const char* const* names, int count)
+{
+    metrics_state_names = names;
+    metrics_state_count = count < METRICS_STATES_MAX ? count : METRICS_STATES_MAX;
+}
+
+/* ---- Rendering ---- */
+
+typedef struct {
+    char* out;
+    size_t size;
+    size_t length;
+} metrics_text_t;
+
+static void Metrics_Append(metrics_text_t* text, const char* format, ...)
+{
+    if (text->length >= text->size) return;
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text->out + text->length, text->size - text->length, format, args);
+    va_end(args);
+
+    // A line that does not fit is dropped whole - the page stays parseable
+    if (n < 0 || (size_t)n >= text->size - text->length) {
+        text->out[text->length] = '\0';
+        text->size = text->length;
+        return;
+    }
+    text->length += n;
+}
+
+static void Metrics_Prometheus_Histogram(metrics_text_t* text, const char* name, const char* label,
+                                         const char* value, const metrics_histogram_t* histogram)
+{
+    uint64_t count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+    if (count == 0) return;
+
+    uint64_t cumulative = 0;
+    int b = 0;
+    for (int i = 0; i < METRICS_BOUND_COUNT; i++)
+    {
+        for (; b < METRICS_BUCKETS && Metrics_Bucket_Top(b) <= metrics_bounds_us[i]; b++) {
+            cumulative += __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+        }
+        Metrics_Append(text, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label, value,
+                       metrics_bounds_us[i] / 1e6, (unsigned long long)cumulative);
+    }
+    Metrics_Append(text, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value, (unsigned long long)count);
+    Metrics_Append(text, "%s_sum{%s=\"%s\"} %.6f\n", name, label, value,
+                   __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED) / 1e6);
+    Metrics_Append(text, "%s_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)count);
+}
+
+        // Prometheus text exposition format 0.0.4. Returns the length written.
+int Metrics_Render_Prometheus(char* out, size_t size)
+{
+    metrics_text_t text = { out, size, 0 };
+    if (size == 0) return 0;
+    out[0] = '\0';
+
+    Metrics_Append(&text, "# HELP sensornode_state_seconds Time spent in a state before moving on\n"
+                          "# TYPE sensornode_state_seconds histogram\n");
+    for (int s = 0; s < metrics_state_count; s++) {
+        Metrics_Prometheus_Histogram(&text, "sensornode_state_seconds", "state", metrics_state_names[s], &metrics_states[s]);
+    }
+
+    Metrics_Append(&text, "# HELP sensornode_operation_seconds Latency of socket calls, encoding and whole cycles\n"
+                          "# TYPE sensornode_operation_seconds histogram\n");
+    for (int t = 0; t < METRIC_TIMER_COUNT; t++) {
+        Metrics_Prometheus_Histogram(&text, "sensornode_operation_seconds", "op", metrics_timer_names[t], &metrics_timers[t]);
+    }
+
+    Metrics_Append(&text, "# HELP sensornode_wire_bytes_total Bytes sent and received on upload sockets\n"
+                          "# TYPE sensornode_wire_bytes_total counter\n"
+                          "sensornode_wire_bytes_total{direction=\"tx\"} %llu\n"
+                          "sensornode_wire_bytes_total{direction=\"rx\"} %llu\n",
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_TX_BYTES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_RX_BYTES], __ATOMIC_RELAXED));
+
+    Metrics_Append(&text, "# HELP sensornode_results_total Uploads and cycles by result code (0 = ok)\n"
+                          "# TYPE sensornode_results_total counter\n");
+    for (int r = 0; r < METRICS_RESULTS; r++)
+    {
+        uint64_t n = __atomic_load_n(&metrics_results[r], __ATOMIC_RELAXED);
+        if (n) Metrics_Append(&text, "sensornode_results_total{code=\"%d\"} %llu\n", -r, (unsigned long long)n);
+    }
+
+    Metrics_Append(&text, "# HELP sensornode_backlog_records Records waiting in the backlog\n"
+                          "# TYPE sensornode_backlog_records gauge\n"
+                          "sensornode_backlog_records %llu\n"
+                          "# HELP sensornode_backlog_bytes Backlog file space the waiting records occupy\n"
+                          "# TYPE sensornode_backlog_bytes gauge\n"
+                          "sensornode_backlog_bytes %llu\n"
+                          "# HELP sensornode_backlog_unwritten_total Backlog records sent from the write-back cache before they were written\n"
+                          "# TYPE sensornode_backlog_unwritten_total counter\n"
+                          "sensornode_backlog_unwritten_total %llu\n",
+                   (unsigned long long)__atomic_load_n(&metrics_gauges[METRIC_BACKLOG_RECORDS], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_gauges[METRIC_BACKLOG_BYTES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_UNWRITTEN], __ATOMIC_RELAXED));
+
+    Metrics_Append(&text, "# HELP sensornode_backlog_retired_total Backlog records removed unsent by the retention limits\n"
+                          "# TYPE sensornode_backlog_retired_total counter\n"
+                          "sensornode_backlog_retired_total{reason=\"expired\"} %llu\n"
+                          "sensornode_backlog_retired_total{reason=\"evicted\"} %llu\n"
+                          "sensornode_backlog_retired_total{reason=\"downsampled\"} %llu\n",
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_EXPIRED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_EVICTED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_DOWNSAMPLED], __ATOMIC_RELAXED));
+
+    Metrics_Append(&text, "# HELP sensornode_queue_records Readings waiting in the in-memory queue (threaded or gateway mode)\n"
+                          "# TYPE sensornode_queue_records gauge\n"
+                          "sensornode_queue_records %llu\n"
+                          "# HELP sensornode_queue_spilled_total Readings written to the backlog because the queue was full\n"
+                          "# TYPE sensornode_queue_spilled_total counter\n"
+                          "sensornode_queue_spilled_total %llu\n",
+                   (unsigned long long)__atomic_load_n(&metrics_gauges[METRIC_QUEUE_RECORDS], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_QUEUE_SPILLED], __ATOMIC_RELAXED));
+
+    Metrics_Append(&text, "# HELP sensornode_gateway_readings_total Readings from downstream nodes by outcome (gateway mode)\n"
+                          "# TYPE sensornode_gateway_readings_total counter\n"
+                          "sensornode_gateway_readings_total{result=\"accepted\"} %llu\n"
+                          "sensornode_gateway_readings_total{result=\"duplicate\"} %llu\n"
+                          "sensornode_gateway_readings_total{result=\"rejected\"} %llu\n",
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_GATEWAY_ACCEPTED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_GATEWAY_DUPLICATES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_GATEWAY_REJECTED], __ATOMIC_RELAXED));
+
+    Metrics_Append(&text, "# HELP sensornode_uptime_seconds Seconds since the metrics were started\n"
+                          "# TYPE sensornode_uptime_seconds gauge\n"
+                          "sensornode_uptime_seconds %llu\n",
+                   (unsigned long long)(metrics_started_us ? (Metrics_Now_Us() - metrics_started_us) / 1000000 : 0));
+    return (int)text.length;
+}
+
+static void Metrics_Compact_Histogram(metrics_text_t* text, const char* name, const metrics_histogram_t* histogram)
+{
+    uint64_t count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+    if (count == 0) return;
+
+    Metrics_Append(text, "%s n=%llu p50=%llu p99=%llu max=%llu\n", name, (unsigned long long)count,
+                   (unsigned long long)Metrics_Percentile(histogram, 0.50),
+                   (unsigned long long)Metrics_Percentile(histogram, 0.99),
+                   (unsigned long long)__atomic_load_n(&histogram->max_us, __ATOMIC_RELAXED));
+}
+
+        // One line per series, latencies as n/p50/p99/max in µs - small enough to ship with logs
+int Metrics_Render_Compact(char* out, size_t size)
+{
+    metrics_text_t text = { out, size, 0 };
+    if (size == 0) return 0;
+    out[0] = '\0';
+
+    Metrics_Append(&text, "uptime_s=%llu tx_bytes=%llu rx_bytes=%llu backlog_records=%llu backlog_bytes=%llu"
+                          " backlog_unwritten=%llu backlog_expired=%llu backlog_evicted=%llu backlog_downsampled=%llu queue_records=%llu queue_spilled=%llu gateway_accepted=%llu gateway_duplicates=%llu"
+                          " gateway_rejected=%llu\n",
+                   (unsigned long long)(metrics_started_us ? (Metrics_Now_Us() - metrics_started_us) / 1000000 : 0),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_TX_BYTES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_RX_BYTES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_gauges[METRIC_BACKLOG_RECORDS], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_gauges[METRIC_BACKLOG_BYTES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_UNWRITTEN], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_EXPIRED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_EVICTED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_BACKLOG_DOWNSAMPLED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_gauges[METRIC_QUEUE_RECORDS], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_QUEUE_SPILLED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_GATEWAY_ACCEPTED], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_GATEWAY_DUPLICATES], __ATOMIC_RELAXED),
+                   (unsigned long long)__atomic_load_n(&metrics_counters[METRIC_GATEWAY_REJECTED], __ATOMIC_RELAXED));
+
+    Metrics_Append(&text, "results");
+    for (int r = 0; r < METRICS_RESULTS; r++)
+    {
+        uint64_t n = __atomic_load_n(&metrics_results[r], __ATOMIC_RELAXED);
+        if (n) Metrics_Append(&text, " %d=%llu", -r, (unsigned long long)n);
+    }
+    Metrics_Append(&text, "\n");
+
+    char name[48];
+    for (int s = 0; s < metrics_state_count; s++) {
+        snprintf(name, sizeof(name), "state.%s", metrics_state_names[s]);
+        Metrics_Compact_Histogram(&text, name, &metrics_states[s]);
+    }
+    for (int t = 0; t < METRIC_TIMER_COUNT; t++) {
+        snprintf(name, sizeof(name), "op.%s", metrics_timer_names[t]);
+        Metrics_Compact_Histogram(&text, name, &metrics_timers[t]);
+    }
+    return (int)text.length;
+}
+
+        // Writes the compact dump next to path and renames it over path, so readers never
+        // see a half-written file
+int Metrics_Dump(const char* path)
+{
+    static char dump[METRICS_PAGE_MAX];
+    char temp_path[256];
+
+    int length = Metrics_Render_Compact(dump, sizeof(dump));
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("ev=metrics_dump_failed path=%s", temp_path);
+        return -1;
+    }
+    int written = (int)write(fd, dump, length);
+    close(fd);
+    if (written != length || rename(temp_path, path) != 0) {
+        LOG_ERROR("ev=metrics_dump_failed path=%s", path);
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---- Endpoint: one scrape at a time on a loopback socket ---- */
+
+static int metrics_listen_fd = -1;
+static int metrics_client_fd = -1;
+static char metrics_request[METRICS_REQUEST_MAX];
+static int metrics_request_length = 0;
+static char metrics_page[METRICS_HEADER_MAX + METRICS_PAGE_MAX];
+static char* metrics_response = NULL;       // Inside metrics_page, NULL until rendered
+static int metrics_response_length = 0;
+static int metrics_response_sent = 0;
+static uint64_t metrics_client_deadline = 0;
+
+static const char* metrics_dump_path = NULL;
+static uint32_t metrics_dump_ms = 0;
+static uint64_t metrics_next_dump = 0;
+static smw_task_t* metrics_task = NULL;
+
+static void Metrics_Client_Close(void)
+{
+    Smw_Unwatch_Fd(metrics_client_fd);
+    close(metrics_client_fd);
+    metrics_client_fd = -1;
+    metrics_response = NULL;
+}
+
+        // Renders the page behind a reserved gap and puts the header right in front of it
+static void Metrics_Client_Respond(void)
+{
+    char header[METRICS_HEADER_MAX];
+    int found = strncmp(metrics_request, "GET /metrics", 12) == 0 || strncmp(metrics_request, "GET / ", 6) == 0;
+
+    char* body = metrics_page + METRICS_HEADER_MAX;
+    int body_length = found ? Metrics_Render_Prometheus(body, METRICS_PAGE_MAX)
+                            : snprintf(body, METRICS_PAGE_MAX, "Not found - try /metrics\n");
+
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %d\r\nConnection: close\r\n\r\n",
+                                 found ? "200 OK" : "404 Not Found", body_length);
+
+    metrics_response = body - header_length;
+    memcpy(metrics_response, header, header_length);
+    metrics_response_length = header_length + body_length;
+    metrics_response_sent = 0;
+}
+
+static void Metrics_Client_Step(void)
+{
+    if (!metrics_response)
+    {
+        ssize_t n = recv(metrics_client_fd, metrics_request + metrics_request_length,
+                         METRICS_REQUEST_MAX - 1 - metrics_request_length, MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (n <= 0) {
+            Metrics_Client_Close();
+            return;
+        }
+        metrics_request_length += n;
+        metrics_request[metrics_request_length] = '\0';
+
+        if (!strstr(metrics_request, "\r\n\r\n") && metrics_request_length < METRICS_REQUEST_MAX - 1) {
+            return;
+        }
+        Metrics_Client_Respond();
+    }
+
+    while (metrics_response_sent < metrics_response_length)
+    {
+        ssize_t n = send(metrics_client_fd, metrics_response + metrics_response_sent,
+                         metrics_response_length - metrics_response_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n < 0) break;
+        metrics_response_sent += n;
+    }
+    Metrics_Client_Close();
+}
+
+static uint64_t Metrics_Task(void* context, uint64_t monTime)
+{
+    (void)context;
+
+    if (metrics_dump_ms && monTime >= metrics_next_dump)
+    {
+        Metrics_Dump(metrics_dump_path);
+        metrics_next_dump = monTime + metrics_dump_ms;
+    }
+
+    if (metrics_client_fd >= 0 && monTime >= metrics_client_deadline) {
+        Metrics_Client_Close();
+    }
+    if (metrics_client_fd < 0 && metrics_listen_fd >= 0)
+    {
+        int fd = accept(metrics_listen_fd, NULL, NULL);
+        if (fd >= 0)
+        {
+            if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+                close(fd);
+            }
+            else {
+                // A scraper is served alone - the listen socket rests until it is done
+                Smw_Unwatch_Fd(metrics_listen_fd);
+                metrics_client_fd = fd;
+                metrics_request_length = 0;
+                metrics_client_deadline = monTime + METRICS_CLIENT_TIMEOUT_MS;
+            }
+        }
+    }
+    if (metrics_client_fd >= 0) {
+        Metrics_Client_Step();
+    }
+
+    uint64_t next_run = metrics_dump_ms ? metrics_next_dump : UINT64_MAX;
+    int watched;
+    if (metrics_client_fd >= 0) {
+        if (metrics_client_deadline < next_run) next_run = metrics_client_deadline;
+        watched = Smw_Watch_Fd(metrics_task, metrics_client_fd, metrics_response ? EPOLLOUT : EPOLLIN);
+    }
+    else {
+        watched = metrics_listen_fd >= 0 ? Smw_Watch_Fd(metrics_task, metrics_listen_fd, EPOLLIN) : 0;
+    }
+    if (watched < 0 && monTime + METRICS_POLL_MS < next_run) {
+        next_run = monTime + METRICS_POLL_MS;
+    }
+    return next_run;
+}
+
+        // Opens the Prometheus endpoint on 127.0.0.1:port (0 = none) and rewrites dump_path every
+        // dump_ms (0 = never) from a low-priority task. Call after Smw_Init().
+int Metrics_Serve(int port, const char* dump_path, uint32_t dump_ms)
+{
+    metrics_started_us = Metrics_Now_Us();
+    metrics_dump_path = dump_path;
+    metrics_dump_ms = dump_path ? dump_ms : 0;
+    metrics_next_dump = Smw_Now_Ms() + metrics_dump_ms;
+
+    if (port > 0)
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int one = 1;
+        metrics_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (metrics_listen_fd < 0 ||
+            setsockopt(metrics_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+            bind(metrics_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            listen(metrics_listen_fd, 4) < 0 ||
+            fcntl(metrics_listen_fd, F_SETFL, fcntl(metrics_listen_fd, F_GETFL, 0) | O_NONBLOCK) < 0)
+        {
+            LOG_ERROR("ev=metrics_listen_failed port=%d errno=%d", port, errno);
+            if (metrics_listen_fd >= 0) close(metrics_listen_fd);
+            metrics_listen_fd = -1;
+        }
+        else {
+            LOG_INFO("ev=metrics_listen url=http://127.0.0.1:%d/metrics", port);
+        }
+    }
+
+    if (metrics_listen_fd < 0 && !metrics_dump_ms) {
+        return -1;
+    }
+    metrics_task = Create_Smw_Task(NULL, Metrics_Task, SMW_PRIO_LOW);
+    if (!metrics_task) {
+        LOG_ERROR("ev=task_create_failed task=metrics");
+        return -1;
+    }
+    if (metrics_dump_ms) {
+        LOG_INFO("ev=metrics_dump path=%s every_s=%u", dump_path, (unsigned)(dump_ms / 1000));
+    }
+    return 0;
+}
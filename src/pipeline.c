@@ -0,0 +1,349 @@
+#define _POSIX_C_SOURCE 200112L
+#include "../include/pipeline.h"
+#include "../include/metrics.h"
+#include "../include/clock.h"
+#include "../include/log.h"
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+static void Pipeline_Signal(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("ev=pipeline_signal_failed errno=%d", errno);
+    }
+}
+
+static void Pipeline_Drain(int fd)
+{
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("ev=pipeline_drain_failed errno=%d", errno);
+    }
+}
+
+        // Waits for fd (or for timeout_ms, -1 = no limit). Returns 1 once the pipeline is stopping.
+static int Pipeline_Wait(const pipeline_t* pipeline, int fd, int timeout_ms)
+{
+    struct pollfd fds[2] = {
+        { .fd = pipeline->stop_fd, .events = POLLIN },
+        { .fd = fd, .events = POLLIN },
+    };
+    if (poll(fds, fd >= 0 ? 2 : 1, timeout_ms) < 0 && errno != EINTR) {
+        LOG_ERROR("ev=pipeline_poll_failed errno=%d", errno);
+    }
+    return (fds[0].revents & POLLIN) != 0;
+}
+
+/* ---- Sampler thread ---- */
+
+        // One row per period: every channel's value into the sample ring, then the encoder is told
+static void Pipeline_Sample(pipeline_t* pipeline)
+{
+    channel_set_t* channels = &pipeline->channels;
+    if (Channel_Sample_All(channels, Clock_Wall_Ms()) < 0) {
+        return;
+    }
+    int latest = (int)Channel_Pending(channels) - 1;
+
+    for (int c = 0; c < channels->count; c++)
+    {
+        const int64_t* timestamps;
+        const double* values;
+        if (Channel_Window(channels, c, latest, 1, &timestamps, &values) != 1) continue;
+
+        pipeline_sample_t* sample = Spsc_Claim(&pipeline->samples);
+        if (!sample) {
+            pipeline->samples_dropped++;
+            LOG_WARN("ev=pipeline_sample_dropped channel=%d dropped=%lu", c, pipeline->samples_dropped);
+            continue;
+        }
+        sample->epoch_ms = timestamps[0];
+        sample->value = values[0];
+        sample->channel = c;
+        Spsc_Publish(&pipeline->samples);
+    }
+    Channel_Consume(channels, Channel_Pending(channels));
+    Pipeline_Signal(pipeline->encode_fd);
+}
+
+static void* Pipeline_Sampler(void* arg)
+{
+    pipeline_t* pipeline = arg;
+    uint64_t next = Clock_Now_Ms();
+
+    while (1)
+    {
+        uint64_t now = Clock_Now_Ms();
+        if (now < next) {
+            if (Pipeline_Wait(pipeline, -1, (int)(next - now))) break;
+            continue;
+        }
+
+        Pipeline_Sample(pipeline);
+
+        // Keeps the cadence; a period missed entirely is skipped, not caught up
+        next += (uint64_t)__atomic_load_n(&pipeline->period_ms, __ATOMIC_RELAXED);
+        if (next <= now) {
+            next = now + (uint64_t)__atomic_load_n(&pipeline->period_ms, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/* ---- Encoder thread ---- */
+
+        // Encodes one sample in place into the record ring, or into the backlog while the ring
+        // is full. Returns 1 if the uploader has something new.
+static int Pipeline_Encode(pipeline_t* pipeline, const pipeline_sample_t* sample)
+{
+    const channel_t* channel = &pipeline->channels.channels[sample->channel];
+    Sensor_Data_t data = {0};
+    data.value = sample->value;
+    data.quantity = Channel_Quantity(channel->kind);
+    data.epoch = (time_t)(sample->epoch_ms / 1000);
+    data.timestamp = Format_Timestamp(data.epoch);
+    data.sensor_id = channel->id;
+
+    uint64_t started = Metrics_Now_Us();
+    pipeline_record_t* record = Spsc_Claim(&pipeline->records);
+    if (record)
+    {
+        int length = pipeline->encoder->encode(&data, record->data, sizeof(record->data));
+        Metrics_Time(METRIC_ENCODE, Metrics_Now_Us() - started);
+        if (length <= 0) {
+            pipeline->lost++;
+            return 0;
+        }
+        record->length = (uint16_t)length;
+        record->type = pipeline->encoder->store_type;
+        Spsc_Publish(&pipeline->records);
+        return 1;
+    }
+
+    // Queue full: the uploader is offline or behind - keep the reading on disk instead
+    char payload[STORE_PAYLOAD_MAX];
+    int length = pipeline->encoder->encode(&data, payload, sizeof(payload));
+    Metrics_Time(METRIC_ENCODE, Metrics_Now_Us() - started);
+    if (length <= 0 || Save_Sensor_Data_To_File(pipeline->backlog, payload, length, pipeline->encoder->store_type) < 0) {
+        pipeline->lost++;
+        LOG_WARN("ev=pipeline_record_lost lost=%lu", pipeline->lost);
+        return 0;
+    }
+    pipeline->spilled++;
+    Metrics_Count(METRIC_QUEUE_SPILLED, 1);
+    if (pipeline->spilled == 1 || pipeline->spilled % PIPELINE_RECORD_SLOTS == 0) {
+        LOG_INFO("ev=pipeline_spill queued=%u spilled=%lu", Spsc_Count(&pipeline->records), pipeline->spilled);
+    }
+    return 1;
+}
+
+        // Wakes the uploader if, and only if, it said it is going to sleep
+static void Pipeline_Wake_Uploader(pipeline_t* pipeline)
+{
+    // Pairs with the fence in Pipeline_Idle(): either the uploader sees the record or we see the flag
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&pipeline->uploader_idle, 0, __ATOMIC_SEQ_CST)) {
+        Pipeline_Signal(pipeline->wake_fd);
+    }
+}
+
+static void* Pipeline_Encoder(void* arg)
+{
+    pipeline_t* pipeline = arg;
+    int stopping = 0;
+
+    while (!stopping)
+    {
+        stopping = Pipeline_Wait(pipeline, pipeline->encode_fd, -1);
+        Pipeline_Drain(pipeline->encode_fd);
+
+        // Whatever was sampled before the stop is still encoded
+        int handed_over = 0;
+        const pipeline_sample_t* sample;
+        while ((sample = Spsc_Peek(&pipeline->samples)) != NULL)
+        {
+            handed_over |= Pipeline_Encode(pipeline, sample);
+            Spsc_Advance(&pipeline->samples);
+            Spsc_Release(&pipeline->samples, 1);
+        }
+        if (handed_over) {
+            Metrics_Gauge(METRIC_QUEUE_RECORDS, Spsc_Count(&pipeline->records));
+            Pipeline_Wake_Uploader(pipeline);
+        }
+    }
+    return NULL;
+}
+
+/* ---- Control ---- */
+
+static int Pipeline_Eventfd(void)
+{
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("ev=eventfd_failed errno=%d", errno);
+    }
+    return fd;
+}
+
+static void Pipeline_Close_Fds(pipeline_t* pipeline)
+{
+    if (pipeline->stop_fd >= 0) close(pipeline->stop_fd);
+    if (pipeline->encode_fd >= 0) close(pipeline->encode_fd);
+    if (pipeline->wake_fd >= 0) close(pipeline->wake_fd);
+    pipeline->stop_fd = pipeline->encode_fd = pipeline->wake_fd = -1;
+}
+
+        // Sets up the sampler's channels from config (ids, ranges, encoding are taken once),
+        // shares backlog with the encoder and starts both threads. The caller is the uploader.
+int Pipeline_Start(pipeline_t* pipeline, const config_t* config, store_t* backlog, uint64_t seed, int period_ms)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->stop_fd = pipeline->encode_fd = pipeline->wake_fd = -1;
+    pipeline->encoder = Encoder_Get(config->payload_encoding);
+    pipeline->backlog = backlog;
+    pipeline->period_ms = period_ms;
+
+    if (Arena_Init(&pipeline->arena, PIPELINE_ARENA_SIZE) < 0 ||
+        Spsc_Init(&pipeline->samples, &pipeline->arena, PIPELINE_SAMPLE_SLOTS, sizeof(pipeline_sample_t)) < 0 ||
+        Spsc_Init(&pipeline->records, &pipeline->arena, PIPELINE_RECORD_SLOTS, sizeof(pipeline_record_t)) < 0 ||
+        Channel_Set_Init(&pipeline->channels, &pipeline->arena, CHANNEL_DEFAULT_MAX, CHANNEL_ROWS) < 0 ||
+        Sensor_Register_Channels(&pipeline->channels) < 0)
+    {
+        Arena_Free(&pipeline->arena);
+        return -1;
+    }
+    Sensor_Configure_Channels(&pipeline->channels, config->device_id, config->temperature_min, config->temperature_max);
+    Channel_Seed(&pipeline->channels, seed);
+
+    pipeline->stop_fd = Pipeline_Eventfd();
+    pipeline->encode_fd = Pipeline_Eventfd();
+    pipeline->wake_fd = Pipeline_Eventfd();
+    if (pipeline->stop_fd < 0 || pipeline->encode_fd < 0 || pipeline->wake_fd < 0) {
+        Pipeline_Close_Fds(pipeline);
+        Arena_Free(&pipeline->arena);
+        return -1;
+    }
+
+    pthread_mutex_init(&pipeline->backlog_lock, NULL);
+    Store_Share(backlog, &pipeline->backlog_lock);
+
+    if (pthread_create(&pipeline->encoder_thread, NULL, Pipeline_Encoder, pipeline) != 0) {
+        LOG_ERROR("ev=thread_create_failed thread=encoder");
+        Store_Share(backlog, NULL);
+        Pipeline_Close_Fds(pipeline);
+        Arena_Free(&pipeline->arena);
+        return -1;
+    }
+    if (pthread_create(&pipeline->sampler_thread, NULL, Pipeline_Sampler, pipeline) != 0) {
+        LOG_ERROR("ev=thread_create_failed thread=sampler");
+        Pipeline_Signal(pipeline->stop_fd);
+        pthread_join(pipeline->encoder_thread, NULL);
+        Store_Share(backlog, NULL);
+        Pipeline_Close_Fds(pipeline);
+        Arena_Free(&pipeline->arena);
+        return -1;
+    }
+    pipeline->running = 1;
+
+    LOG_INFO("ev=pipeline_started period_ms=%d queue=%d encoding=%s", period_ms, PIPELINE_RECORD_SLOTS,
+             pipeline->encoder->name);
+    return 0;
+}
+
+        // Stops both threads after the encoder has handled what was sampled. Queued records
+        // not acked yet are dropped with the ring.
+void Pipeline_Stop(pipeline_t* pipeline)
+{
+    if (!pipeline->running) return;
+
+    Pipeline_Signal(pipeline->stop_fd);
+    pthread_join(pipeline->sampler_thread, NULL);
+    pthread_join(pipeline->encoder_thread, NULL);
+    pipeline->running = 0;
+
+    LOG_INFO("ev=pipeline_stopped queued=%u spilled=%lu lost=%lu samples_dropped=%lu",
+             Spsc_Count(&pipeline->records), pipeline->spilled, pipeline->lost, pipeline->samples_dropped);
+    Store_Share(pipeline->backlog, NULL);
+    pthread_mutex_destroy(&pipeline->backlog_lock);
+    Pipeline_Close_Fds(pipeline);
+    Arena_Free(&pipeline->arena);
+}
+
+        // A new measurement interval takes effect after the current period
+void Pipeline_Set_Period(pipeline_t* pipeline, int period_ms)
+{
+    __atomic_store_n(&pipeline->period_ms, period_ms, __ATOMIC_RELAXED);
+}
+
+/* ---- Uploader side ---- */
+
+static int Pipeline_Peek(void* source, store_view_t* view)
+{
+    spsc_ring_t* records = source;
+    const pipeline_record_t* record = Spsc_Peek(records);
+    if (!record) return 0;
+
+    view->data = record->data;
+    view->length = record->length;
+    view->type = record->type;
+    view->seq = records->cursor;
+    return 1;
+}
+
+static void Pipeline_Advance(void* source)
+{
+    Spsc_Advance(source);
+}
+
+        // The record ring the uploader drains. Acked records are freed with Spsc_Release(),
+        // a failed upload reads them again after Spsc_Rewind().
+spsc_ring_t* Pipeline_Queue(pipeline_t* pipeline)
+{
+    return &pipeline->records;
+}
+
+        // Reads the records of any pipeline_record_t ring in place for Read_Record_Batches();
+        // they stay queued until released
+record_cursor_t Pipeline_Queue_Cursor(spsc_ring_t* queue)
+{
+    record_cursor_t cursor = { queue, Pipeline_Peek, Pipeline_Advance };
+    return cursor;
+}
+
+        // The uploader has drained the queue and the backlog and wants to sleep on the wake fd.
+        // Returns 1 if it may, 0 if a record slipped in meanwhile. A wakeup the encoder sent
+        // anyway just makes one spurious dispatch.
+int Pipeline_Idle(pipeline_t* pipeline)
+{
+    __atomic_store_n(&pipeline->uploader_idle, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (Spsc_Unread(&pipeline->records) > 0 || Store_Count(pipeline->backlog) > 0) {
+        __atomic_store_n(&pipeline->uploader_idle, 0, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+    pipeline->uploader_sleeping = 1;
+    return 1;
+}
+
+        // Called whenever the uploader runs: returns 1 (and consumes the wakeup) if it had gone
+        // idle, so it looks at the queue again
+int Pipeline_Woken(pipeline_t* pipeline)
+{
+    if (!pipeline->uploader_sleeping) return 0;
+
+    pipeline->uploader_sleeping = 0;
+    __atomic_store_n(&pipeline->uploader_idle, 0, __ATOMIC_SEQ_CST);
+    Pipeline_Drain(pipeline->wake_fd);
+    return 1;
+}
+
+        // Watch for EPOLLIN | EPOLLET: a wakeup never needs reading to stop it firing again
+int Pipeline_Wake_Fd(const pipeline_t* pipeline)
+{
+    return pipeline->wake_fd;
+}
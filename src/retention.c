@@ -0,0 +1,140 @@
+#include "../include/smw.h"
+#include "../include/retention.h"
+#include <string.h>
+
+static retention_stats_t retention_stats;
+static store_t* retention_backlog = NULL;
+static smw_task_t* retention_task = NULL;
+static uint8_t retention_parity[RETENTION_SOURCES];          // Per sensor: its last reading in the window was kept
+static char retention_window[RETENTION_THIN_RECORDS * STORE_SLOT_SIZE];
+
+        // Readings measured before the cutoff. A record that tells no time stops the scan.
+static int Retention_Expired(const store_view_t* view, void* context)
+{
+    int64_t cutoff_ms = *(const int64_t*)context;
+    record_info_t info;
+    return Record_Info(view->data, view->length, view->type, &info) == 0 && info.epoch_ms < cutoff_ms;
+}
+
+        // Every other reading of each sensor, starting with its first - two channels written
+        // alternately both keep half their readings
+static int Retention_Keep(const store_view_t* view, void* context)
+{
+    (void)context;
+    record_info_t info;
+    if (Record_Info(view->data, view->length, view->type, &info) < 0) {
+        return 1;
+    }
+    uint8_t* kept = &retention_parity[info.source % RETENTION_SOURCES];
+    *kept ^= 1;
+    return *kept;
+}
+
+        // Records the backlog may hold. Downsampling starts a window before the file is full,
+        // so the ring does not overwrite the oldest records before they could be thinned.
+static uint32_t Retention_Limit(const store_t* backlog, const config_t* config)
+{
+    uint32_t limit = backlog->capacity;
+    if (config->retention_policy == RETENTION_DOWNSAMPLE_OLDEST && limit > 2 * RETENTION_THIN_RECORDS) {
+        limit -= RETENTION_THIN_RECORDS;
+    }
+    if (config->retention_max_bytes > 0 && (uint32_t)config->retention_max_bytes / backlog->slot_size < limit) {
+        limit = (uint32_t)config->retention_max_bytes / backlog->slot_size;
+    }
+    return limit > 0 ? limit : 1;
+}
+
+static uint64_t Retention_Task(void* context, uint64_t monTime)
+{
+    (void)context;
+    const config_t* config = Config_Current();
+    int expired = 0, dropped = 0, downsampled = 0;
+    int more = 0;
+
+    // Age goes first, whatever the policy
+    if (config->retention_max_age_s > 0)
+    {
+        int64_t cutoff_ms = Clock_Wall_Ms() - (int64_t)config->retention_max_age_s * 1000;
+        expired = Store_Drop_Oldest(retention_backlog, RETENTION_STEP_RECORDS, Retention_Expired, &cutoff_ms);
+        more = expired == RETENTION_STEP_RECORDS;
+    }
+
+    uint32_t limit = Retention_Limit(retention_backlog, config);
+    uint32_t used = Store_Count(retention_backlog);
+    if (used > limit)
+    {
+        if (config->retention_policy == RETENTION_DOWNSAMPLE_OLDEST)
+        {
+            memset(retention_parity, 0, sizeof(retention_parity));
+            downsampled = Store_Thin_Oldest(retention_backlog, RETENTION_THIN_RECORDS, Retention_Keep, NULL,
+                                            retention_window, sizeof(retention_window));
+        }
+        // Nothing to thin (one record per sensor, or all of them still cached) - drop instead
+        if (config->retention_policy == RETENTION_DROP_OLDEST || downsampled == 0)
+        {
+            uint32_t excess = used - limit;
+            dropped = Store_Drop_Oldest(retention_backlog, excess < RETENTION_STEP_RECORDS ? excess : RETENTION_STEP_RECORDS,
+                                        NULL, NULL);
+        }
+        more = more || Store_Count(retention_backlog) > limit;
+    }
+
+    // -1: an upload holds the oldest records, try again later
+    if (expired < 0) expired = 0;
+    if (dropped < 0) dropped = 0;
+    if (downsampled < 0) downsampled = 0;
+    if (expired + dropped + downsampled == 0) {
+        return monTime + RETENTION_PERIOD_MS;
+    }
+
+    // The head moved - the header follows now rather than with the next successful upload
+    Store_Sync(retention_backlog);
+    retention_stats.expired += expired;
+    retention_stats.dropped += dropped;
+    retention_stats.downsampled += downsampled;
+    retention_stats.runs++;
+    Metrics_Count(METRIC_BACKLOG_EXPIRED, expired);
+    Metrics_Count(METRIC_BACKLOG_EVICTED, dropped);
+    Metrics_Count(METRIC_BACKLOG_DOWNSAMPLED, downsampled);
+
+    uint32_t records = Store_Count(retention_backlog);
+    Metrics_Gauge(METRIC_BACKLOG_RECORDS, records);
+    Metrics_Gauge(METRIC_BACKLOG_BYTES, (uint64_t)records * retention_backlog->slot_size);
+    LOG_DEBUG("ev=backlog_retention expired=%d dropped=%d downsampled=%d records=%u limit=%u",
+              expired, dropped, downsampled, records, limit);
+
+    // More to do - again once the other due tasks had their turn
+    return more ? monTime : monTime + RETENTION_PERIOD_MS;
+}
+
+        // Keeps backlog within the retention_* limits of the current config snapshot, read on
+        // every run so a reload applies without a restart. Call after Smw_Init().
+int Retention_Start(store_t* backlog)
+{
+    if (!backlog || backlog->fd < 0) {
+        return -1;
+    }
+    memset(&retention_stats, 0, sizeof(retention_stats));
+    retention_backlog = backlog;
+
+    retention_task = Create_Smw_Task(NULL, Retention_Task, SMW_PRIO_LOW);
+    if (!retention_task) {
+        LOG_ERROR("ev=task_create_failed task=retention");
+        return -1;
+    }
+    return 0;
+}
+
+const retention_stats_t* Retention_Stats(void)
+{
+    return &retention_stats;
+}
+
+void Retention_Stop(void)
+{
+    if (retention_task) {
+        Free_Smw_Task(retention_task);
+        retention_task = NULL;
+    }
+    retention_backlog = NULL;
+}
@@ -0,0 +1,137 @@
+#include "../include/retry.h"
+#include "../include/log.h"
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t Retry_Random(retry_policy_t* policy)
+{
+    // xorshift32 - plenty for spreading retries, no libc state shared with anyone
+    uint32_t x = policy->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    policy->seed = x;
+    return x;
+}
+
+void Retry_Init(retry_policy_t* policy, uint32_t base_ms, uint32_t cap_ms, uint32_t threshold, uint32_t seed)
+{
+    if (!policy) return;
+
+    memset(policy, 0, sizeof(*policy));
+    policy->state = BREAKER_CLOSED;
+    policy->base_ms = base_ms > 0 ? base_ms : 1;
+    policy->cap_ms = cap_ms >= policy->base_ms ? cap_ms : policy->base_ms;
+    policy->threshold = threshold > 0 ? threshold : 1;
+    policy->delay_ms = policy->base_ms;
+    policy->seed = seed ? seed : 0x9E3779B9u;
+}
+
+        // Returns 1 if an upload may start now. An open breaker whose wait is over
+        // goes half-open and hands out a single probe.
+int Retry_Allow(retry_policy_t* policy, uint64_t now)
+{
+    if (!policy) return 1;
+    if (now < policy->next_attempt_at) return 0;
+
+    switch (policy->state)
+    {
+        case BREAKER_CLOSED:
+            return 1;
+
+        case BREAKER_OPEN:
+            policy->state = BREAKER_HALF_OPEN;
+            policy->probe_in_flight = 1;
+            LOG_INFO("ev=breaker state=half_open action=probe");
+            return 1;
+
+        case BREAKER_HALF_OPEN:
+            if (policy->probe_in_flight) return 0;
+            policy->probe_in_flight = 1;
+            return 1;
+    }
+    return 1;
+}
+
+        // Earliest time Retry_Allow() can say yes (0 = now)
+uint64_t Retry_Next_Attempt(const retry_policy_t* policy)
+{
+    return policy ? policy->next_attempt_at : 0;
+}
+
+void Retry_Success(retry_policy_t* policy, uint64_t now)
+{
+    if (!policy) return;
+
+    if (policy->offline_since) {
+        LOG_INFO("ev=back_online offline_s=%llu failures=%u",
+                 (unsigned long long)(now - policy->offline_since) / 1000, policy->failures);
+    }
+    if (policy->state != BREAKER_CLOSED) {
+        LOG_INFO("ev=breaker state=closed");
+    }
+
+    policy->state = BREAKER_CLOSED;
+    policy->failures = 0;
+    policy->delay_ms = policy->base_ms;
+    policy->offline_since = 0;
+    policy->probe_in_flight = 0;
+    // next_attempt_at is left alone - a Retry-After hold may still apply
+}
+
+void Retry_Failure(retry_policy_t* policy, uint64_t now)
+{
+    if (!policy) return;
+
+    if (policy->failures == 0) {
+        policy->offline_since = now;
+    }
+    policy->failures++;
+    policy->probe_in_flight = 0;
+
+    // Decorrelated jitter: random_between(base, previous * 3), capped
+    uint64_t upper = policy->delay_ms * 3;
+    if (upper > policy->cap_ms) upper = policy->cap_ms;
+    uint64_t delay = policy->base_ms;
+    if (upper > policy->base_ms) {
+        delay += Retry_Random(policy) % (upper - policy->base_ms + 1);
+    }
+    policy->delay_ms = delay;
+
+    if (now + delay > policy->next_attempt_at) {
+        policy->next_attempt_at = now + delay;
+    }
+
+    if (policy->state == BREAKER_HALF_OPEN ||
+        (policy->state == BREAKER_CLOSED && policy->failures >= policy->threshold))
+    {
+        if (policy->state == BREAKER_CLOSED) policy->trips++;
+        policy->state = BREAKER_OPEN;
+        LOG_WARN("ev=breaker state=open failures=%u next_attempt_ms=%llu",
+                 policy->failures, (unsigned long long)(policy->next_attempt_at - now));
+    }
+    else if (policy->state == BREAKER_CLOSED)
+    {
+        LOG_WARN("ev=upload_failed failures=%u threshold=%u retry_ms=%llu",
+                 policy->failures, policy->threshold, (unsigned long long)(policy->next_attempt_at - now));
+    }
+}
+
+        // Server-side hold (Retry-After): no attempt before until, whatever the backoff says
+void Retry_Hold(retry_policy_t* policy, uint64_t until)
+{
+    if (policy && until > policy->next_attempt_at) {
+        policy->next_attempt_at = until;
+    }
+}
+
+const char* Retry_State_Name(breaker_state_t state)
+{
+    switch (state)
+    {
+        case BREAKER_CLOSED:    return "closed";
+        case BREAKER_OPEN:      return "open";
+        case BREAKER_HALF_OPEN: return "half-open";
+    }
+    return "unknown";
+}
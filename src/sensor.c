@@ -1,4 +1,9 @@
+#define _POSIX_C_SOURCE 200112L
 #include "../include/sensor.h"
+#include "../include/encode.h"
+#include "../include/config.h"
+#include "../include/log.h"
+#include "../include/clock.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -12,271 +17,482 @@ int Sensor_Init(void)
        // printf("Sensor already initialized\n");
         return 0;
     }
-    printf("Initializing sensor system...\n");
-    
-    srand(time(NULL));
-    
+    LOG_DEBUG("ev=sensor_init");
+
     sensor_initialized = 1;
-    printf("Sensor system initialized\n");
+    LOG_INFO("ev=sensor_ready");
     return 0;
 }
 
-Sensor_Data_t* Sensor_Read(void)
+        // The node's own channels. Channel 0 is the primary reading.
+int Sensor_Register_Channels(channel_set_t* channels)
+{
+    if (Channel_Add(channels, DEFAULT_SENSOR_ID, CHANNEL_TEMPERATURE) < 0 ||
+        Channel_Add(channels, DEFAULT_HUMIDITY_ID, CHANNEL_HUMIDITY) < 0 ||
+        Channel_Add(channels, DEFAULT_PRESSURE_ID, CHANNEL_PRESSURE) < 0)
+    {
+        return -1;
+    }
+    LOG_INFO("ev=channels_registered count=%d", channels->count);
+    return 0;
+}
+
+        // Names the node's channels after device_id and sets the temperature range
+int Sensor_Configure_Channels(channel_set_t* channels, const char* device_id, double temperature_min, double temperature_max)
+{
+    char id[CHANNEL_ID_MAX + 1];
+    int rc = 0;
+
+    for (int c = 0; c < channels->count; c++)
+    {
+        const channel_t* channel = &channels->channels[c];
+        double min = channel->min, max = channel->max;
+
+        if (c == 0) {
+            snprintf(id, sizeof(id), "%s", device_id);
+        }
+        else {
+            snprintf(id, sizeof(id), "%s_%s", device_id, Channel_Quantity(channel->kind));
+        }
+        if (channel->kind == CHANNEL_TEMPERATURE) {
+            min = temperature_min;
+            max = temperature_max;
+        }
+        if (Channel_Configure(channels, c, id, min, max) < 0) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+        // Latest sample of one channel as a reading. It lives in the caller's per-cycle
+        // arena - no heap call per measurement. The timestamp text is valid until the next read.
+Sensor_Data_t* Sensor_Read(arena_t* arena, const channel_set_t* channels, int channel)
 {
     if (!sensor_initialized) {
-        printf("Sensor not initialized! Call Sensor_Init() first\n");
+        LOG_ERROR("ev=sensor_not_initialized");
+        return NULL;
+    }
+
+    const int64_t* timestamps;
+    const double* values;
+    uint32_t pending = Channel_Pending(channels);
+    if (pending == 0 || Channel_Window(channels, channel, pending - 1, 1, &timestamps, &values) != 1) {
+        LOG_WARN("ev=no_sample channel=%d", channel);
         return NULL;
     }
-    printf("Reading sensors...\n");
     
-    Sensor_Data_t* SensorData_t = malloc(sizeof(Sensor_Data_t));
+    Sensor_Data_t* SensorData_t = Arena_Alloc(arena, sizeof(Sensor_Data_t));
     if (!SensorData_t) {
-        printf("Failed to allocate memory for sensor data\n");
+        LOG_ERROR("ev=alloc_failed what=sensor_data");
         return NULL;
     }
+    memset(SensorData_t, 0, sizeof(*SensorData_t));     // Arena memory is not zeroed - no stale summary
 
-    SensorData_t->temperature = Random_Temperature_Sensor();
-    SensorData_t->timestamp = Get_Current_Timestamp();
-    SensorData_t->sensor_id = DEFAULT_SENSOR_ID;
+    const channel_t* source = &channels->channels[channel];
+    SensorData_t->value = values[0];
+    SensorData_t->quantity = Channel_Quantity(source->kind);
+    SensorData_t->epoch = (time_t)(timestamps[0] / 1000);
+    SensorData_t->timestamp = Format_Timestamp(SensorData_t->epoch);
+    SensorData_t->sensor_id = source->id;
     
-    printf("Sensor ID: %s Temperature: %.2f°C Timestamp: %s\n", SensorData_t->sensor_id, SensorData_t->temperature, SensorData_t->timestamp);
+    LOG_DEBUG("ev=sample sensor=%s %s=%.2f time=%s", SensorData_t->sensor_id, SensorData_t->quantity,
+              SensorData_t->value, SensorData_t->timestamp);
     
     return SensorData_t;
 }
 
+        // One channel's window summary as a reading. Timestamp and epoch are those of the
+        // window's last sample; the summary stays owned by the caller.
+Sensor_Data_t* Sensor_Summary(arena_t* arena, const channel_set_t* channels, int channel, const aggregate_t* window)
+{
+    if (!window || window->count == 0) {
+        return NULL;
+    }
+
+    Sensor_Data_t* SensorData_t = Arena_Alloc(arena, sizeof(Sensor_Data_t));
+    if (!SensorData_t) {
+        LOG_ERROR("ev=alloc_failed what=sensor_data");
+        return NULL;
+    }
+    memset(SensorData_t, 0, sizeof(*SensorData_t));
+
+    const channel_t* source = &channels->channels[channel];
+    SensorData_t->value = window->mean;
+    SensorData_t->quantity = Channel_Quantity(source->kind);
+    SensorData_t->epoch = (time_t)(window->last_ms / 1000);
+    SensorData_t->timestamp = Format_Timestamp(SensorData_t->epoch);
+    SensorData_t->sensor_id = source->id;
+    SensorData_t->summary = window;
+
+    LOG_DEBUG("ev=summary sensor=%s quantity=%s samples=%u min=%.2f max=%.2f mean=%.2f", SensorData_t->sensor_id,
+              SensorData_t->quantity, window->count, window->min, window->max, window->mean);
+
+    return SensorData_t;
+}
+
+        // A window summary: the quantity key holds count/min/max/mean/stddev
+static int Sensor_JSON_Summary(const Sensor_Data_t* SensorData_t, char* json_buffer, int buffer_size)
+{
+    const aggregate_t* window = SensorData_t->summary;
+    int jsondata = snprintf(json_buffer, buffer_size,
+                          "{\n"
+                                "\"sensor_id\": \"%s\",\n"
+                                "\"timestamp\": \"%s\",\n"
+                                "\"window_s\": %lld,\n"
+                                "\"%s\": {\"count\": %u, \"min\": %.2f, \"max\": %.2f, \"mean\": %.2f, \"stddev\": %.2f}\n"
+                          "}",
+                          SensorData_t->sensor_id ? SensorData_t->sensor_id : "unknown",
+                          SensorData_t->timestamp ? SensorData_t->timestamp : "unknown",
+                          (long long)((window->last_ms - window->first_ms + 500) / 1000),
+                          SensorData_t->quantity ? SensorData_t->quantity : "temperature",
+                          window->count, window->min, window->max, window->mean, Aggregate_Stddev(window));
+
+    if (jsondata >= buffer_size) {
+        LOG_ERROR("ev=buffer_too_small what=json needed=%d available=%d", jsondata, buffer_size);
+        return -1;
+    }
+    return jsondata;
+}
+
 int Sensor_JSON(const Sensor_Data_t* SensorData_t, char* json_buffer, int buffer_size)
 {
     if (!SensorData_t || !json_buffer) {
-        printf("Invalid parameters for JSON builder\n");
+        LOG_ERROR("ev=invalid_arguments what=json");
         return -1;
     }
+    if (SensorData_t->summary) {
+        return Sensor_JSON_Summary(SensorData_t, json_buffer, buffer_size);
+    }
     int jsondata = snprintf(json_buffer, buffer_size,
                           "{\n"
                                 "\"sensor_id\": \"%s\",\n"
                                 "\"timestamp\": \"%s\",\n"
-                                "\"temperature\": %.2f\n"
+                                "\"%s\": %.2f\n"
                           "}",
                           SensorData_t->sensor_id ? SensorData_t->sensor_id : "unknown",
                           SensorData_t->timestamp ? SensorData_t->timestamp : "unknown",
-                          SensorData_t->temperature);
+                          SensorData_t->quantity ? SensorData_t->quantity : "temperature",
+                          SensorData_t->value);
     
     if (jsondata >= buffer_size) {
-        printf("JSON buffer too small (%d needed, %d available)\n", jsondata, buffer_size);
+        LOG_ERROR("ev=buffer_too_small what=json needed=%d available=%d", jsondata, buffer_size);
         return -1;
     }
     
-    printf("JSON built: %d characters\n", jsondata);
     return jsondata;
 }
 
-int Save_Sensor_Data_To_File(char* request)
+        // A window of one channel (columns from the channel ring) as a JSON array
+int Sensor_JSON_Window(const char* sensor_id, const char* quantity, const int64_t* timestamps,
+                       const double* values, int count, char* json_buffer, int buffer_size)
+{
+    if (!json_buffer || buffer_size < 3 || count <= 0) {
+        return -1;
+    }
+
+    Sensor_Data_t reading = { .quantity = quantity, .sensor_id = sensor_id };
+    int used = 0;
+    json_buffer[used++] = '[';
+
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0) {
+            if (used + 1 >= buffer_size) return -1;
+            json_buffer[used++] = ',';
+        }
+        reading.value = values[i];
+        reading.epoch = (time_t)(timestamps[i] / 1000);
+        reading.timestamp = Format_Timestamp(reading.epoch);
+
+        // Leave room for the closing bracket
+        int length = Sensor_JSON(&reading, json_buffer + used, buffer_size - used - 1);
+        if (length < 0) return -1;
+        used += length;
+    }
+
+    json_buffer[used++] = ']';
+    json_buffer[used] = '\0';
+    return used;
+}
+
+int Save_Sensor_Data_To_File(store_t* store, const char* data, int length, uint16_t type)
 {    
-    FILE *file = fopen("bin/saved_temp.txt", "a");
-    
-    if (file == NULL) {
-        printf("DEBUG: Failed to open file!\n");
+    if (!store || !data) {
+        return -1;
+    }
+
+    if (Store_Append(store, data, length, type) < 0) {
+        LOG_ERROR("ev=backlog_append_failed");
         return -1;
     }
-        
-    fprintf(file, "%s\n", request);    
-    fclose(file);
     
     return 0;
 }
 
 
-        // 0 = success, 1 = no data to send
-int Send_Saved_Sensor_Data(char* buffer)
+        // Reads the next saved JSON object into buffer. Returns its length,
+        // 0 at end of file or -1 for an object that does not fit (it is skipped).
+static int Next_Saved_Object(FILE* file, char* buffer, int buffer_size)
 {
-    FILE *file = fopen("bin/saved_temp.txt", "r");
-    if (file == NULL) {
-        printf("No saved sensor data to send.\n");
-        return 1; 
-    }
-    
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    if (size == 0) {
-       // printf("\"bin/saved_temp\" file is empty\n");
-        fclose(file);
-        return 1;  // Empty file
-    }
-    
-    fseek(file, 0, SEEK_SET);
-    
     char line[256];
-    
-    if (fgets(line, sizeof(line), file) && line[0] == '{') {
-        strcpy(buffer, line);
-        
-        do {
-            if (!fgets(line, sizeof(line), file)) {
-                break;
-            }
-            strcat(buffer, line);
-        } while (line[0] != '}');
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] != '{') continue;
+
+        int used = snprintf(buffer, buffer_size, "%s", line);
+        while (line[0] != '}' && used < buffer_size && fgets(line, sizeof(line), file)) {
+            used += snprintf(buffer + used, buffer_size - used, "%s", line);
+        }
 
         char* brace_pos = strchr(buffer, '}');
-        if (brace_pos) {
-            *(brace_pos + 1) = '\0';
+        if (used >= buffer_size || !brace_pos) {
+            return -1;
         }
-        
-        fclose(file);
-        printf("📋 Retrieved JSON object from file\n");
-        return 0; 
+        *(brace_pos + 1) = '\0';
+        return (int)(brace_pos + 1 - buffer);
     }
-    
-    fclose(file);
-    return 1; 
+    return 0;
 }
 
-
-        
-int Read_Complete_Saved_File(char** buffer, size_t* file_size)                  //NOT USED YET 
+        // Moves readings from the old text backlog into the ring store, once
+int Import_Saved_Text_File(store_t* store, const char* path)
 {
-    if (!buffer) {
-        printf("Invalid buffer pointer provided.\n");
-        return -1;
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
     }
-    
-    *buffer = NULL;  // Initialize to NULL
-    if (file_size) *file_size = 0;
-    
-    FILE *file = fopen("bin/saved_temp.txt", "r");
-    if (!file) {
-        printf("No saved sensor data file found.\n");
-        return 1;
+
+    char object[512];
+    int object_len;
+    int imported = 0;
+
+    while ((object_len = Next_Saved_Object(file, object, sizeof(object))) != 0)
+    {
+        if (object_len > 0 && Store_Append(store, object, object_len, STORE_TYPE_JSON) == 0) {
+            imported++;
+        }
     }
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    if (size <= 0) {
-        printf("Saved data file is empty or invalid.\n");
-        fclose(file);
-        return 1; 
+    fclose(file);
+
+    // On disk before the old file goes - it is not imported again
+    if (imported > 0 && Store_Commit(store) < 0) {
+        return -1;
     }
-    
-    // Allocate buffer for entire file content + null terminator
-    *buffer = malloc(size + 1);
-    if (!*buffer) {
-        printf("Failed to allocate memory for file content (%ld bytes).\n", size);
-        fclose(file);
-        return -1; 
+
+    // Keep the old file around under a new name so it is never imported twice
+    char done_path[256];
+    snprintf(done_path, sizeof(done_path), "%s.imported", path);
+    if (rename(path, done_path) != 0) {
+        LOG_ERROR("ev=import_rename_failed path=%s", path);
+        return -1;
     }
-    
-    // Read entire file in one operation
-    size_t bytes_read = fread(*buffer, 1, size, file);
-    (*buffer)[bytes_read] = '\0';  // Null terminate
-    
-    fclose(file);
-    
-    if (file_size) *file_size = bytes_read;
-    printf("📋 Read complete file: %zu bytes\n", bytes_read);
-    
-    return 0;  // Success
+
+    LOG_INFO("ev=imported records=%d path=%s", imported, path);
+    return imported;
 }
 
-int Remove_Sent_Object_From_File(const char* sent_object)
+        // Packs binary frames starting at the cursor into one delta-encoded batch frame in scratch.
+        // Returns the records consumed.
+static int Read_Frame_Batch(const record_cursor_t* cursor, http_body_t* body, char* scratch, int body_size, int max_records)
 {
-    FILE *file = fopen("bin/saved_temp.txt", "r");
-    FILE *temp = fopen("bin/temp_backup.txt", "w");
-    
-    if (!file || !temp) {
-        if (file) fclose(file);
-        if (temp) fclose(temp);
-        return -1;
-    }
-    
-    char buffer[512];
-    char line[256];
-    int objects_kept = 0;
-    
-    // Copy all objects except the sent one to temp file
-    while (fgets(line, sizeof(line), file)) {
-        if (line[0] == '{') {
-            strcpy(buffer, line);
-            
-            do {
-                if (!fgets(line, sizeof(line), file)) break;
-                strcat(buffer, line);
-            } while (line[0] != '}');
-            
-            char* brace_pos = strchr(buffer, '}');
-            if (brace_pos) {
-                *(brace_pos + 1) = '\0';
-            }
-            
-            // If this object doesn't match the sent one, keep it
-            if (strcmp(buffer, sent_object) != 0) {
-                fprintf(temp, "%s\n", buffer);
-                objects_kept++;
-            }
+    frame_batch_t batch;
+    store_view_t view;
+    int consumed = 0;
+    int rc;
+
+    Frame_Batch_Begin(&batch, scratch, body_size);
+
+    while (batch.count < max_records && (rc = cursor->peek(cursor->source, &view)) != 0)
+    {
+        if (rc > 0 && view.type != STORE_TYPE_FRAME) break;
+
+        // Window summaries do not delta-encode - one goes out as its own body, as stored
+        if (rc > 0 && Frame_Kind(view.data, view.length) == FRAME_KIND_SUMMARY)
+        {
+            if (batch.count > 0 || consumed > 0) break;
+            Http_Body_Add(body, view.data, view.length);
+            cursor->advance(cursor->source);
+            return 1;
         }
+
+        int added = rc > 0 ? Frame_Batch_Add(&batch, view.data, view.length) : -2;
+        if (added == -1) break;     // Full or another sensor - starts the next batch
+
+        if (added == -2) {
+            LOG_WARN("ev=backlog_corrupt action=skip");
+        }
+        cursor->advance(cursor->source);
+        consumed++;
     }
-    
-    fclose(file);
-    fclose(temp);
-    
-    // Replace original with temp file
-    if (rename("bin/temp_backup.txt", "bin/saved_temp.txt") == 0) {
-        printf("Removed sent object from file (%d objects remaining)\n", objects_kept);
-        return 0;
-    } else {
-        printf("❌ Failed to update saved data file\n");
-        return -1;
+
+    int length = Frame_Batch_End(&batch);
+    if (length > 0) {
+        Http_Body_Add(body, scratch, length);
     }
+    return consumed;
 }
 
-void Sensor_Free(Sensor_Data_t* SensorData_t)
+        // Packs JSON records starting at the cursor into a JSON array - one of them too, so a
+        // drain keeps one schema whatever the batch size. Parts point straight into the mapped
+        // store; a body that got no record stays empty. Returns the records consumed.
+static int Read_Json_Batch(const record_cursor_t* cursor, http_body_t* body, int body_size, int max_records)
 {
-    if (SensorData_t) {
-        // No need to free timestamp - it's now a static buffer
-        free(SensorData_t);
-        printf("🗑️  Sensor data memory freed\n");
+    static const char open_bracket[] = "[";
+    static const char separator[] = ",";
+    static const char close_bracket[] = "]";
+
+    int records = 0;
+    int consumed = 0;
+    store_view_t view;
+    int rc;
+
+    while (records < max_records && (rc = cursor->peek(cursor->source, &view)) != 0)
+    {
+        if (rc < 0) {
+            LOG_WARN("ev=backlog_corrupt action=skip");
+            cursor->advance(cursor->source);
+            consumed++;
+            continue;
+        }
+        if (view.type != STORE_TYPE_JSON) break;
+
+        // Opening bracket or separator, and the closing bracket, must fit as well
+        size_t needed = view.length + 2;
+        if (body->length + needed > (size_t)body_size && records > 0) {
+            break;      // Starts the next batch
+        }
+
+        Http_Body_Add(body, records > 0 ? separator : open_bracket, 1);
+        Http_Body_Add(body, view.data, view.length);
+        cursor->advance(cursor->source);
+        records++;
+        consumed++;
     }
+
+    if (records > 0) Http_Body_Add(body, close_bracket, 1);
+    return consumed;
 }
 
-double Random_Temperature_Sensor(void)
+        // Builds up to max_batches request bodies from the records at cursor, each at most body_size
+        // bytes and max_records records. A batch holds records of one encoding: JSON records are
+        // sent in place from where they are kept, binary frames are delta-encoded into scratch[i].
+        // record_counts[i] gets the records consumed by bodies[i] (including corrupt ones) for the
+        // ack once the server took them. Records that make no body (corrupt or of unknown type)
+        // count with the next body, or the last one. If there is no body at all, a single empty
+        // one (count 0) carries them: nothing to send, ack them at once.
+int Read_Record_Batches(const record_cursor_t* cursor, http_body_t* bodies, char** scratch, int max_batches, int body_size, int max_records, int* record_counts)
 {
-    static double base_temperature = 23.0;
-    static int initialized = 0;
+    int batches = 0;
+    int total = 0;
+    int skipped = 0;
+
+    while (batches < max_batches)
+    {
+        http_body_t* body = &bodies[batches];
+        store_view_t view;
+
+        int rc = cursor->peek(cursor->source, &view);
+        if (rc == 0) break;
+
+        uint16_t type = rc > 0 ? view.type : STORE_TYPE_JSON;
+        const encoder_t* encoder = Encoder_For_Store_Type(type);
+        if (!encoder) {
+            LOG_WARN("ev=backlog_unknown_type type=%u action=treat_as_json", type);
+            encoder = Encoder_Get(ENCODING_JSON);
+            type = STORE_TYPE_JSON;
+        }
 
-    if(!initialized) {
-        srand(time(NULL));
-        initialized = 1;
+        Http_Body_Reset(body);
+        body->content_type = encoder->content_type;
+
+        int consumed = (type == STORE_TYPE_FRAME)
+                     ? Read_Frame_Batch(cursor, body, scratch[batches], body_size, max_records)
+                     : Read_Json_Batch(cursor, body, body_size, max_records);
+
+        if (consumed == 0) {
+            // Record of unknown type at the cursor - drop it so the backlog keeps moving
+            cursor->advance(cursor->source);
+            consumed = 1;
+        }
+        total += consumed;
+
+        // Nothing made it into the body - an empty "[]" would still be a POST
+        if (body->count == 0) {
+            skipped += consumed;
+            continue;
+        }
+        record_counts[batches++] = consumed + skipped;
+        skipped = 0;
     }
 
-    double noise = ((double)rand() / RAND_MAX - 0.5) * 1.0;
+    if (skipped > 0 && batches > 0) {
+        record_counts[batches - 1] += skipped;
+    }
+    else if (skipped > 0) {
+        Http_Body_Reset(&bodies[0]);
+        record_counts[batches++] = skipped;
+    }
     
-    double drift = ((double)rand() / RAND_MAX - 0.5) * 0.1;
-    base_temperature += drift;
+    if (total > 0) {
+        LOG_DEBUG("ev=backlog_batches records=%d batches=%d", total, batches);
+    }
+    return batches; 
+}
+
+static int Saved_Peek(void* store, store_view_t* view)
+{
+    return Store_Peek_View(store, view);
+}
+
+static void Saved_Advance(void* store)
+{
+    Store_Advance(store);
+}
 
-    if (base_temperature < -15.0 || base_temperature > 35.0)
-        base_temperature = 23.0;
+        // Read_Record_Batches() over the backlog cursor, acked with Remove_Saved_Objects()
+int Read_Saved_Batches(store_t* store, http_body_t* bodies, char** scratch, int max_batches, int body_size, int max_records, int* record_counts)
+{
+    record_cursor_t cursor = { store, Saved_Peek, Saved_Advance };
+    return Read_Record_Batches(&cursor, bodies, scratch, max_batches, body_size, max_records, record_counts);
+}
+
+        // Drops the oldest count records in one step so an acknowledged batch disappears atomically
+int Remove_Saved_Objects(store_t* store, int count)
+{
+    if (Store_Ack(store, count) < 0) {
+        LOG_ERROR("ev=backlog_ack_failed");
+        return -1;
+    }
 
-    return base_temperature + noise;
+    LOG_INFO("ev=backlog_acked records=%d remaining=%u", count, Store_Count(store));
+    return 0;
 }
 
 char* Get_Current_Timestamp(void)
 {
-    static char timestamp[24]; // Static buffer - no malloc needed
-    time_t now = time(NULL);
+    return Format_Timestamp((time_t)(Clock_Wall_Ms() / 1000));
+}
+
+        // Text is valid until the same thread formats the next one
+char* Format_Timestamp(time_t when)
+{
+    static __thread char timestamp[24]; // Static buffer per thread - no malloc needed
+    struct tm utc_tm;
     
-    struct tm *utc_tm = gmtime(&now);
-    if (!utc_tm) {
+    if (!gmtime_r(&when, &utc_tm)) {
         return NULL;
     }
     
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", utc_tm);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &utc_tm);
     
     return timestamp;
 }
 
+        // Returns the --interval override, or 0 to use measurement_interval from the config file
 int parse_interval(int argc, char **argv) {
-    int interval = 30; 
+    int interval = 0; 
     
     if (argc >= 3 && strcmp(argv[1], "--interval") == 0) {
         int user_interval = atoi(argv[2]);
@@ -287,12 +503,13 @@ int parse_interval(int argc, char **argv) {
             printf("✅ Using interval: %d seconds\n", interval);
         } else {
             printf("❌ Invalid interval %d. Must be between 10-120 seconds\n", user_interval);
-            printf("Using default interval: %d seconds\n", interval);
+            printf("Using measurement_interval from %s\n", CONFIG_FILE);
         }
     } else if (argc == 2 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
-        printf("Usage: %s [--interval <10-120>]\n", argv[0]);
+        printf("Usage: %s [--interval <10-120>] | --bench [readings]\n", argv[0]);
         printf("Example: %s --interval 60\n", argv[0]);
-        printf("Default interval: 30 seconds\n");
+        printf("Default interval: measurement_interval in %s (%d seconds if unset), reloaded on SIGHUP\n",
+               CONFIG_FILE, DEFAULT_MEASUREMENT_INTERVAL);
         exit(0);
     } else if (argc > 1) {
         printf("❌ Unknown arguments. Use --help for usage.\n");
@@ -1,45 +1,734 @@
 #include "../include/smw.h"
+#include <sys/epoll.h>
+#include <errno.h>
+#include <limits.h>
 
-smw_task_t* Create_Smw_Task(void* ctx, void (*cb) (void*, uint64_t))
+#define SMW_MAX_EVENTS 8
+#define SMW_OVERDUE_POLL 16          // Dispatches in a row without waiting before epoll is checked anyway
+
+const char* const sensor_state_names[SENSOR_STATE_COUNT] = {
+    "initialize", "read_sensor", "process_saved_data", "http_transaction", "http_resolving",
+    "http_connecting", "http_sending", "http_receiving", "http_complete", "offline",
+    "save_data", "done", "failed",
+};
+
+static int smw_epoll_fd = -1;
+static int smw_overdue = 0;          // Smw_Wait_Until() calls in a row that found work due already
+
+static smw_task_t smw_tasks[SMW_MAX_TASKS];
+static smw_task_t* smw_heap[SMW_MAX_TASKS];
+static int smw_heap_size = 0;
+
+static wheel_t smw_wheel;            // Timers of all tasks, advanced before every dispatch
+
+int Smw_Init(void)
+{
+    if (smw_epoll_fd >= 0) {
+        return 0;
+    }
+    Wheel_Init(&smw_wheel, Smw_Now_Ms());
+
+    // Blocking point for the main loop - tasks add the sockets they wait on with Smw_Watch_Fd()
+    smw_epoll_fd = epoll_create1(0);
+    if (smw_epoll_fd < 0) {
+        LOG_WARN("ev=epoll_unavailable fallback=clock_nanosleep");
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t Smw_Now_Ms(void)
+{
+    return Clock_Now_Ms();
+}
+
+void Smw_Wait_Until(uint64_t deadline)
+{
+    uint64_t now = Smw_Now_Ms();
+    int overdue = deadline <= now;
+
+    // A task that keeps running again right away must not starve ready sockets: every
+    // SMW_OVERDUE_POLL dispatches epoll is checked anyway, just without waiting. A state
+    // machine stepping through a few states in a row costs no syscall.
+    if (!overdue) {
+        smw_overdue = 0;
+    }
+    else if (++smw_overdue < SMW_OVERDUE_POLL || smw_epoll_fd < 0) {
+        return;
+    }
+    else {
+        smw_overdue = 0;
+    }
+
+    uint64_t wait_ms = overdue ? 0 : deadline - now;
+    if (wait_ms > INT_MAX) {
+        wait_ms = INT_MAX;
+    }
+
+    // Virtual time: handle whatever is ready now, otherwise jump to the deadline. Only when
+    // every task waits for I/O alone is there real time to wait (a background lookup).
+    int virtual_time = Clock_Is_Virtual();
+    if (virtual_time) {
+        wait_ms = deadline == UINT64_MAX ? SMW_POLL_MS : 0;
+    }
+
+    if (smw_epoll_fd >= 0) {
+        struct epoll_event events[SMW_MAX_EVENTS];
+        // Returns early on I/O events or signals, the caller just re-checks deadlines
+        int ready = epoll_wait(smw_epoll_fd, events, SMW_MAX_EVENTS, (int)wait_ms);
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("ev=epoll_wait_failed errno=%d", errno);
+        }
+
+        // A ready socket makes its task due right away
+        now = Smw_Now_Ms();
+        for (int i = 0; i < ready; i++)
+        {
+            smw_task_t* task = events[i].data.ptr;
+            if (task && task->active && task->next_run > now) {
+                Reschedule_Smw_Task(task, now);
+            }
+        }
+        if (virtual_time && ready == 0 && !overdue && deadline != UINT64_MAX) {
+            Clock_Advance(deadline * 1000);
+        }
+        return;
+    }
+    if (virtual_time && deadline != UINT64_MAX) {
+        Clock_Advance(deadline * 1000);
+        return;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = wait_ms / 1000;
+    ts.tv_nsec = (wait_ms % 1000) * 1000000;
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
+
+        // Wakes task when fd becomes ready for events (EPOLLIN/EPOLLOUT), replacing any
+        // earlier interest in fd. Returns -1 without epoll - the task then has to poll.
+int Smw_Watch_Fd(smw_task_t* task, int fd, uint32_t events)
+{
+    if (smw_epoll_fd < 0 || !task || fd < 0) {
+        return -1;
+    }
+
+    struct epoll_event ev = {0};
+    ev.events = events;
+    ev.data.ptr = task;
+
+    if (epoll_ctl(smw_epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+        return 0;
+    }
+    if (errno == ENOENT && epoll_ctl(smw_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+        return 0;
+    }
+    LOG_ERROR("ev=epoll_ctl_failed fd=%d errno=%d", fd, errno);
+    return -1;
+}
+
+        // An idle kept-alive socket must not stay registered - a FIN would wake the loop forever
+void Smw_Unwatch_Fd(int fd)
+{
+    if (smw_epoll_fd >= 0 && fd >= 0) {
+        epoll_ctl(smw_epoll_fd, EPOLL_CTL_DEL, fd, NULL);   // Already gone if the socket was closed
+    }
+}
+
+/* ---- Task registry: fixed table + min-heap on next_run ---- */
+
+static int Smw_Before(const smw_task_t* a, const smw_task_t* b)
+{
+    if (a->next_run != b->next_run) {
+        return a->next_run < b->next_run;
+    }
+    return a->priority < b->priority;
+}
+
+static void Smw_Heap_Swap(int i, int j)
+{
+    smw_task_t* tmp = smw_heap[i];
+    smw_heap[i] = smw_heap[j];
+    smw_heap[j] = tmp;
+    smw_heap[i]->heap_index = i;
+    smw_heap[j]->heap_index = j;
+}
+
+static void Smw_Heap_Up(int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!Smw_Before(smw_heap[i], smw_heap[parent])) break;
+        Smw_Heap_Swap(i, parent);
+        i = parent;
+    }
+}
+
+static void Smw_Heap_Down(int i)
+{
+    while (1) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int smallest = i;
+
+        if (left < smw_heap_size && Smw_Before(smw_heap[left], smw_heap[smallest])) smallest = left;
+        if (right < smw_heap_size && Smw_Before(smw_heap[right], smw_heap[smallest])) smallest = right;
+        if (smallest == i) break;
+
+        Smw_Heap_Swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void Smw_Heap_Push(smw_task_t* task)
 {
-    smw_task_t* task = malloc(sizeof(smw_task_t));
-    if (!task) return NULL;
+    task->heap_index = smw_heap_size;
+    smw_heap[smw_heap_size++] = task;
+    Smw_Heap_Up(task->heap_index);
+}
 
-    task->context = ctx;
-    task->callback = cb;
-    task->active = 1;
+static void Smw_Heap_Remove(smw_task_t* task)
+{
+    int i = task->heap_index;
+    if (i < 0) return;
 
-    return task;
+    smw_heap_size--;
+    if (i != smw_heap_size) {
+        smw_heap[i] = smw_heap[smw_heap_size];
+        smw_heap[i]->heap_index = i;
+        Smw_Heap_Up(i);
+        Smw_Heap_Down(smw_heap[i]->heap_index);
+    }
+    task->heap_index = -1;
 }
 
-void Execute_Smw_Task(smw_task_t* task, uint64_t timestamp)
+uint64_t Smw_Next_Deadline(void)
 {
-    if (!task || !task->active || !task->callback) 
+    uint64_t next = Wheel_Next(&smw_wheel);
+    if (smw_heap_size > 0 && smw_heap[0]->next_run < next) {
+        next = smw_heap[0]->next_run;
+    }
+    return next;
+}
+
+/* ---- Timers: one wheel for every task, see wheel.h ---- */
+
+        // O(1). A deadline already passed fires on the next dispatch.
+void Smw_Timer_Arm(wheel_timer_t* timer, uint64_t deadline)
+{
+    Wheel_Arm(&smw_wheel, timer, deadline);
+}
+
+void Smw_Timer_Cancel(wheel_timer_t* timer)
+{
+    Wheel_Cancel(&smw_wheel, timer);
+}
+
+        // Fire callback for timers whose context is a task: it runs in this dispatch. The task
+        // sees timer->fired and can sleep with UINT64_MAX instead of working out deadlines.
+void Smw_Timer_Wake(wheel_timer_t* timer, uint64_t monTime)
+{
+    Reschedule_Smw_Task(timer->context, monTime);
+}
+
+smw_task_t* Create_Smw_Task(void* ctx, uint64_t (*cb) (void*, uint64_t), int priority)
+{
+    if (!cb) return NULL;
+
+    for (int i = 0; i < SMW_MAX_TASKS; i++)
+    {
+        smw_task_t* task = &smw_tasks[i];
+        if (task->active) continue;
+
+        task->context = ctx;
+        task->callback = cb;
+        task->active = 1;
+        task->next_run = 0;     // Run on the first dispatch
+        task->priority = priority;
+        task->heap_index = -1;
+        Smw_Heap_Push(task);
+
+        return task;
+    }
+
+    LOG_ERROR("ev=task_table_full max=%d", SMW_MAX_TASKS);
+    return NULL;
+}
+
+void Reschedule_Smw_Task(smw_task_t* task, uint64_t next_run)
+{
+    if (!task || !task->active || task->heap_index < 0) 
     return;
 
-    task->callback(task->context, timestamp);
+    uint64_t old = task->next_run;
+    task->next_run = next_run;
+    if (next_run < old) {
+        Smw_Heap_Up(task->heap_index);
+    } else {
+        Smw_Heap_Down(task->heap_index);
+    }
+}
+
+        // Fires the timers due by monTime, then runs every task that is due once.
+        // Returns how many tasks ran.
+int Execute_Smw_Task(uint64_t monTime)
+{
+    smw_task_t* due[SMW_MAX_TASKS];
+    int count = 0;
+
+    Wheel_Advance(&smw_wheel, monTime);
+
+    // Pop everything due first so a task that asks to run again "now" waits for the next dispatch
+    while (smw_heap_size > 0 && smw_heap[0]->next_run <= monTime)
+    {
+        due[count++] = smw_heap[0];
+        Smw_Heap_Remove(smw_heap[0]);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        smw_task_t* task = due[i];
+        if (!task->active) continue;    // Freed by an earlier task in this dispatch
+
+        task->next_run = task->callback(task->context, monTime);
+
+        // The callback may have freed its own task
+        if (task->active) {
+            Smw_Heap_Push(task);
+        }
+    }
+
+    return count;
 }
 
 void Free_Smw_Task(smw_task_t* task)
 {
-    if (task)
+    if (task && task->active)
     {
         //printf("Freeing Task resources\n");
-        free(task);
+        Smw_Heap_Remove(task);
+        task->active = 0;
+        task->callback = NULL;
+        task->context = NULL;
+    }
+}
+
+        // How often the task samples: once per interval for raw posts, faster when aggregating
+static uint64_t Sensor_Sample_Period(const task_context_t* ctx)
+{
+    if (ctx->aggregation == AGGREGATE_RAW || ctx->sample_interval_ms <= 0) {
+        return (uint64_t)ctx->measurement_interval * 1000;
+    }
+    return (uint64_t)ctx->sample_interval_ms;
+}
+
+        // Takes the measurement slot at monTime and arms the next one
+static void Sensor_Read_Taken(task_context_t* ctx, uint64_t monTime)
+{
+    ctx->last_read_time = monTime;
+    Smw_Timer_Arm(&ctx->read_timer, monTime + Sensor_Sample_Period(ctx));
+}
+
+        // Idle until one of the task's timers fires - unless a reading is due already
+static uint64_t Sensor_Sleep(const task_context_t* ctx, uint64_t monTime)
+{
+    return ctx->read_timer.fired ? monTime : UINT64_MAX;
+}
+
+        // Each HTTP phase gets connection_timeout from now
+static void Sensor_Phase_Start(task_context_t* ctx, uint64_t monTime)
+{
+    Smw_Timer_Arm(&ctx->phase_timer, monTime + ctx->phase_timeout_ms);
+}
+
+static void Sensor_Save_Fired(wheel_timer_t* timer, uint64_t monTime)
+{
+    task_context_t* ctx = timer->context;
+    Store_Sync(&ctx->backlog);
+    ctx->last_save_time = monTime;
+}
+
+        // Acks only move the backlog head, and losing the newest ones in a crash just sends a
+        // few records twice - so the head is written at most once per SAVE_THROTTLE_MS
+static void Sensor_Save_Position(task_context_t* ctx, uint64_t monTime)
+{
+    if (monTime - ctx->last_save_time >= SAVE_THROTTLE_MS) {
+        Sensor_Save_Fired(&ctx->save_timer, monTime);
+    }
+    else if (!Wheel_Armed(&ctx->save_timer)) {
+        Smw_Timer_Arm(&ctx->save_timer, ctx->last_save_time + SAVE_THROTTLE_MS);
+    }
+}
+
+static void Sensor_Commit_Fired(wheel_timer_t* timer, uint64_t monTime)
+{
+    task_context_t* ctx = timer->context;
+    Store_Commit_Due(&ctx->backlog, monTime);
+}
+
+        // Readings that could not be sent wait in the backlog's cache until their group is
+        // large enough (the store commits it) or old enough (this timer does)
+static void Sensor_Commit_Arm(task_context_t* ctx)
+{
+    uint64_t deadline = Store_Commit_Deadline(&ctx->backlog);
+    if (deadline != UINT64_MAX && ctx->commit_timer.fire &&
+        (!Wheel_Armed(&ctx->commit_timer) || ctx->commit_timer.deadline != deadline))
+    {
+        Smw_Timer_Arm(&ctx->commit_timer, deadline);
+    }
+}
+
+        // Online, a partial backlog batch waits up to batch_flush_ms for more records to share
+        // its POST. Returns 1 while it should wait.
+static int Sensor_Batch_Waiting(task_context_t* ctx, uint64_t monTime)
+{
+    uint32_t pending = Store_Count(&ctx->backlog) + (ctx->queue ? Spsc_Unread(ctx->queue) : 0);
+
+    if (ctx->batch_flush_ms <= 0 || ctx->flush_timer.fired || ctx->retry.state != BREAKER_CLOSED ||
+        pending >= (uint32_t)ctx->batch_limit_records)
+    {
+        return 0;
+    }
+    if (!Wheel_Armed(&ctx->flush_timer)) {
+        Smw_Timer_Arm(&ctx->flush_timer, monTime + ctx->batch_flush_ms);
+    }
+    return 1;
+}
+
+        // Batches not taken by the server are offered again, from wherever they were read
+static void Sensor_Rewind_Batches(task_context_t* ctx)
+{
+    Store_Rewind(&ctx->backlog);
+    if (ctx->queue) {
+        Spsc_Rewind(ctx->queue);
+    }
+    ctx->batch_count = 0;
+    ctx->batch_queued = 0;
+}
+
+static void Sensor_Init_Timers(task_context_t* ctx)
+{
+    Wheel_Timer_Init(&ctx->read_timer, Smw_Timer_Wake, ctx->task);
+    Wheel_Timer_Init(&ctx->phase_timer, Smw_Timer_Wake, ctx->task);
+    Wheel_Timer_Init(&ctx->retry_timer, Smw_Timer_Wake, ctx->task);
+    Wheel_Timer_Init(&ctx->flush_timer, Smw_Timer_Wake, ctx->task);
+    Wheel_Timer_Init(&ctx->save_timer, Sensor_Save_Fired, ctx);
+    Wheel_Timer_Init(&ctx->commit_timer, Sensor_Commit_Fired, ctx);
+}
+
+        // Takes over a config snapshot. Runs between cycles only: no upload is in flight, and the
+        // ring, aggregation windows and backlog carry over unchanged.
+static void Sensor_Apply_Config(task_context_t* ctx, const config_t* config)
+{
+    ctx->measurement_interval = ctx->interval_override ? ctx->interval_override : config->measurement_interval;
+    ctx->phase_timeout_ms = config->connection_timeout * 1000;
+    ctx->encoder = Encoder_Get(config->payload_encoding);
+    ctx->sample_interval_ms = config->sample_interval_ms;
+    ctx->deadband = config->deadband;
+    ctx->aggregator.deadband = config->deadband;
+    ctx->batch_flush_ms = config->batch_flush_ms;
+    ctx->batch_limit_records = ctx->batch_max_records;    // A reload may have moved the server - try full batches again
+    Store_Set_Commit(&ctx->backlog, (uint32_t)config->commit_records, (uint32_t)config->commit_ms, config->durability);
+
+    if (ctx->aggregation != config->aggregation)
+    {
+        // A half-built window of the old mode would mean nothing in the new one
+        ctx->aggregation = config->aggregation;
+        ctx->aggregator.mode = config->aggregation;
+        Aggregator_Reset_Windows(&ctx->aggregator, Smw_Now_Ms());
+    }
+    Sensor_Configure_Channels(&ctx->channels, config->device_id, config->temperature_min, config->temperature_max);
+
+    // Server moved - drop the old keep-alive socket and the headers naming the old host
+    if (ctx->conn && (ctx->conn->port != config->server_port || strcmp(ctx->conn->hostname, config->server_host) != 0))
+    {
+        LOG_INFO("ev=server_changed host=%s port=%d", config->server_host, config->server_port);
+        Tcp_Pool_Release(ctx->conn);
+        Http_Template_Reset();
+        ctx->conn = NULL;
+    }
+
+    // A new interval counts from the last reading - the sampler thread's, in threaded mode
+    if (ctx->pipeline) {
+        Pipeline_Set_Period(ctx->pipeline, ctx->measurement_interval * 1000);
+    }
+    else if (!ctx->read_timer.fired) {
+        Smw_Timer_Arm(&ctx->read_timer, ctx->last_read_time + Sensor_Sample_Period(ctx));
+    }
+
+    ctx->config_generation = config->generation;
+    LOG_INFO("ev=config_applied generation=%lu device=%s interval_s=%d server=%s:%d encoding=%s aggregation=%s",
+             config->generation, config->device_id, ctx->measurement_interval, config->server_host,
+             config->server_port, ctx->encoder->name, Aggregation_Name(ctx->aggregation));
+}
+
+        // Runs the payload encoder and records how long it took
+static int Sensor_Encode(const task_context_t* ctx, const Sensor_Data_t* data, char* out, int size)
+{
+    uint64_t started = Metrics_Now_Us();
+    int length = ctx->encoder->encode(data, out, size);
+    Metrics_Time(METRIC_ENCODE, Metrics_Now_Us() - started);
+    return length;
+}
+
+        // Encodes one channel's latest sample into the backlog
+static int Sensor_Queue_Channel(task_context_t* ctx, int channel)
+{
+    char payload[BUFFER_JSON_SIZE];
+
+    Sensor_Data_t* data = Sensor_Read(&ctx->arena, &ctx->channels, channel);
+    int length = data ? Sensor_Encode(ctx, data, payload, sizeof(payload)) : -1;
+    if (length <= 0 || Save_Sensor_Data_To_File(&ctx->backlog, payload, length, ctx->encoder->store_type) < 0) {
+        return -1;
+    }
+    ctx->backlog_empty = 0;
+    return 0;
+}
+
+        // Encodes one channel's window summary into the backlog
+static int Sensor_Queue_Summary(task_context_t* ctx, int channel)
+{
+    char payload[BUFFER_JSON_SIZE];
+
+    Sensor_Data_t* data = Sensor_Summary(&ctx->arena, &ctx->channels, channel, &ctx->aggregator.windows[channel]);
+    int length = data ? Sensor_Encode(ctx, data, payload, sizeof(payload)) : -1;
+    if (length <= 0 || Save_Sensor_Data_To_File(&ctx->backlog, payload, length, ctx->encoder->store_type) < 0) {
+        return -1;
+    }
+    ctx->backlog_empty = 0;
+    return 0;
+}
+
+        // Samples every channel in one pass over the ring, then lets the aggregation mode decide
+        // what leaves the node. Secondary channels go to the backlog and leave with the next
+        // batched drain; the primary channel's reading or summary is returned for a fresh
+        // upload. NULL means nothing to post this time.
+static Sensor_Data_t* Sensor_Take_Sample(task_context_t* ctx, uint64_t monTime)
+{
+    Sensor_Data_t* primary = NULL;
+
+    if (ctx->aggregation == AGGREGATE_RAW) LOG_DEBUG("ev=sensor_read");
+    Arena_Reset(&ctx->arena, ctx->cycle_mark);
+    if (Channel_Sample_All(&ctx->channels, Clock_Wall_Ms()) < 0) {
+        return NULL;
+    }
+    int latest = (int)Channel_Pending(&ctx->channels) - 1;
+
+    switch (ctx->aggregation)
+    {
+        case AGGREGATE_RAW:
+            for (int c = 1; c < ctx->channels.count; c++) {
+                Sensor_Queue_Channel(ctx, c);
+            }
+            primary = Sensor_Read(&ctx->arena, &ctx->channels, 0);
+        break;
+
+        case AGGREGATE_WINDOW:
+            // Streaming min/max/mean/stddev - the samples themselves are not kept
+            Aggregator_Add_Rows(&ctx->aggregator, &ctx->channels);
+            if (monTime - ctx->aggregator.window_start >= (uint64_t)ctx->measurement_interval * 1000)
+            {
+                LOG_DEBUG("ev=window_closed samples=%u", ctx->aggregator.windows[0].count);
+                for (int c = 1; c < ctx->channels.count; c++) {
+                    Sensor_Queue_Summary(ctx, c);
+                }
+                ctx->closed_window = ctx->aggregator.windows[0];
+                primary = Sensor_Summary(&ctx->arena, &ctx->channels, 0, &ctx->closed_window);
+                Aggregator_Reset_Windows(&ctx->aggregator, monTime);
+            }
+        break;
+
+        case AGGREGATE_DEADBAND:
+            // A flat channel still reports once per measurement interval
+            for (int c = 0; c < ctx->channels.count; c++)
+            {
+                const int64_t* timestamps;
+                const double* values;
+                if (Channel_Window(&ctx->channels, c, latest, 1, &timestamps, &values) != 1 ||
+                    !Aggregator_Deadband(&ctx->aggregator, c, values[0], monTime, (uint64_t)ctx->measurement_interval * 1000))
+                {
+                    continue;
+                }
+                if (c == 0) {
+                    primary = Sensor_Read(&ctx->arena, &ctx->channels, 0);
+                }
+                else {
+                    Sensor_Queue_Channel(ctx, c);
+                }
+            }
+        break;
+    }
+
+    Channel_Consume(&ctx->channels, Channel_Pending(&ctx->channels));
+    return primary;
+}
+
+        // A measurement fell due while an upload is in flight. The payload buffer is busy,
+        // so the primary reading is queued in the backlog too and sampling keeps its cadence.
+static void Sensor_Sample_In_Flight(task_context_t* ctx, uint64_t monTime)
+{
+    char payload[BUFFER_JSON_SIZE];
+
+    Sensor_Read_Taken(ctx, monTime);
+    ctx->sensor_data = Sensor_Take_Sample(ctx, monTime);
+
+    int length = ctx->sensor_data ? Sensor_Encode(ctx, ctx->sensor_data, payload, sizeof(payload)) : -1;
+    if (length > 0 && Save_Sensor_Data_To_File(&ctx->backlog, payload, length, ctx->encoder->store_type) == 0)
+    {
+        LOG_DEBUG("ev=reading_queued reason=upload_in_flight");
+        ctx->backlog_empty = 0;
+    }
+}
+
+static void Sensor_Unwatch_Socket(task_context_t* ctx)
+{
+    for (int i = 0; i < ctx->watch_count; i++) {
+        Smw_Unwatch_Fd(ctx->watch_fds[i]);
+    }
+    ctx->watch_count = 0;
+}
+
+        // Sleeps until a socket is ready or the next connect candidate is due. The phase
+        // and read timers wake the task as well.
+static uint64_t Sensor_Wait_Socket(task_context_t* ctx, uint32_t events, uint64_t monTime)
+{
+    uint64_t wake = UINT64_MAX;
+    if (ctx->conn->connecting && ctx->conn->next_attempt_at) {
+        wake = ctx->conn->next_attempt_at;
+    }
+
+    Sensor_Unwatch_Socket(ctx);
+    int fds[TCP_ADDR_MAX];
+    int count = Tcp_Conn_Wait_Fds(ctx->conn, fds, TCP_ADDR_MAX);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (Smw_Watch_Fd(ctx->task, fds[i], events) < 0)
+        {
+            uint64_t poll = monTime + SMW_POLL_MS;
+            return poll < wake ? poll : wake;
+        }
+        ctx->watch_fds[ctx->watch_count++] = fds[i];
     }
+    return wake;
 }
 
-void Sensor_State_Machine(task_context_t* ctx, uint64_t monTime)
+        // Sleeps until the background lookup ends or the phase timer fires. Polls only when
+        // the resolver has no eventfd or epoll is not available.
+static uint64_t Sensor_Wait_Lookup(task_context_t* ctx, uint64_t monTime)
 {
-    (void)monTime; // Mark as unused to suppress warning
-    
+    int fd = Tcp_Dns_Wake_Fd();
+    if (ctx->watch_count == 1 && ctx->watch_fds[0] == fd) {
+        return UINT64_MAX;
+    }
+
+    Sensor_Unwatch_Socket(ctx);
+    if (fd < 0 || Smw_Watch_Fd(ctx->task, fd, EPOLLIN | EPOLLET) < 0) {
+        return monTime + SMW_POLL_MS;
+    }
+    ctx->watch_fds[ctx->watch_count++] = fd;
+    return UINT64_MAX;
+}
+
+        // A reload was staged - if the task sleeps between cycles, wake it so the snapshot is
+        // applied now instead of after the old interval. Otherwise it waits for the next cycle.
+void Sensor_Config_Staged(void* context)
+{
+    task_context_t* ctx = context;
+    if (ctx->state == STATE_INITIALIZE || (ctx->pipeline && ctx->state == STATE_READ_SENSOR)) {
+        Reschedule_Smw_Task(ctx->task, Smw_Now_Ms());
+    }
+}
+
+        // Records were put on ctx->queue from the main loop (gateway mode). A task asleep
+        // because there was nothing to send starts draining; a busy one finds them anyway.
+void Sensor_Records_Queued(void* context)
+{
+    task_context_t* ctx = context;
+    Sensor_Commit_Arm(ctx);    // Spilled readings may have started a group
+    if (!ctx->backlog_empty) return;
+
+    ctx->backlog_empty = 0;
+    if (ctx->state == STATE_INITIALIZE || ctx->state == STATE_READ_SENSOR) {
+        Reschedule_Smw_Task(ctx->task, Smw_Now_Ms());
+    }
+}
+
+uint64_t Sensor_State_Machine(task_context_t* ctx, uint64_t monTime)
+{
+    uint64_t next_run = monTime;    // Default: step again on the next dispatch
+    task_state_t entered_state = ctx->state;
+
+    if (ctx->state >= STATE_HTTP_RESOLVING && ctx->state <= STATE_HTTP_RECEIVING && ctx->read_timer.fired)
+    {
+        Sensor_Sample_In_Flight(ctx, monTime);
+    }
 
 
     switch(ctx->state)
     {
         case STATE_INITIALIZE:
 
+            if (!ctx->read_timer.fire) {
+                Sensor_Init_Timers(ctx);
+            }
+
+            // The arena is the only heap allocation of the task. Backlog body part lists
+            // ("[", record, ",", record, ..., "]") and batch scratch are carved once and
+            // stay below cycle_mark; everything after it is dropped when a cycle ends.
+            if (!ctx->arena.base)
+            {
+                if (Arena_Init(&ctx->arena, TASK_ARENA_SIZE(ctx->batch_max_records, ctx->batch_max_bytes)) < 0)
+                {
+                    ctx->state = STATE_FAILED;
+                    ctx->result_code = -1;
+                    break;
+                }
+                for (int i = 0; i < HTTP_PIPELINE_DEPTH; i++)
+                {
+                    ctx->batch_bodies[i].capacity = 2 * ctx->batch_max_records + 1;
+                    ctx->batch_bodies[i].parts = Arena_Alloc(&ctx->arena, ctx->batch_bodies[i].capacity * sizeof(struct iovec));
+                    ctx->batch_scratch[i] = Arena_Alloc(&ctx->arena, ctx->batch_max_bytes);
+                    if (!ctx->batch_bodies[i].parts || !ctx->batch_scratch[i])
+                    {
+                        ctx->state = STATE_FAILED;
+                        ctx->result_code = -1;
+                        break;
+                    }
+                }
+                if (ctx->state == STATE_FAILED)
+                {
+                    break;
+                }
+                if (Channel_Set_Init(&ctx->channels, &ctx->arena, CHANNEL_DEFAULT_MAX, CHANNEL_ROWS) < 0 ||
+                    Sensor_Register_Channels(&ctx->channels) < 0 ||
+                    Aggregator_Init(&ctx->aggregator, &ctx->arena, CHANNEL_DEFAULT_MAX, ctx->aggregation, ctx->deadband, monTime) < 0)
+                {
+                    ctx->state = STATE_FAILED;
+                    ctx->result_code = -1;
+                    break;
+                }
+                Channel_Seed(&ctx->channels, ctx->seed);
+                Channel_Set_Source(&ctx->channels, ctx->source);
+
+                // Edge-triggered: a wakeup that arrives while the task is busy needs no read
+                if (ctx->pipeline) {
+                    Smw_Watch_Fd(ctx->task, Pipeline_Wake_Fd(ctx->pipeline), EPOLLIN | EPOLLET);
+                }
+                ctx->cycle_mark = Arena_Mark(&ctx->arena);
+                ctx->cycle_heap_calls = Heap_Calls();
+                Sensor_Apply_Config(ctx, Config_Current());
+            }
+            else
+            {
+                // Between cycles: a reload staged since the last one takes effect here
+                const config_t* config = Config_Apply();
+                if (config) {
+                    Sensor_Apply_Config(ctx, config);
+                }
+            }
 
+            ctx->cycle_started_us = Metrics_Now_Us();
             if (Sensor_Init() == 0)
             {
                 ctx->state = STATE_READ_SENSOR;
@@ -53,21 +742,40 @@ void Sensor_State_Machine(task_context_t* ctx, uint64_t monTime)
         
         case STATE_READ_SENSOR:
         
+            // Threaded mode never fires the read timer - readings arrive through the pipeline
+            if (ctx->pipeline && Pipeline_Woken(ctx->pipeline))
+            {
+                ctx->backlog_empty = 0;
+            }
 
-            struct timespec current_time;
-            clock_gettime(CLOCK_MONOTONIC, &current_time);
-            uint64_t current_ms = (current_time.tv_sec * 1000) + (current_time.tv_nsec / 1000000);
-            uint64_t elapsed = current_ms - ctx->last_read_time;
-            
-            if (elapsed >= (uint64_t)ctx->measurement_interval * 1000)
+            if (ctx->read_timer.fired)
             {
 
-                ctx->last_read_time = current_ms;
-                ctx->sensor_data = Sensor_Read();
-                int json_len = Sensor_JSON(ctx->sensor_data, ctx->json_buffer, sizeof(ctx->json_buffer));
+                Sensor_Read_Taken(ctx, monTime);
 
-                if (json_len > 0)
+                // The previous reading was sent or saved already - its memory can be reused
+                ctx->sensor_data = Sensor_Take_Sample(ctx, monTime);
+                if (!ctx->sensor_data && ctx->aggregation != AGGREGATE_RAW)
                 {
+                    // Folded into the window or inside the deadband - nothing to post yet
+                    break;
+                }
+                ctx->backlog_empty = 0;
+                ctx->payload_length = ctx->sensor_data
+                                    ? Sensor_Encode(ctx, ctx->sensor_data, ctx->payload_buffer, sizeof(ctx->payload_buffer))
+                                    : -1;
+
+                if (ctx->payload_length > 0 && !Retry_Allow(&ctx->retry, monTime))
+                {
+                    // Backing off (or told to wait by the server) - keep the reading instead of sending it
+                    LOG_INFO("ev=upload_held wait_s=%llu breaker=%s",
+                             (unsigned long long)(Retry_Next_Attempt(&ctx->retry) - monTime + 999) / 1000,
+                             Retry_State_Name(ctx->retry.state));
+                    ctx->state = STATE_SAVE_DATA;
+                }
+                else if (ctx->payload_length > 0)
+                {
+                    LOG_DEBUG("ev=payload_built bytes=%d encoding=%s", ctx->payload_length, ctx->encoder->name);
                     ctx->state = STATE_HTTP_TRANSACTION;
                 }
                 else
@@ -76,6 +784,26 @@ void Sensor_State_Machine(task_context_t* ctx, uint64_t monTime)
                         ctx->result_code = -2;
                 }
             }
+            else if (ctx->backlog_empty)
+            {
+                // Nothing saved and no measurement due - the read timer (or the encoder) wakes the task
+                if (!ctx->pipeline || Pipeline_Idle(ctx->pipeline)) {
+                    next_run = UINT64_MAX;
+                }
+                else {
+                    ctx->backlog_empty = 0;
+                }
+            }
+            else if (monTime < Retry_Next_Attempt(&ctx->retry))
+            {
+                // Backoff or Retry-After applies to the backlog too
+                Smw_Timer_Arm(&ctx->retry_timer, Retry_Next_Attempt(&ctx->retry));
+                next_run = UINT64_MAX;
+            }
+            else if (Sensor_Batch_Waiting(ctx, monTime))
+            {
+                next_run = UINT64_MAX;
+            }
             else
             {
                 ctx->state = STATE_PROCESS_SAVED_DATA;
@@ -87,73 +815,310 @@ void Sensor_State_Machine(task_context_t* ctx, uint64_t monTime)
         case STATE_PROCESS_SAVED_DATA:
 
 
-            if (Send_Saved_Sensor_Data(ctx->fromfile_buffer) == 0)
-            {
-
-                strcpy(ctx->json_buffer, ctx->fromfile_buffer);
+        {
+            // A half-open breaker probes with a single batch, not a full pipeline
+            int depth = ctx->retry.state == BREAKER_CLOSED ? HTTP_PIPELINE_DEPTH : 1;
 
-                Remove_Sent_Object_From_File(ctx->fromfile_buffer);
-                memset(ctx->fromfile_buffer, 0, sizeof(ctx->fromfile_buffer));
+            // The in-memory queue goes first: freeing its slots is what stops readings spilling to disk
+            ctx->batch_queued = 0;
+            if (ctx->queue)
+            {
+                record_cursor_t queue = Pipeline_Queue_Cursor(ctx->queue);
+                ctx->batch_queued = Read_Record_Batches(&queue, ctx->batch_bodies, ctx->batch_scratch, depth,
+                                                        ctx->batch_max_bytes, ctx->batch_limit_records, ctx->batch_records);
+            }
+            // Only records that were all skipped leave an empty body - acked without a request
+            if (ctx->batch_queued == 1 && ctx->batch_bodies[0].count == 0)
+            {
+                Spsc_Release(ctx->queue, ctx->batch_records[0]);
+                Metrics_Gauge(METRIC_QUEUE_RECORDS, Spsc_Count(ctx->queue));
+                ctx->batch_queued = 0;
+            }
+            int saved = Read_Saved_Batches(&ctx->backlog, ctx->batch_bodies + ctx->batch_queued,
+                                           ctx->batch_scratch + ctx->batch_queued, depth - ctx->batch_queued,
+                                           ctx->batch_max_bytes, ctx->batch_limit_records, ctx->batch_records + ctx->batch_queued);
+            if (saved == 1 && ctx->batch_bodies[ctx->batch_queued].count == 0)
+            {
+                Remove_Saved_Objects(&ctx->backlog, ctx->batch_records[ctx->batch_queued]);
+                Sensor_Save_Position(ctx, monTime);
+                saved = 0;
+            }
+            ctx->batch_count = ctx->batch_queued + saved;
+            if (ctx->batch_count > 0 && Retry_Allow(&ctx->retry, Smw_Now_Ms()))
+            {
+                ctx->payload_length = 0;     // Nothing fresh to save if this upload fails
                 ctx->state = STATE_HTTP_TRANSACTION;
             }
+            else if (ctx->batch_count > 0)
+            {
+                Sensor_Rewind_Batches(ctx);
+                ctx->state = STATE_DONE;
+            }
             else
             {
                 //printf("No saved data to send\n");
+                ctx->backlog_empty = 1;
+                Smw_Timer_Cancel(&ctx->flush_timer);
                 ctx->state = STATE_DONE;
             }
-
+        }
         break;
 
 
         case STATE_HTTP_TRANSACTION:
+        {
+            const http_body_t* bodies = ctx->batch_bodies;
+            int count = ctx->batch_count;
 
-            ctx->sockfd = Tcp_Init(SERVER_HOST, SERVER_PORT);
-            ctx->http_request = build_http_request(METHOD_POST, SERVER_HOST, ctx->json_buffer);
+            // Backlog batches are pipelined on one kept-alive connection, a fresh reading goes alone
+            if (count == 0)
+            {
+                ctx->fresh_body.parts = &ctx->fresh_part;
+                ctx->fresh_body.capacity = 1;
+                ctx->fresh_body.content_type = ctx->encoder->content_type;
+                Http_Body_Reset(&ctx->fresh_body);
+                Http_Body_Add(&ctx->fresh_body, ctx->payload_buffer, ctx->payload_length);
+                bodies = &ctx->fresh_body;
+                count = 1;
+            }
 
-            if (Tcp_Send(ctx->sockfd, ctx->http_request, strlen(ctx->http_request)) < 0)
+            ctx->conn = Tcp_Pool_Get(Config_Current()->server_host, Config_Current()->server_port);
+            ctx->txn_retried = 0;
+            if (Http_Txn_Begin(&ctx->txn, ctx->conn, METHOD_POST, bodies, count) < 0)
             {
-                ctx->state = STATE_SAVE_DATA;
-                ctx->result_code = -5;
+                ctx->txn.count = count;     // Nothing sent - everything is kept for later
+                ctx->state = STATE_HTTP_COMPLETE;
                 break;
             }
-            
-            int bytes_received = Tcp_Recv(ctx->sockfd, ctx->http_response, sizeof(ctx->http_response) - 1);
-            if (bytes_received > 0)
+            Sensor_Phase_Start(ctx, monTime);
+            ctx->state = STATE_HTTP_RESOLVING;
+        }
+        break;
+
+
+        case STATE_HTTP_RESOLVING:
+        {
+            // Cached answers return at once; only a cold cache waits for the background lookup
+            int resolved = Tcp_Conn_Resolve(ctx->conn, monTime);
+            if (resolved > 0)
+            {
+                Sensor_Phase_Start(ctx, monTime);
+                ctx->state = STATE_HTTP_CONNECTING;
+            }
+            else if (resolved < 0)
+            {
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else if (ctx->phase_timer.fired)
+            {
+                LOG_WARN("ev=timeout phase=lookup host=%s ms=%d", ctx->conn->hostname, ctx->phase_timeout_ms);
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else
+            {
+                next_run = Sensor_Wait_Lookup(ctx, monTime);
+            }
+        }
+        break;
+
+
+        case STATE_HTTP_CONNECTING:
+        {
+            int connected = Tcp_Conn_Connect(ctx->conn, monTime);
+            if (connected < 0)
+            {
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else if (connected > 0)
+            {
+                Sensor_Phase_Start(ctx, monTime);
+                ctx->state = STATE_HTTP_SENDING;
+            }
+            else if (ctx->phase_timer.fired)
+            {
+                LOG_WARN("ev=timeout phase=connect ms=%d", ctx->phase_timeout_ms);
+                Tcp_Conn_Close(ctx->conn);
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else
             {
-                ctx->http_response[bytes_received] = '\0';
-                Print_HTTP_Status(ctx->http_response);
+                next_run = Sensor_Wait_Socket(ctx, EPOLLOUT, monTime);
+            }
+        }
+        break;
+
 
-                if (strstr(ctx->http_response, "HTTP/1.1 2") != NULL)
+        case STATE_HTTP_SENDING:
+        {
+            int reused = ctx->conn->socket_requests > 0;
+            int done = Http_Txn_Send(&ctx->txn);
+
+            if (done > 0)
+            {
+                Sensor_Phase_Start(ctx, monTime);
+                ctx->state = STATE_HTTP_RECEIVING;
+            }
+            else if (done < 0)
+            {
+                Tcp_Conn_Close(ctx->conn);
+
+                // Server dropped an idle kept-alive socket after our check - retry once on a fresh one
+                if (reused && ctx->txn.bytes_sent == 0 && !ctx->txn_retried)
                 {
-                    ctx->state = STATE_DONE;
+                    LOG_INFO("ev=keepalive_send_failed action=reconnect");
+                    ctx->conn->reconnects++;
+                    ctx->txn_retried = 1;
+                    Sensor_Phase_Start(ctx, monTime);
+                    ctx->state = STATE_HTTP_CONNECTING;
                 }
                 else
                 {
-                    ctx->state = STATE_OFFLINE; // Save data if server rejected it
-                    ctx->result_code = -7;
+                    ctx->state = STATE_HTTP_COMPLETE;
                 }
             }
+            else if (ctx->phase_timer.fired)
+            {
+                LOG_WARN("ev=timeout phase=send ms=%d", ctx->phase_timeout_ms);
+                Tcp_Conn_Close(ctx->conn);
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else
+            {
+                next_run = Sensor_Wait_Socket(ctx, EPOLLOUT, monTime);
+            }
+        }
+        break;
+
 
+        case STATE_HTTP_RECEIVING:
+        {
+            int done = Http_Txn_Recv(&ctx->txn);
+
+            if (done != 0)
+            {
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else if (ctx->phase_timer.fired)
+            {
+                LOG_WARN("ev=timeout phase=recv ms=%d", ctx->phase_timeout_ms);
+                Tcp_Conn_Close(ctx->conn);
+                ctx->state = STATE_HTTP_COMPLETE;
+            }
+            else
+            {
+                next_run = Sensor_Wait_Socket(ctx, EPOLLIN, monTime);
+            }
+        }
         break;
 
 
-        case STATE_OFFLINE:
+        case STATE_HTTP_COMPLETE:
         {
-            struct timespec current_time;
-            clock_gettime(CLOCK_MONOTONIC, &current_time);
-            uint64_t current_ms = (current_time.tv_sec * 1000) + (current_time.tv_nsec / 1000000);
-            
-            uint64_t offline_duration = current_ms - ctx->offline_time;
+            int count = ctx->txn.count;
+            int acked = 0;
+            int acked_records = 0;
+            int acked_queued = 0;
+            int resized = 0;
+
+            Sensor_Unwatch_Socket(ctx);
+            Smw_Timer_Cancel(&ctx->phase_timer);
+
+            // Only the leading run of finished batches can be dropped from the front of the file.
+            // A payload the server refuses outright is dropped too - resending it cannot succeed.
+            while (acked < ctx->txn.received)
+            {
+                int status = ctx->txn.status_codes[acked];
+                http_status_class_t status_class = Http_Status_Class(status);
+                int records = ctx->batch_count > 0 ? ctx->batch_records[acked] : 0;
+
+                if (status_class == HTTP_CLASS_REJECTED && status == 413 && records > 1)
+                {
+                    // Too large for the server - retry the same records in smaller batches
+                    ctx->batch_limit_records = records / 2;
+                    LOG_WARN("ev=batch_too_large records=%d batch_max=%d", records, ctx->batch_limit_records);
+                    resized = 1;
+                    break;
+                }
+                if (status_class == HTTP_CLASS_REJECTED) {
+                    LOG_WARN("ev=payload_rejected what=%s status=%d action=drop", records ? "batch" : "reading", status);
+                    if (!records) ctx->payload_length = 0;
+                }
+                else if (status_class != HTTP_CLASS_SUCCESS) {
+                    break;
+                }
+                if (acked < ctx->batch_queued) acked_queued += records;
+                else acked_records += records;
+                acked++;
+            }
+
+            // The server answering what we sent (or asking for smaller batches) means the path is up
+            if (acked == count || resized) {
+                Retry_Success(&ctx->retry, monTime);
+            }
+            else {
+                Retry_Failure(&ctx->retry, monTime);
+            }
+            if (ctx->txn.retry_after >= 0)
+            {
+                Retry_Hold(&ctx->retry, monTime + (uint64_t)ctx->txn.retry_after * 1000);
+                LOG_INFO("ev=retry_after s=%d", ctx->txn.retry_after);
+            }
+            if (acked_queued > 0)
+            {
+                // The slots go back to the producer
+                Spsc_Release(ctx->queue, acked_queued);
+                Metrics_Gauge(METRIC_QUEUE_RECORDS, Spsc_Count(ctx->queue));
+            }
+            if (acked > 0 && !resized && ctx->batch_limit_records < ctx->batch_max_records)
+            {
+                // Taken whole - grow back by a quarter per transaction, so a server that still
+                // limits the size answers 413 every few uploads rather than every other one
+                int grown = ctx->batch_limit_records + (ctx->batch_limit_records + 3) / 4;
+                ctx->batch_limit_records = grown < ctx->batch_max_records ? grown : ctx->batch_max_records;
+            }
+            if (acked_records > 0)
+            {
+                Remove_Saved_Objects(&ctx->backlog, acked_records);
+                Sensor_Save_Position(ctx, monTime);
+            }
+            Sensor_Rewind_Batches(ctx);      // Unacknowledged batches are offered again next time
+            Tcp_Conn_Print_Stats(ctx->conn);
 
-            if (offline_duration >= 30000) {  // 30 seconds
-                printf("Offline - attempting to reconnect\n");
-                ctx->offline_time = current_ms;
+            if (acked == count)
+            {
+                ctx->state = STATE_DONE;
+                ctx->result_code = 0;
+            }
+            else if (ctx->txn.received < count)
+            {
                 ctx->state = STATE_SAVE_DATA;
+                ctx->result_code = -5;
             }
             else
             {
-                ctx->state = STATE_READ_SENSOR;
+                ctx->state = STATE_SAVE_DATA; // Server answered but did not take it - keep the data
+                ctx->result_code = -7;
             }
+            Metrics_Result(ctx->result_code);
+        }
+        break;
+
+
+        case STATE_OFFLINE:
+        {
+            // Data is safe in the backlog - sleep until the next measurement or the next allowed attempt
+            uint64_t next_attempt = Retry_Next_Attempt(&ctx->retry);
+
+            if (ctx->retry.offline_since)
+            {
+                LOG_INFO("ev=offline for_s=%llu breaker=%s next_attempt_ms=%llu",
+                         (unsigned long long)(monTime - ctx->retry.offline_since) / 1000,
+                         Retry_State_Name(ctx->retry.state),
+                         (unsigned long long)(next_attempt > monTime ? next_attempt - monTime : 0));
+            }
+            ctx->state = STATE_READ_SENSOR;
+            Smw_Timer_Arm(&ctx->retry_timer, next_attempt);
+            next_run = Sensor_Sleep(ctx, monTime);
         }
         break;
 
@@ -161,37 +1126,85 @@ void Sensor_State_Machine(task_context_t* ctx, uint64_t monTime)
         case STATE_SAVE_DATA:
 
 
-            Save_Sensor_Data_To_File(ctx->json_buffer);
-            printf("Data saved to file\n");
+            // Saved objects that failed are still in the file - only a fresh reading needs saving
+            if (ctx->payload_length > 0)
+            {
+                Save_Sensor_Data_To_File(&ctx->backlog, ctx->payload_buffer, ctx->payload_length, ctx->encoder->store_type);
+                LOG_DEBUG("ev=reading_saved");
+                ctx->payload_length = 0;
+            }
+            ctx->backlog_empty = 0;
             ctx->state = STATE_OFFLINE;
 
         break;
 
 
         case STATE_DONE:
-            if (ctx->sockfd >= 0)
-            {
-                close(ctx->sockfd);
-                ctx->sockfd = -1;
-            }
-            if (ctx->http_request)
-            {
-                free(ctx->http_request);
-                ctx->http_request = NULL;
-            }
+            // The connection stays open in the pool for the next cycle.
+            // One reset releases everything the cycle allocated.
             if (ctx->sensor_data)
             {
-                Sensor_Free(ctx->sensor_data);
                 ctx->sensor_data = NULL;
+                LOG_DEBUG("ev=arena_reset used=%zu peak=%zu size=%zu",
+                          ctx->arena.used - ctx->cycle_mark, ctx->arena.peak, ctx->arena.size);
             }
-            else
+            Arena_Reset(&ctx->arena, ctx->cycle_mark);
+            ctx->cycles++;
+            Metrics_Time(METRIC_CYCLE, Metrics_Now_Us() - ctx->cycle_started_us);
+
+#ifdef HEAP_COUNT
+            // The first cycle sets things up, every later one must not touch the heap
+            if (ctx->cycles > 1 && Heap_Calls() != ctx->cycle_heap_calls)
             {
-               // printf("Sensor task completed successfully\n");
+                LOG_ERROR("ev=heap_check result=fail calls=%lu cycle=%lu", Heap_Calls() - ctx->cycle_heap_calls, ctx->cycles);
+                Log_Flush();
+                exit(1);
+            }
+            LOG_INFO("ev=heap_check result=ok cycle=%lu total_calls=%lu", ctx->cycles, Heap_Calls());
+            ctx->cycle_heap_calls = Heap_Calls();
+#endif
+
+            // Task is kept across cycles - start over and sleep if there is nothing left to send.
+            // Threaded mode goes to sleep in STATE_READ_SENSOR, where the encoder can wake it.
+            ctx->state = STATE_INITIALIZE;
+            if (ctx->backlog_empty && !ctx->pipeline)
+            {
+                next_run = Sensor_Sleep(ctx, monTime);
             }
         break;
         
         case STATE_FAILED:
-                printf("Sensor task failed with code: %d\n", ctx->result_code);           
+                LOG_ERROR("ev=task_failed code=%d", ctx->result_code);
+                Metrics_Result(ctx->result_code);
+                ctx->sensor_data = NULL;
+                Arena_Reset(&ctx->arena, ctx->cycle_mark);
+                ctx->state = STATE_INITIALIZE;
+
+                // Try again when the next reading is due
+                if (ctx->pipeline) {
+                    Smw_Timer_Arm(&ctx->retry_timer, monTime + Sensor_Sample_Period(ctx));
+                }
+                else if (!ctx->read_timer.fired) {
+                    Smw_Timer_Arm(&ctx->read_timer, ctx->last_read_time + Sensor_Sample_Period(ctx));
+                }
+                next_run = Sensor_Sleep(ctx, monTime);
         break;
     }
+
+    // Time spent in the state just left, plus the backlog it left behind
+    if (ctx->state != entered_state)
+    {
+        uint64_t now_us = Metrics_Now_Us();
+        if (ctx->state_entered_us) {
+            Metrics_State_Time(entered_state, now_us - ctx->state_entered_us);
+        }
+        ctx->state_entered_us = now_us;
+
+        uint32_t records = Store_Count(&ctx->backlog);
+        Metrics_Gauge(METRIC_BACKLOG_RECORDS, records);
+        Metrics_Gauge(METRIC_BACKLOG_BYTES, (uint64_t)records * ctx->backlog.slot_size);
+    }
+    Sensor_Commit_Arm(ctx);
+
+    return next_run;
 }
@@ -0,0 +1,84 @@
+#include "../include/spsc.h"
+#include <string.h>
+
+        // Carves capacity slots of slot_size bytes from arena. capacity must be a power of two.
+int Spsc_Init(spsc_ring_t* ring, arena_t* arena, uint32_t capacity, uint32_t slot_size)
+{
+    if (!ring || capacity == 0 || (capacity & (capacity - 1)) || slot_size == 0) return -1;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = Arena_Alloc(arena, (size_t)capacity * slot_size);
+    if (!ring->slots) return -1;
+
+    ring->slot_size = slot_size;
+    ring->mask = capacity - 1;
+    return 0;
+}
+
+static void* Spsc_Slot(const spsc_ring_t* ring, uint64_t position)
+{
+    return ring->slots + (size_t)(position & ring->mask) * ring->slot_size;
+}
+
+/* ---- Producer ---- */
+
+        // Next free slot to fill in place, NULL while the ring is full. Claiming again
+        // before Spsc_Publish() returns the same slot.
+void* Spsc_Claim(spsc_ring_t* ring)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (ring->tail - head > ring->mask) {
+        return NULL;
+    }
+    return Spsc_Slot(ring, ring->tail);
+}
+
+        // Hands the claimed slot to the consumer - its contents are visible before the tail moves
+void Spsc_Publish(spsc_ring_t* ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/* ---- Consumer ---- */
+
+        // Oldest slot not read yet, NULL when the consumer has caught up
+void* Spsc_Peek(const spsc_ring_t* ring)
+{
+    if (ring->cursor == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return Spsc_Slot(ring, ring->cursor);
+}
+
+void Spsc_Advance(spsc_ring_t* ring)
+{
+    if (ring->cursor != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) ring->cursor++;
+}
+
+        // Slots read but not released are read again (an upload that failed)
+void Spsc_Rewind(spsc_ring_t* ring)
+{
+    ring->cursor = ring->head;
+}
+
+        // Frees the oldest count slots for the producer. Nothing is read from them afterwards.
+void Spsc_Release(spsc_ring_t* ring, uint32_t count)
+{
+    uint64_t read = ring->cursor - ring->head;
+    if (count > read) count = (uint32_t)read;
+
+    __atomic_store_n(&ring->head, ring->head + count, __ATOMIC_RELEASE);
+}
+
+        // Slots published but not read yet (consumer side)
+uint32_t Spsc_Unread(const spsc_ring_t* ring)
+{
+    return (uint32_t)(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - ring->cursor);
+}
+
+        // Slots in use, published and not released - a snapshot from either side
+uint32_t Spsc_Count(const spsc_ring_t* ring)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return (uint32_t)(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head);
+}
@@ -0,0 +1,351 @@
+#define _GNU_SOURCE     // memmem()
+#include "../include/smw.h"
+#include "../include/standin.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define STANDIN_OK "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"
+#define STANDIN_UNAVAILABLE "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n"
+#define STANDIN_TIMESTAMP "\"timestamp\": \""
+
+typedef struct {
+    uint64_t due_ms;                 // Sent once the latency has passed
+    int status;
+} standin_answer_t;
+
+typedef struct {
+    int fd;                          // -1 = free
+    int reading;                     // Watched for EPOLLIN - paused while the answer queue is full
+    char buffer[STANDIN_BUFFER_SIZE];
+    int used;
+    standin_answer_t answers[STANDIN_PENDING_MAX];
+    int answer_count;
+} standin_client_t;
+
+static standin_config_t standin_config;
+static standin_stats_t standin_stats;
+static standin_client_t standin_clients[STANDIN_CLIENTS_MAX];
+static smw_task_t* standin_task = NULL;
+static int standin_listen_fd = -1;
+static int standin_port = 0;         // Picked by the kernel on the first listen, kept across outages
+static uint64_t standin_started_ms = 0;
+static uint32_t standin_random = 1;
+static int standin_active = 0;
+
+        // xorshift32: which requests fail, reproducible from the seed
+static double Standin_Random(void)
+{
+    uint32_t x = standin_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    standin_random = x;
+    return (double)x / 4294967296.0;
+}
+
+static int Standin_Listen(void)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)standin_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+
+    int one = 1;
+    standin_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (standin_listen_fd < 0 ||
+        setsockopt(standin_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(standin_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(standin_listen_fd, 16) < 0 ||
+        getsockname(standin_listen_fd, (struct sockaddr*)&addr, &addr_len) < 0)
+    {
+        LOG_ERROR("ev=standin_listen_failed port=%d errno=%d", standin_port, errno);
+        if (standin_listen_fd >= 0) close(standin_listen_fd);
+        standin_listen_fd = -1;
+        return -1;
+    }
+    standin_port = ntohs(addr.sin_port);
+    Smw_Watch_Fd(standin_task, standin_listen_fd, EPOLLIN);
+    return 0;
+}
+
+static void Standin_Close(standin_client_t* client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    client->fd = -1;
+    client->used = 0;
+    client->answer_count = 0;
+}
+
+        // Inside an outage at since_ms? Also returns when the answer next changes.
+static int Standin_Down(uint64_t since_ms, uint64_t* next_change)
+{
+    int down = 0;
+    *next_change = UINT64_MAX;
+    for (int i = 0; i < standin_config.outage_count; i++)
+    {
+        const standin_outage_t* outage = &standin_config.outages[i];
+        if (since_ms >= outage->start_ms && since_ms < outage->end_ms) {
+            down = 1;
+        }
+        if (outage->start_ms > since_ms && outage->start_ms < *next_change) *next_change = outage->start_ms;
+        if (outage->end_ms > since_ms && outage->end_ms < *next_change) *next_change = outage->end_ms;
+    }
+    return down;
+}
+
+        // Counts the readings of an accepted JSON body and how old each one is
+static void Standin_Count_Records(const char* body, int length, int64_t accepted_ms)
+{
+    const char* end = body + length;
+    const char* at = body;
+
+    while ((at = memmem(at, end - at, STANDIN_TIMESTAMP, sizeof(STANDIN_TIMESTAMP) - 1)) != NULL)
+    {
+        at += sizeof(STANDIN_TIMESTAMP) - 1;
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (end - at < 20 || sscanf(at, "%4d-%2d-%2dT%2d:%2d:%2dZ", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                                    &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+            continue;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        int64_t age_ms = accepted_ms - (int64_t)timegm(&tm) * 1000;
+        Metrics_Record(&standin_stats.latency, age_ms > 0 ? (uint64_t)age_ms * 1000 : 0);
+        standin_stats.records++;
+    }
+}
+
+        // Takes every complete request off the front of the buffer and queues its answer
+static void Standin_Parse(standin_client_t* client, uint64_t monTime)
+{
+    while (client->answer_count < STANDIN_PENDING_MAX)
+    {
+        const char* header_end = memmem(client->buffer, client->used, "\r\n\r\n", 4);
+        if (!header_end) {
+            return;
+        }
+        int header_length = (int)(header_end - client->buffer) + 4;
+        long content_length = Http_Request_Length(client->buffer, header_length);
+        if (content_length < 0 || content_length > STANDIN_BUFFER_SIZE - header_length) {
+            Standin_Close(client);
+            return;
+        }
+        if (client->used < header_length + content_length) {
+            return;
+        }
+
+        standin_answer_t* answer = &client->answers[client->answer_count++];
+        answer->due_ms = monTime + (uint64_t)standin_config.latency_ms;
+        answer->status = Standin_Random() < standin_config.error_rate ? 503 : 200;
+        standin_stats.requests++;
+        if (answer->status == 200) {
+            Standin_Count_Records(client->buffer + header_length, (int)content_length,
+                                  Clock_Wall_Ms() + standin_config.latency_ms);
+        }
+        else {
+            standin_stats.errors++;
+        }
+
+        int consumed = header_length + (int)content_length;
+        memmove(client->buffer, client->buffer + consumed, client->used - consumed);
+        client->used -= consumed;
+    }
+}
+
+static void Standin_Read(standin_client_t* client, uint64_t monTime)
+{
+    while (client->fd >= 0 && client->used < STANDIN_BUFFER_SIZE && client->answer_count < STANDIN_PENDING_MAX)
+    {
+        ssize_t n = recv(client->fd, client->buffer + client->used, STANDIN_BUFFER_SIZE - client->used, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            Standin_Close(client);
+            return;
+        }
+        client->used += (int)n;
+        standin_stats.bytes += (uint64_t)n;
+        Standin_Parse(client, monTime);
+    }
+    if (client->fd >= 0 && client->used >= STANDIN_BUFFER_SIZE) {
+        LOG_WARN("ev=standin_request_too_large bytes=%d", client->used);
+        Standin_Close(client);
+    }
+}
+
+        // Sends the answers whose latency has passed, in request order and in one segment:
+        // the kernel's delayed ACK runs on real time, so Nagle must never hold a piece back
+static void Standin_Answer(standin_client_t* client, uint64_t monTime)
+{
+    char text[STANDIN_PENDING_MAX * sizeof(STANDIN_UNAVAILABLE)];
+    size_t length = 0;
+    int sent = 0;
+
+    while (sent < client->answer_count && client->answers[sent].due_ms <= monTime)
+    {
+        const char* answer = client->answers[sent].status == 200 ? STANDIN_OK : STANDIN_UNAVAILABLE;
+        size_t answer_length = strlen(answer);
+        memcpy(text + length, answer, answer_length);
+        length += answer_length;
+        sent++;
+    }
+    if (sent == 0 || client->fd < 0) {
+        return;
+    }
+    if (send(client->fd, text, length, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)length) {
+        Standin_Close(client);        // A few hundred bytes not fitting means the peer is gone
+        return;
+    }
+    memmove(client->answers, client->answers + sent, (client->answer_count - sent) * sizeof(standin_answer_t));
+    client->answer_count -= sent;
+}
+
+static void Standin_Accept(void)
+{
+    while (standin_listen_fd >= 0)
+    {
+        int fd = accept4(standin_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        standin_client_t* client = NULL;
+        for (int i = 0; i < STANDIN_CLIENTS_MAX && !client; i++) {
+            if (standin_clients[i].fd < 0) client = &standin_clients[i];
+        }
+        if (!client) {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        client->fd = fd;
+        client->reading = 0;
+        client->used = 0;
+        client->answer_count = 0;
+        standin_stats.connections++;
+    }
+}
+
+static uint64_t Standin_Task(void* context, uint64_t monTime)
+{
+    (void)context;
+    standin_active = 1;
+
+    uint64_t next_change;
+    int down = Standin_Down(monTime - standin_started_ms, &next_change);
+    uint64_t next_run = next_change == UINT64_MAX ? UINT64_MAX : standin_started_ms + next_change;
+
+    if (down && standin_listen_fd >= 0)
+    {
+        LOG_INFO("ev=standin_outage state=down port=%d", standin_port);
+        close(standin_listen_fd);
+        standin_listen_fd = -1;
+        for (int i = 0; i < STANDIN_CLIENTS_MAX; i++) {
+            if (standin_clients[i].fd >= 0) {
+                standin_stats.dropped++;
+                Standin_Close(&standin_clients[i]);
+            }
+        }
+    }
+    else if (!down && standin_listen_fd < 0)
+    {
+        LOG_INFO("ev=standin_outage state=up port=%d", standin_port);
+        if (Standin_Listen() < 0) {
+            next_run = monTime + SMW_POLL_MS;
+        }
+    }
+
+    Standin_Accept();
+    for (int i = 0; i < STANDIN_CLIENTS_MAX; i++)
+    {
+        standin_client_t* client = &standin_clients[i];
+        if (client->fd < 0) continue;
+
+        Standin_Read(client, monTime);
+        Standin_Answer(client, monTime);
+        if (client->fd < 0) continue;
+
+        // Answers pile up while the latency runs - stop reading rather than spin on a full queue
+        int want = client->answer_count < STANDIN_PENDING_MAX;
+        if (want && !client->reading) Smw_Watch_Fd(standin_task, client->fd, EPOLLIN);
+        if (!want && client->reading) Smw_Unwatch_Fd(client->fd);
+        client->reading = want;
+
+        if (client->answer_count > 0 && client->answers[0].due_ms < next_run) {
+            next_run = client->answers[0].due_ms;
+        }
+    }
+
+    standin_active = 0;
+    return next_run;
+}
+
+        // Listens on an ephemeral 127.0.0.1 port (see Standin_Port()). Call after Smw_Init().
+int Standin_Start(const standin_config_t* config)
+{
+    standin_config = *config;
+    memset(&standin_stats, 0, sizeof(standin_stats));
+    standin_random = config->seed ? config->seed : 1;
+    for (int i = 0; i < STANDIN_CLIENTS_MAX; i++) {
+        standin_clients[i].fd = -1;
+    }
+
+    standin_task = Create_Smw_Task(NULL, Standin_Task, SMW_PRIO_NORMAL);
+    if (!standin_task) {
+        LOG_ERROR("ev=task_create_failed task=standin");
+        return -1;
+    }
+    standin_started_ms = Smw_Now_Ms();
+    if (Standin_Listen() < 0) {
+        Free_Smw_Task(standin_task);
+        standin_task = NULL;
+        return -1;
+    }
+    LOG_INFO("ev=standin_listen port=%d latency_ms=%d error_rate=%.3f outages=%d",
+             standin_port, config->latency_ms, config->error_rate, config->outage_count);
+    return 0;
+}
+
+int Standin_Port(void)
+{
+    return standin_port;
+}
+
+        // True while the stand-in's task runs - lets the harness tell its work from the node's
+int Standin_Active(void)
+{
+    return standin_active;
+}
+
+const standin_stats_t* Standin_Stats(void)
+{
+    return &standin_stats;
+}
+
+void Standin_Stop(void)
+{
+    for (int i = 0; i < STANDIN_CLIENTS_MAX; i++) {
+        Standin_Close(&standin_clients[i]);
+    }
+    if (standin_listen_fd >= 0) {
+        close(standin_listen_fd);
+        standin_listen_fd = -1;
+    }
+    if (standin_task) {
+        Free_Smw_Task(standin_task);
+        standin_task = NULL;
+    }
+}
@@ -0,0 +1,846 @@
+#define _DEFAULT_SOURCE     // pwritev()
+#include "../include/store.h"
+#include "../include/log.h"
+#include "../include/clock.h"
+#include "../include/metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define STORE_V1_HEADER_SIZE 40      // Version 1 header: no checksum fields, slots followed at once
+
+// CRC32C (Castagnoli, reflected 0x82F63B78), four bits per step - a 64-byte table fits any device
+static const uint32_t store_crc_table[16] = {
+    0x00000000, 0x105EC76F, 0x20BD8EDE, 0x30E349B1, 0x417B1DBC, 0x5125DAD3, 0x61C69362, 0x7198540D,
+    0x82F63B78, 0x92A8FC17, 0xA24BB5A6, 0xB21572C9, 0xC38D26C4, 0xD3D3E1AB, 0xE330A81A, 0xF36E6F75,
+};
+
+        // Continues crc over length bytes of data (start with 0)
+static uint32_t Store_Crc32c(uint32_t crc, const void* data, size_t length)
+{
+    const unsigned char* bytes = data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ store_crc_table[crc & 15];
+        crc = (crc >> 4) ^ store_crc_table[crc & 15];
+    }
+    return ~crc;
+}
+
+static uint32_t Store_Record_Crc(const store_record_t* record, const char* payload)
+{
+    store_record_t header = *record;
+    header.crc = 0;
+    uint32_t crc = Store_Crc32c(0, &header, sizeof(header));
+    return Store_Crc32c(crc, payload, header.length);
+}
+
+static uint32_t Store_Header_Crc(const store_header_t* header)
+{
+    store_header_t copy = *header;
+    copy.crc = 0;
+    return Store_Crc32c(0, &copy, sizeof(copy));
+}
+
+static off_t Store_Slot_Offset(const store_t* store, uint64_t seq)
+{
+    return (off_t)sizeof(store_header_t) + (off_t)(seq % store->capacity) * store->slot_size;
+}
+
+static uint32_t Store_Used(const store_t* store)
+{
+    return (uint32_t)(store->tail - store->head);
+}
+
+static char* Store_Cache_Slot(const store_t* store, uint64_t seq)
+{
+    return store->cache + (size_t)(seq % STORE_CACHE_SLOTS) * store->slot_size;
+}
+
+        // Where record seq lives right now: the cache until it is committed, the mapping after
+static const char* Store_Record_Slot(const store_t* store, uint64_t seq)
+{
+    if (seq >= store->committed) {
+        return Store_Cache_Slot(store, seq);
+    }
+    return store->map + Store_Slot_Offset(store, seq);
+}
+
+static void Store_Lock(const store_t* store)
+{
+    if (store->lock) pthread_mutex_lock(store->lock);
+}
+
+static void Store_Unlock(const store_t* store)
+{
+    if (store->lock) pthread_mutex_unlock(store->lock);
+}
+
+static int Store_Map(store_t* store)
+{
+    store->map_size = Store_Slot_Offset(store, 0) + (size_t)store->capacity * store->slot_size;
+
+    void* map = mmap(NULL, store->map_size, PROT_READ, MAP_SHARED, store->fd, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("ev=backlog_map_failed bytes=%zu", store->map_size);
+        store->map = NULL;
+        return -1;
+    }
+    store->map = map;
+    return 0;
+}
+
+static int Store_Write_Header(store_t* store)
+{
+    store_header_t header = {0};
+    header.magic = STORE_MAGIC;
+    header.version = STORE_VERSION;
+    header.slot_size = store->slot_size;
+    header.capacity = store->capacity;
+    header.head = store->head;
+    header.tail = store->committed;
+    header.dropped = store->dropped;
+    header.crc = Store_Header_Crc(&header);
+
+    if (pwrite(store->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        LOG_ERROR("ev=backlog_header_write_failed");
+        return -1;
+    }
+    store->dirty = 0;
+    store->gap = 0;
+    store->checkpoint = store->committed;
+    return 0;
+}
+
+        // A whole record of sequence number seq in the file: number, length and checksum agree
+static int Store_Slot_Valid(const store_t* store, uint64_t seq)
+{
+    const char* slot = store->map + Store_Slot_Offset(store, seq);
+    store_record_t record;
+    memcpy(&record, slot, sizeof(record));
+
+    return record.seq == seq && record.length <= store->slot_size - sizeof(record) &&
+           record.crc == Store_Record_Crc(&record, slot + sizeof(record));
+}
+
+        // Records committed between two checkpoints, at most
+static uint32_t Store_Checkpoint_Interval(const store_t* store)
+{
+    uint32_t interval = store->capacity / 2;    // The log found on open can never lap the checkpoint
+    if (interval > STORE_CHECKPOINT_RECORDS) interval = STORE_CHECKPOINT_RECORDS;
+    return interval > 0 ? interval : 1;
+}
+
+        // Rebuilds head and tail from the checkpoint in the header. Records committed after it are
+        // found by sequence number and checksum; the first slot that fails ends the log. Reads at
+        // most STORE_CHECKPOINT_RECORDS + STORE_CACHE_SLOTS slots, however large the backlog has grown.
+static int Store_Recover(store_t* store)
+{
+    uint64_t checkpoint = store->tail;
+    uint32_t window = Store_Checkpoint_Interval(store) + STORE_CACHE_SLOTS;
+    if (window > store->capacity) window = store->capacity;
+
+    while (store->tail - checkpoint < window && Store_Slot_Valid(store, store->tail)) {
+        store->tail++;
+    }
+
+    // A slot that names the next record but fails its checksum is a torn write. Slots after it
+    // may hold later records of the same unfinished group - the disk need not write a group in
+    // order. They go with it, or an append at the torn slot would join them up again on the
+    // next open. A slot still holding an older lap ends the log too, but proves nothing torn:
+    // what follows it is left alone.
+    store_record_t stop;
+    memcpy(&stop, store->map + Store_Slot_Offset(store, store->tail), sizeof(stop));
+    int torn = store->tail - checkpoint < window && stop.seq == store->tail;
+
+    store_record_t cleared = {0};
+    uint32_t truncated = 0;
+    for (uint64_t seq = store->tail + 1; torn && seq < checkpoint + window; seq++)
+    {
+        store_record_t record;
+        memcpy(&record, store->map + Store_Slot_Offset(store, seq), sizeof(record));
+        if (record.seq <= store->tail || record.seq >= checkpoint + window) continue;   // Older lap or empty
+
+        if (pwrite(store->fd, &cleared, sizeof(cleared), Store_Slot_Offset(store, seq)) != (ssize_t)sizeof(cleared)) {
+            LOG_ERROR("ev=backlog_truncate_failed seq=%llu", (unsigned long long)seq);
+            return -1;
+        }
+        truncated++;
+    }
+    if (truncated && fdatasync(store->fd) < 0) {
+        LOG_ERROR("ev=backlog_sync_failed");
+        return -1;
+    }
+
+    // Past a full ring the oldest records were overwritten by the newest
+    if (Store_Used(store) > store->capacity) {
+        store->dropped += Store_Used(store) - store->capacity;
+        store->head = store->tail - store->capacity;
+    }
+    if (store->tail != checkpoint || truncated) {
+        LOG_INFO("ev=backlog_recovered records=%llu truncated=%u",
+                 (unsigned long long)(store->tail - checkpoint), truncated);
+    }
+    return 0;
+}
+
+        // The header itself is damaged: every slot is read once, the newest whole record is the
+        // last one and the run of whole records before it the backlog. Acked records in that
+        // run are sent again.
+static void Store_Scan_Ring(store_t* store)
+{
+    uint64_t newest = 0;
+    int any = 0;
+
+    for (uint32_t slot = 0; slot < store->capacity; slot++)
+    {
+        store_record_t record;
+        memcpy(&record, store->map + Store_Slot_Offset(store, slot), sizeof(record));
+        if (record.seq % store->capacity == slot && (!any || record.seq > newest) && Store_Slot_Valid(store, record.seq)) {
+            newest = record.seq;
+            any = 1;
+        }
+    }
+
+    store->tail = any ? newest + 1 : 0;
+    store->head = store->tail;
+    while (store->head > 0 && Store_Used(store) < store->capacity && Store_Slot_Valid(store, store->head - 1)) {
+        store->head--;
+    }
+    store->dropped = 0;
+    store->dirty = 1;
+    LOG_WARN("ev=backlog_header_corrupt action=scanned records=%u", Store_Used(store));
+}
+
+static int Store_Start_Cache(store_t* store)
+{
+    if (Arena_Init(&store->cache_arena, (size_t)STORE_CACHE_SLOTS * store->slot_size + ARENA_ALIGN) < 0) {
+        LOG_ERROR("ev=backlog_cache_alloc_failed slots=%d", STORE_CACHE_SLOTS);
+        return -1;
+    }
+    store->cache = Arena_Alloc(&store->cache_arena, (size_t)STORE_CACHE_SLOTS * store->slot_size);
+    if (!store->cache) return -1;
+
+    memset(store->cache, 0xFF, (size_t)STORE_CACHE_SLOTS * store->slot_size);   // No slot names a record yet
+    store->committed = store->tail;
+    store->commit_records = STORE_COMMIT_RECORDS;
+    store->commit_ms = STORE_COMMIT_MS;
+    store->durability = STORE_DURABILITY_GROUP;
+    return 0;
+}
+
+        // Slots the mapping may cover without reaching past the end of the file. A damaged
+        // header's capacity is not trusted - the file size tells. A file cut short behind a good
+        // header (copied, or the disk filled as it was created) gets its missing slots back
+        // empty, and they read as damaged records. Returns the capacity, 0 if the file holds no
+        // slot, -1 on failure.
+static int64_t Store_File_Capacity(int fd, const store_header_t* header, int damaged)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        LOG_ERROR("ev=backlog_stat_failed");
+        return -1;
+    }
+    int64_t slots = (int64_t)(st.st_size - (off_t)sizeof(*header)) / header->slot_size;
+    if (slots < 0) slots = 0;
+
+    if (damaged) {
+        return slots > UINT32_MAX ? UINT32_MAX : slots;
+    }
+    if (slots < header->capacity)
+    {
+        off_t file_size = (off_t)sizeof(*header) + (off_t)header->capacity * header->slot_size;
+        LOG_WARN("ev=backlog_file_short slots=%lld expected=%u action=extend", (long long)slots, header->capacity);
+        if (posix_fallocate(fd, 0, file_size) != 0) {
+            LOG_ERROR("ev=backlog_preallocate_failed bytes=%ld", (long)file_size);
+            return -1;
+        }
+    }
+    return header->capacity;
+}
+
+static int Store_Upgrade(store_t* store, const char* path, int old_fd, const store_header_t* old, store_policy_t policy);
+
+        // Opens (or creates) the ring file. An existing file keeps its own geometry.
+int Store_Open(store_t* store, const char* path, uint32_t capacity, store_policy_t policy)
+{
+    if (!store || !path || capacity == 0) return -1;
+
+    memset(store, 0, sizeof(*store));
+    store->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (store->fd < 0) {
+        LOG_ERROR("ev=backlog_open_failed path=%s", path);
+        return -1;
+    }
+    store->policy = policy;
+
+    store_header_t header;
+    ssize_t n = pread(store->fd, &header, sizeof(header), 0);
+
+    if (n == (ssize_t)sizeof(header) && header.magic == STORE_MAGIC && header.version == 1 &&
+        header.slot_size == STORE_SLOT_SIZE && header.capacity > 0)
+    {
+        return Store_Upgrade(store, path, store->fd, &header, policy);
+    }
+
+    int damaged = 0;
+    int64_t slots = 0;
+    if (n == (ssize_t)sizeof(header) && header.magic == STORE_MAGIC && header.version == STORE_VERSION &&
+        header.slot_size == STORE_SLOT_SIZE)
+    {
+        damaged = header.crc != Store_Header_Crc(&header);
+        slots = Store_File_Capacity(store->fd, &header, damaged);
+        if (slots < 0) {
+            Store_Close(store);
+            return -1;
+        }
+    }
+
+    if (slots > 0)
+    {
+        store->slot_size = header.slot_size;
+        store->capacity = (uint32_t)slots;
+        store->head = header.head;
+        store->tail = header.tail;
+        store->dropped = header.dropped;
+        store->checkpoint = header.tail;
+
+        if (store->capacity != capacity) {
+            LOG_INFO("ev=backlog_capacity_kept slots=%u requested=%u", store->capacity, capacity);
+        }
+        if (Store_Map(store) < 0) {
+            Store_Close(store);
+            return -1;
+        }
+        if (damaged) {
+            Store_Scan_Ring(store);
+        }
+        else if (Store_Recover(store) < 0) {
+            Store_Close(store);
+            return -1;
+        }
+        if (Store_Start_Cache(store) < 0 || ((store->dirty || store->checkpoint != store->committed) && Store_Write_Header(store) < 0)) {
+            Store_Close(store);
+            return -1;
+        }
+        store->cursor = store->head;
+        LOG_INFO("ev=backlog_opened pending=%u", Store_Used(store));
+        return 0;
+    }
+
+    if (n > 0) {
+        LOG_WARN("ev=backlog_unknown_format path=%s action=start_empty", path);
+    }
+
+    // Fresh ring: reserve the whole file up front so appends never grow it
+    store->slot_size = STORE_SLOT_SIZE;
+    store->capacity = capacity;
+    off_t file_size = Store_Slot_Offset(store, 0) + (off_t)capacity * store->slot_size;
+
+    if (ftruncate(store->fd, 0) < 0 || posix_fallocate(store->fd, 0, file_size) != 0) {
+        LOG_ERROR("ev=backlog_preallocate_failed bytes=%ld", (long)file_size);
+        Store_Close(store);
+        return -1;
+    }
+
+    if (Store_Write_Header(store) < 0 || Store_Map(store) < 0 || Store_Start_Cache(store) < 0) {
+        Store_Close(store);
+        return -1;
+    }
+    LOG_INFO("ev=backlog_created slots=%u slot_bytes=%u", store->capacity, store->slot_size);
+    return 0;
+}
+
+        // Version 1 records have no checksums. They are copied into a fresh ring next to the
+        // old file, which replaces it with one rename once they are on disk - a crash before
+        // that leaves the old file as it was.
+static int Store_Upgrade(store_t* store, const char* path, int old_fd, const store_header_t* old, store_policy_t policy)
+{
+    char new_path[256];
+    snprintf(new_path, sizeof(new_path), "%s.new", path);
+    unlink(new_path);
+
+    if (Store_Open(store, new_path, old->capacity, policy) < 0) {
+        close(old_fd);
+        return -1;
+    }
+
+    char slot[STORE_SLOT_SIZE];
+    store_record_t record;
+    uint32_t copied = 0;
+    uint64_t head = old->tail - old->head > old->capacity ? old->tail - old->capacity : old->head;
+
+    // Past the header's tail, records that follow on by sequence number were committed later
+    for (uint64_t seq = head; seq - head < old->capacity; seq++)
+    {
+        off_t offset = STORE_V1_HEADER_SIZE + (off_t)(seq % old->capacity) * old->slot_size;
+        if (pread(old_fd, slot, sizeof(slot), offset) != (ssize_t)sizeof(slot)) break;
+
+        memcpy(&record, slot, sizeof(record));
+        int valid = record.seq == seq && record.type != 0 && record.length <= sizeof(slot) - sizeof(record);
+        if (!valid && seq >= old->tail) break;
+        if (valid && Store_Append(store, slot + sizeof(record), record.length, record.type) == 0) copied++;
+    }
+    close(old_fd);
+
+    if (Store_Commit(store) < 0 || Store_Write_Header(store) < 0 || fdatasync(store->fd) < 0 || rename(new_path, path) != 0) {
+        LOG_ERROR("ev=backlog_upgrade_failed path=%s", path);
+        Store_Close(store);
+        unlink(new_path);
+        return -1;
+    }
+    LOG_INFO("ev=backlog_upgraded from_version=1 records=%u", copied);
+    return 0;
+}
+
+        // From now on every call takes lock, so another thread may append while this one
+        // drains. Call before the second thread starts.
+void Store_Share(store_t* store, pthread_mutex_t* lock)
+{
+    if (store) store->lock = lock;
+}
+
+        // Writes [committed, tail) with one pwritev() per run of slots that is contiguous in the
+        // file - one in the common case, two when the group wraps around the ring - then syncs
+        // them as the durability level asks. Records stay cached if the write fails.
+static int Store_Commit_Locked(store_t* store)
+{
+    if (store->committed >= store->tail) return 0;
+
+    // Records acked or dropped from the cache never reach their slots. Open scans on from the
+    // header's tail and stops at the first slot that fails, so the header moves past them
+    // first - the sync below covers both.
+    if (store->gap && Store_Write_Header(store) < 0) {
+        return -1;
+    }
+
+    uint64_t started = Metrics_Now_Us();
+    uint64_t seq = store->committed;
+    while (seq < store->tail)
+    {
+        uint64_t end = seq + (store->capacity - seq % store->capacity);
+        if (end > store->tail) end = store->tail;
+
+        // A group is at most STORE_CACHE_SLOTS records, so the cache wraps at most once inside it
+        struct iovec parts[2];
+        int count = 0;
+        size_t bytes = 0;
+        for (uint64_t from = seq; from < end; count++)
+        {
+            uint64_t to = from + (STORE_CACHE_SLOTS - from % STORE_CACHE_SLOTS);
+            if (to > end) to = end;
+            parts[count].iov_base = Store_Cache_Slot(store, from);
+            parts[count].iov_len = (size_t)(to - from) * store->slot_size;
+            bytes += parts[count].iov_len;
+            from = to;
+        }
+        if (pwritev(store->fd, parts, count, Store_Slot_Offset(store, seq)) != (ssize_t)bytes) {
+            LOG_ERROR("ev=backlog_write_failed records=%llu", (unsigned long long)(store->tail - seq));
+            return -1;
+        }
+        store->committed = end;
+        seq = end;
+    }
+
+    // A new checkpoint keeps the recovery scan short; the sync below covers it with the group
+    if (store->committed - store->checkpoint >= Store_Checkpoint_Interval(store) && Store_Write_Header(store) < 0) {
+        return -1;
+    }
+    if (store->durability != STORE_DURABILITY_WRITE && fdatasync(store->fd) < 0) {
+        LOG_ERROR("ev=backlog_sync_failed");
+        return -1;
+    }
+    Metrics_Time(METRIC_COMMIT, Metrics_Now_Us() - started);
+    return 0;
+}
+
+        // If an upload still holds a view of the record in seq's cache slot, the slot cannot be
+        // reused yet. Its record header names the record - records written through skip the cache.
+static int Store_Cache_Slot_Busy(const store_t* store, uint64_t seq)
+{
+    store_record_t previous;
+    memcpy(&previous, Store_Cache_Slot(store, seq), sizeof(previous));
+    return previous.seq >= store->head && previous.seq < store->cursor;
+}
+
+        // O(1): copies the record into the cache and commits the group once it is large enough.
+        // Returns 0, or -1 if the record was not stored.
+static int Store_Append_Locked(store_t* store, const void* data, int length, uint16_t type)
+{
+    if (length < 0 || length > (int)(store->slot_size - sizeof(store_record_t))) {
+        LOG_WARN("ev=backlog_record_too_large bytes=%d", length);
+        return -1;
+    }
+
+    if (Store_Used(store) >= store->capacity)
+    {
+        // Never overwrites a record an upload is reading - the encoder thread or the gateway
+        // may append while one is in flight
+        if (store->policy == STORE_REJECT_NEW || store->cursor > store->head) {
+            LOG_WARN("ev=backlog_full records=%u action=drop_new", store->capacity);
+            return -1;
+        }
+        // The slot we are about to write holds the oldest record
+        store->head++;
+        store->dropped++;
+        store->dirty = 1;
+        if (store->cursor < store->head) store->cursor = store->head;
+        if (store->committed < store->head) {
+            store->committed = store->head;
+            store->gap = 1;
+        }
+    }
+
+    // A full cache makes room by committing; a slot still viewed by an upload, or
+    // STORE_DURABILITY_RECORD, sends the record straight to the file behind the group
+    char through[STORE_SLOT_SIZE];
+    int write_through = store->durability == STORE_DURABILITY_RECORD || Store_Cache_Slot_Busy(store, store->tail);
+    if ((write_through || store->tail - store->committed >= STORE_CACHE_SLOTS) && Store_Commit_Locked(store) < 0) {
+        return -1;
+    }
+    char* slot = write_through ? through : Store_Cache_Slot(store, store->tail);
+
+    store_record_t record = {0};
+    record.seq = store->tail;
+    record.length = (uint16_t)length;
+    record.type = type;
+    record.crc = Store_Record_Crc(&record, data);
+
+    memcpy(slot, &record, sizeof(record));
+    memcpy(slot + sizeof(record), data, length);
+
+    if (write_through)
+    {
+        size_t slot_used = sizeof(record) + length;
+        if ((store->gap && Store_Write_Header(store) < 0) ||
+            pwrite(store->fd, slot, slot_used, Store_Slot_Offset(store, store->tail)) != (ssize_t)slot_used ||
+            (store->durability != STORE_DURABILITY_WRITE && fdatasync(store->fd) < 0))
+        {
+            LOG_ERROR("ev=backlog_write_failed records=1");
+            return -1;
+        }
+        store->tail++;
+        store->committed = store->tail;
+        if (store->committed - store->checkpoint >= Store_Checkpoint_Interval(store)) {
+            Store_Write_Header(store);
+        }
+        return 0;
+    }
+
+    if (store->committed == store->tail) {
+        store->pending_since_ms = Clock_Now_Ms();
+    }
+    store->tail++;
+    if (store->tail - store->committed >= store->commit_records) {
+        Store_Commit_Locked(store);
+    }
+    return 0;
+}
+
+int Store_Append(store_t* store, const void* data, int length, uint16_t type)
+{
+    if (!store || store->fd < 0 || !data) return -1;
+
+    Store_Lock(store);
+    int rc = Store_Append_Locked(store, data, length, type);
+    Store_Unlock(store);
+    return rc;
+}
+
+static int Store_View_Locked(const store_t* store, uint32_t index, store_view_t* view)
+{
+    if (!store->map || index >= Store_Used(store)) return -1;
+
+    uint64_t seq = store->head + index;
+    const char* slot = Store_Record_Slot(store, seq);
+
+    // Cached records never left memory; records from the file are checked on every read
+    store_record_t record;
+    memcpy(&record, slot, sizeof(record));
+    if (record.seq != seq || record.length > store->slot_size - sizeof(record) ||
+        (seq < store->committed && record.crc != Store_Record_Crc(&record, slot + sizeof(record))))
+    {
+        LOG_WARN("ev=backlog_corrupt seq=%llu", (unsigned long long)seq);
+        return -1;
+    }
+
+    view->data = slot + sizeof(record);
+    view->length = record.length;
+    view->type = record.type;
+    view->seq = seq;
+    return 0;
+}
+
+        // Points view at record number index (0 = oldest) inside the mapping or the cache, no copy.
+        // Returns 0, or -1 if the record is missing or corrupt.
+int Store_View(const store_t* store, uint32_t index, store_view_t* view)
+{
+    if (!store || !view) return -1;
+
+    Store_Lock(store);
+    int rc = Store_View_Locked(store, index, view);
+    Store_Unlock(store);
+    return rc;
+}
+
+        // Views the record at the cursor without moving it. Returns 1 for a view,
+        // 0 when everything has been handed out, -1 for a corrupt record.
+int Store_Peek_View(const store_t* store, store_view_t* view)
+{
+    if (!store || !view) return 0;
+
+    Store_Lock(store);
+    int rc = 0;
+    if (store->cursor < store->tail) {
+        rc = Store_View_Locked(store, (uint32_t)(store->cursor - store->head), view) == 0 ? 1 : -1;
+    }
+    Store_Unlock(store);
+    return rc;
+}
+
+void Store_Advance(store_t* store)
+{
+    if (!store) return;
+
+    Store_Lock(store);
+    if (store->cursor < store->tail) store->cursor++;
+    Store_Unlock(store);
+}
+
+        // Makes records handed out but not acked available again (after a failed upload)
+void Store_Rewind(store_t* store)
+{
+    if (!store) return;
+
+    Store_Lock(store);
+    store->cursor = store->head;
+    Store_Unlock(store);
+}
+
+        // O(1): forgets the oldest count records. Only memory changes - the header follows with
+        // Store_Sync(), so a crash in between just sends them again. Records acked while still
+        // in the cache are never written at all.
+int Store_Ack(store_t* store, uint32_t count)
+{
+    if (!store || store->fd < 0) return -1;
+
+    Store_Lock(store);
+    if (count > Store_Used(store)) {
+        count = Store_Used(store);
+    }
+    store->head += count;
+    if (store->cursor < store->head) store->cursor = store->head;
+    if (store->committed < store->head) {
+        Metrics_Count(METRIC_BACKLOG_UNWRITTEN, store->head - store->committed);
+        store->committed = store->head;
+        store->gap = 1;
+    }
+    store->dirty = 1;
+    Store_Unlock(store);
+    return 0;
+}
+
+        // Writes the header if acks changed it since the last write
+int Store_Sync(store_t* store)
+{
+    if (!store || store->fd < 0) return -1;
+
+    Store_Lock(store);
+    int rc = store->dirty ? Store_Write_Header(store) : 0;
+    Store_Unlock(store);
+    return rc;
+}
+
+        // Group thresholds and durability, may change while running. records is capped at
+        // STORE_CACHE_SLOTS; the next append or Store_Commit_Due() applies them.
+void Store_Set_Commit(store_t* store, uint32_t records, uint32_t ms, store_durability_t durability)
+{
+    if (!store) return;
+
+    Store_Lock(store);
+    store->commit_records = records == 0 ? 1 : records > STORE_CACHE_SLOTS ? STORE_CACHE_SLOTS : records;
+    store->commit_ms = ms;
+    store->durability = durability;
+    Store_Unlock(store);
+}
+
+        // Writes every cached record now (before shutdown, or once data must not be lost)
+int Store_Commit(store_t* store)
+{
+    if (!store || store->fd < 0) return -1;
+
+    Store_Lock(store);
+    int rc = Store_Commit_Locked(store);
+    Store_Unlock(store);
+    return rc;
+}
+
+        // Commits the cached group if its oldest record has waited commit_ms by now_ms
+int Store_Commit_Due(store_t* store, uint64_t now_ms)
+{
+    if (!store || store->fd < 0) return -1;
+
+    Store_Lock(store);
+    int rc = 0;
+    if (store->committed < store->tail && now_ms - store->pending_since_ms >= store->commit_ms) {
+        rc = Store_Commit_Locked(store);
+    }
+    Store_Unlock(store);
+    return rc;
+}
+
+        // When Store_Commit_Due() has work, UINT64_MAX while nothing waits in the cache
+uint64_t Store_Commit_Deadline(const store_t* store)
+{
+    if (!store) return UINT64_MAX;
+
+    Store_Lock(store);
+    uint64_t deadline = store->committed < store->tail ? store->pending_since_ms + store->commit_ms : UINT64_MAX;
+    Store_Unlock(store);
+    return deadline;
+}
+
+        // Retention: forgets up to max of the oldest records for as long as expired() says so
+        // (NULL: all of them). Corrupt records go too - they can never be sent. Like an ack,
+        // only memory changes until Store_Sync(). Refused while an upload holds records, as
+        // those are acked by count from the head. Returns the records dropped, -1 while busy.
+int Store_Drop_Oldest(store_t* store, uint32_t max, int (*expired)(const store_view_t*, void*), void* context)
+{
+    if (!store || store->fd < 0) return -1;
+
+    Store_Lock(store);
+    if (store->cursor != store->head) {
+        Store_Unlock(store);
+        return -1;
+    }
+
+    uint32_t count = 0;
+    store_view_t view;
+    while (count < max && count < Store_Used(store))
+    {
+        if (expired && Store_View_Locked(store, count, &view) == 0 && !expired(&view, context)) break;
+        count++;
+    }
+    store->head += count;
+    store->cursor = store->head;
+    if (store->committed < store->head) {
+        store->committed = store->head;
+        store->gap = 1;
+    }
+    if (count > 0) store->dirty = 1;
+    Store_Unlock(store);
+    return (int)count;
+}
+
+        // Retention: downsamples the oldest window records on disk. keep() picks the ones to stay;
+        // they move, renumbered and in order, into the last slots of the window with one write
+        // (two when the window wraps the ring) and the head moves past the rest. Kept records
+        // only ever move to newer slots, so a crash before the header follows leaves the old
+        // head and at worst some readings twice - none lost. scratch holds the kept slots.
+        // Returns the records removed, -1 while an upload holds records or the write failed.
+int Store_Thin_Oldest(store_t* store, uint32_t window, int (*keep)(const store_view_t*, void*), void* context,
+                      char* scratch, size_t scratch_size)
+{
+    if (!store || store->fd < 0 || !keep || !scratch) return -1;
+
+    Store_Lock(store);
+    if (store->cursor != store->head) {
+        Store_Unlock(store);
+        return -1;
+    }
+
+    // The cache holds the newest records - they stay as they are
+    if (window > store->committed - store->head) window = (uint32_t)(store->committed - store->head);
+    if (window > scratch_size / store->slot_size) window = (uint32_t)(scratch_size / store->slot_size);
+
+    uint32_t kept = 0;
+    store_view_t view;
+    for (uint32_t i = 0; i < window; i++)
+    {
+        if (Store_View_Locked(store, i, &view) == 0 && keep(&view, context)) {
+            memcpy(scratch + (size_t)kept * store->slot_size, Store_Record_Slot(store, view.seq), store->slot_size);
+            kept++;
+        }
+    }
+    uint32_t removed = window - kept;
+    if (removed == 0) {
+        Store_Unlock(store);
+        return 0;
+    }
+
+    uint64_t first = store->head + removed;
+    for (uint32_t k = 0; k < kept; k++)
+    {
+        char* slot = scratch + (size_t)k * store->slot_size;
+        store_record_t record;
+        memcpy(&record, slot, sizeof(record));
+        record.seq = first + k;
+        record.crc = Store_Record_Crc(&record, slot + sizeof(record));
+        memcpy(slot, &record, sizeof(record));
+    }
+
+    // Up to the end of the file, then on from its first slot
+    int rc = 0;
+    for (uint32_t k = 0; k < kept && rc == 0; )
+    {
+        uint64_t seq = first + k;
+        uint32_t run = (uint32_t)(store->capacity - seq % store->capacity);
+        if (run > kept - k) run = kept - k;
+
+        size_t bytes = (size_t)run * store->slot_size;
+        if (pwrite(store->fd, scratch + (size_t)k * store->slot_size, bytes, Store_Slot_Offset(store, seq)) != (ssize_t)bytes) {
+            rc = -1;
+        }
+        k += run;
+    }
+    if (rc == 0 && store->durability != STORE_DURABILITY_WRITE && fdatasync(store->fd) < 0) {
+        rc = -1;
+    }
+    if (rc < 0) {
+        LOG_ERROR("ev=backlog_thin_failed records=%u", kept);
+        Store_Unlock(store);
+        return -1;
+    }
+
+    store->head = first;
+    store->cursor = first;
+    store->dirty = 1;
+    Store_Unlock(store);
+    return (int)removed;
+}
+
+uint32_t Store_Count(const store_t* store)
+{
+    if (!store) return 0;
+
+    Store_Lock(store);
+    uint32_t count = Store_Used(store);
+    Store_Unlock(store);
+    return count;
+}
+
+void Store_Close(store_t* store)
+{
+    if (store && store->fd >= 0 && store->cache) {
+        Store_Commit(store);
+        Store_Sync(store);
+    }
+    if (store) {
+        Arena_Free(&store->cache_arena);
+        store->cache = NULL;
+    }
+    if (store && store->map) {
+        munmap((void*)store->map, store->map_size);
+        store->map = NULL;
+    }
+    if (store && store->fd >= 0) {
+        close(store->fd);
+        store->fd = -1;
+    }
+}
@@ -1,99 +1,568 @@
-#define _POSIX_C_SOURCE 200112L
+#define _GNU_SOURCE     // getaddrinfo_a()
 #include "../include/tcp.h"
+#include "../include/metrics.h"
+#include "../include/log.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
 
-int Tcp_Init(const char* hostname, int port)
+static tcp_conn_t tcp_pool[TCP_POOL_SIZE];
+
+void Tcp_Close(int sockfd)
+{
+    if (sockfd > 0) {
+        close(sockfd);
+        LOG_DEBUG("ev=socket_closed fd=%d", sockfd);
+    }
+}
+
+        // Returns the pooled connection for host:port, claiming a free slot on first use
+tcp_conn_t* Tcp_Pool_Get(const char* hostname, int port)
+{
+    tcp_conn_t* free_slot = NULL;
+
+    for (int i = 0; i < TCP_POOL_SIZE; i++)
+    {
+        tcp_conn_t* conn = &tcp_pool[i];
+        if (!conn->in_use) {
+            if (!free_slot) free_slot = conn;
+            continue;
+        }
+        if (conn->port == port && strcmp(conn->hostname, hostname) == 0) {
+            return conn;
+        }
+    }
+
+    if (!free_slot) {
+        LOG_ERROR("ev=pool_full max=%d", TCP_POOL_SIZE);
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    snprintf(free_slot->hostname, sizeof(free_slot->hostname), "%s", hostname);
+    free_slot->port = port;
+    free_slot->sockfd = -1;
+    free_slot->in_use = 1;
+    return free_slot;
+}
+
+        // A kept-alive socket is usable only if the server has not closed it or sent unexpected data
+static int Tcp_Conn_Alive(int sockfd)
+{
+    char probe;
+    int n = recv(sockfd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 1;
+    }
+    return 0;   // 0 = FIN received (half-closed), >0 = stray bytes, <0 = socket error
+}
+
+/* ---- Resolver cache: getaddrinfo_a() lookups with a TTL and last-good fallback ---- */
+
+typedef struct {
+    char hostname[TCP_HOST_MAX];
+    int port;
+    int in_use;
+
+    tcp_addr_t addrs[TCP_ADDR_MAX];   // Last good answer, kept when a refresh fails
+    int count;
+    uint64_t refresh_at;              // Look the host up again from here on (ms), 0 = now
+
+    int in_progress;                  // getaddrinfo_a() running in the background
+    int released;                     // Tcp_Pool_Release() gave it up mid-lookup - freed once the lookup ends
+    char port_str[8];
+    struct addrinfo hints;
+    struct gaicb request;
+} tcp_dns_entry_t;
+
+static tcp_dns_entry_t dns_cache[TCP_POOL_SIZE];
+static int dns_wake_fd = -1;          // Signalled when a lookup ends, -1 = lookups are polled
+
+static void Tcp_Dns_Poll(tcp_dns_entry_t* entry, uint64_t now_ms);
+
+static tcp_dns_entry_t* Tcp_Dns_Entry(const char* hostname, int port)
+{
+    tcp_dns_entry_t* free_entry = NULL;
+
+    for (int i = 0; i < TCP_POOL_SIZE; i++)
+    {
+        tcp_dns_entry_t* entry = &dns_cache[i];
+        if (entry->in_use && entry->released) {
+            Tcp_Dns_Poll(entry, 0);      // Frees it if its lookup is over
+        }
+        if (!entry->in_use) {
+            if (!free_entry) free_entry = entry;
+            continue;
+        }
+        if (entry->port == port && strcmp(entry->hostname, hostname) == 0) {
+            entry->released = 0;         // Wanted again before its lookup ended
+            return entry;
+        }
+    }
+
+    if (!free_entry) {
+        LOG_ERROR("ev=resolver_cache_full max=%d", TCP_POOL_SIZE);
+        return NULL;
+    }
+
+    memset(free_entry, 0, sizeof(*free_entry));
+    snprintf(free_entry->hostname, sizeof(free_entry->hostname), "%s", hostname);
+    free_entry->port = port;
+    free_entry->in_use = 1;
+    return free_entry;
+}
+
+        // Keeps up to TCP_ADDR_MAX addresses, alternating families in the order the
+        // resolver preferred them (RFC 8305): v6, v4, v6, ... or v4, v6, v4, ...
+static void Tcp_Dns_Store(tcp_dns_entry_t* entry, const struct addrinfo* res)
+{
+    const struct addrinfo* by_family[2][TCP_ADDR_MAX];
+    int counts[2] = {0, 0};
+    int first_family = res ? res->ai_family : AF_INET;
+
+    for (const struct addrinfo* ai = res; ai; ai = ai->ai_next)
+    {
+        int slot = ai->ai_family == first_family ? 0 : 1;
+        if (counts[slot] < TCP_ADDR_MAX && ai->ai_addrlen <= sizeof(struct sockaddr_storage)) {
+            by_family[slot][counts[slot]++] = ai;
+        }
+    }
+
+    entry->count = 0;
+    for (int i = 0; i < TCP_ADDR_MAX && entry->count < TCP_ADDR_MAX; i++)
+    {
+        for (int slot = 0; slot < 2 && entry->count < TCP_ADDR_MAX; slot++)
+        {
+            if (i >= counts[slot]) continue;
+            tcp_addr_t* addr = &entry->addrs[entry->count++];
+            memcpy(&addr->addr, by_family[slot][i]->ai_addr, by_family[slot][i]->ai_addrlen);
+            addr->addr_len = by_family[slot][i]->ai_addrlen;
+        }
+    }
+}
+
+static void Tcp_Dns_Notify(union sigval value)
+{
+    uint64_t one = 1;
+    if (write(value.sival_int, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("ev=lookup_signal_failed errno=%d", errno);
+    }
+}
+
+static int Tcp_Dns_Start(tcp_dns_entry_t* entry, uint64_t now_ms)
 {
-    struct addrinfo hints = {0};
+    snprintf(entry->port_str, sizeof(entry->port_str), "%d", entry->port);
+    memset(&entry->hints, 0, sizeof(entry->hints));
+    entry->hints.ai_family = AF_UNSPEC;
+    entry->hints.ai_socktype = SOCK_STREAM;
+    entry->hints.ai_protocol = IPPROTO_TCP;
+
+    // Literal addresses (a local stand-in server) need no lookup and never expire
     struct addrinfo* res = NULL;
-    char port_str[10];
+    entry->hints.ai_flags = AI_NUMERICHOST;
+    if (getaddrinfo(entry->hostname, entry->port_str, &entry->hints, &res) == 0) {
+        Tcp_Dns_Store(entry, res);
+        freeaddrinfo(res);
+        entry->refresh_at = UINT64_MAX;
+        return 0;
+    }
+    entry->hints.ai_flags = 0;
+
+    memset(&entry->request, 0, sizeof(entry->request));
+    entry->request.ar_name = entry->hostname;
+    entry->request.ar_service = entry->port_str;
+    entry->request.ar_request = &entry->hints;
 
-    memset(&hints, 0, sizeof(hints));
-    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (dns_wake_fd < 0) {
+        dns_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
 
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
+    // The end of the lookup signals dns_wake_fd from a resolver thread; the result is still
+    // picked up with gai_error() on the main loop
+    struct gaicb* list[1] = { &entry->request };
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = dns_wake_fd >= 0 ? SIGEV_THREAD : SIGEV_NONE;
+    sev.sigev_notify_function = Tcp_Dns_Notify;
+    sev.sigev_value.sival_int = dns_wake_fd;
 
-    if (getaddrinfo(hostname, port_str, &hints, &res) != 0) {
-        printf("getaddrinfo() failed\n");
+    if (getaddrinfo_a(GAI_NOWAIT, list, 1, &sev) != 0) {
+        LOG_WARN("ev=lookup_start_failed host=%s", entry->hostname);
+        entry->refresh_at = now_ms + TCP_DNS_RETRY_MS;
         return -1;
     }
+    entry->in_progress = 1;
+    return 0;
+}
+
+        // Picks up a finished background lookup without blocking
+static void Tcp_Dns_Poll(tcp_dns_entry_t* entry, uint64_t now_ms)
+{
+    if (!entry->in_progress) return;
+
+    // Emptied before asking, so a lookup ending after gai_error() still leaves it readable
+    uint64_t count;
+    if (dns_wake_fd >= 0 && read(dns_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("ev=lookup_drain_failed errno=%d", errno);
+    }
+
+    int status = gai_error(&entry->request);
+    if (status == EAI_INPROGRESS) return;
+
+    entry->in_progress = 0;
+    if (entry->released)
+    {
+        if (entry->request.ar_result) freeaddrinfo(entry->request.ar_result);
+        entry->request.ar_result = NULL;
+        entry->released = 0;
+        entry->in_use = 0;
+        return;
+    }
+    if (status == 0 && entry->request.ar_result)
+    {
+        Tcp_Dns_Store(entry, entry->request.ar_result);
+        entry->refresh_at = now_ms + TCP_DNS_TTL_MS - TCP_DNS_REFRESH_MS;
+        LOG_INFO("ev=resolved host=%s addresses=%d ttl_s=%d", entry->hostname, entry->count, TCP_DNS_TTL_MS / 1000);
+    }
+    else
+    {
+        entry->refresh_at = now_ms + TCP_DNS_RETRY_MS;
+        if (entry->count > 0) {
+            LOG_WARN("ev=lookup_failed host=%s error=\"%s\" action=keep_last", entry->hostname, gai_strerror(status));
+        } else {
+            LOG_WARN("ev=lookup_failed host=%s error=\"%s\"", entry->hostname, gai_strerror(status));
+        }
+    }
+    if (entry->request.ar_result) {
+        freeaddrinfo(entry->request.ar_result);
+        entry->request.ar_result = NULL;
+    }
+}
+
+        // Served from the cache; an answer close to expiry is refreshed in the background.
+        // Returns 1 when addresses are available (possibly the last good ones), 0 while
+        // the first lookup is still running, -1 if the host cannot be resolved.
+int Tcp_Conn_Resolve(tcp_conn_t* conn, uint64_t now_ms)
+{
+    if (!conn) return -1;
+
+    if (conn->sockfd >= 0) {
+        return 1;
+    }
+
+    tcp_dns_entry_t* entry = Tcp_Dns_Entry(conn->hostname, conn->port);
+    if (!entry) return -1;
+
+    Tcp_Dns_Poll(entry, now_ms);
+    if (!entry->in_progress && now_ms >= entry->refresh_at)
+    {
+        conn->lookups++;
+        if (Tcp_Dns_Start(entry, now_ms) == 0) {
+            Tcp_Dns_Poll(entry, now_ms);
+        }
+    }
 
-    int sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (entry->count > 0) return 1;
+    return entry->in_progress ? 0 : -1;
+}
+
+        // Readable once a background lookup has ended: watch it for EPOLLIN | EPOLLET while
+        // Tcp_Conn_Resolve() returns 0. -1 when lookups have to be polled.
+int Tcp_Dns_Wake_Fd(void)
+{
+    return dns_wake_fd;
+}
+
+        // A host that could not be reached may have moved - look it up on the next resolve
+static void Tcp_Dns_Invalidate(const tcp_conn_t* conn)
+{
+    tcp_dns_entry_t* entry = Tcp_Dns_Entry(conn->hostname, conn->port);
+    if (entry && entry->refresh_at != UINT64_MAX) {
+        entry->refresh_at = 0;
+    }
+}
+
+/* ---- Happy eyeballs connect ---- */
+
+static const char* Tcp_Family_Name(int family)
+{
+    return family == AF_INET6 ? "IPv6" : "IPv4";
+}
+
+static void Tcp_Attempt_Remove(tcp_conn_t* conn, int index, int close_fd)
+{
+    if (close_fd) close(conn->attempt_fds[index]);
+    conn->attempt_fds[index] = conn->attempt_fds[--conn->attempt_count];
+}
+
+        // The socket at attempt index won - everything else in flight is dropped
+static void Tcp_Attempt_Won(tcp_conn_t* conn, int index)
+{
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    local.ss_family = AF_UNSPEC;
+    getsockname(conn->attempt_fds[index], (struct sockaddr*)&local, &local_len);
+
+    conn->sockfd = conn->attempt_fds[index];
+    Tcp_Attempt_Remove(conn, index, 0);
+    while (conn->attempt_count > 0) {
+        Tcp_Attempt_Remove(conn, 0, 1);
+    }
+
+    conn->connecting = 0;
+    conn->next_attempt_at = 0;
+    conn->connects++;
+    Metrics_Time(METRIC_TCP_CONNECT, Metrics_Now_Us() - conn->connect_started_us);
+    conn->socket_requests = 0;
+    conn->pending = 0;
+    conn->rx_len = 0;
+    LOG_INFO("ev=connected host=%s port=%d family=%s", conn->hostname, conn->port, Tcp_Family_Name(local.ss_family));
+}
+
+        // Starts a handshake with the next candidate. Returns 1 if it connected at once,
+        // 0 when it is in flight, -1 if it could not be started.
+static int Tcp_Attempt_Start(tcp_conn_t* conn)
+{
+    const tcp_addr_t* addr = &conn->candidates[conn->next_candidate++];
+
+    int sockfd = socket(addr->addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
     if (sockfd < 0) {
-        printf("socket() failed\n");
-        freeaddrinfo(res);
+        LOG_ERROR("ev=socket_failed errno=%d", errno);
         return -1;
     }
-
-    if (connect(sockfd, res->ai_addr, res->ai_addrlen) < 0) {
-        printf("connect() failed\n");
+    if (fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        LOG_ERROR("ev=fcntl_failed errno=%d", errno);
         close(sockfd);
-        freeaddrinfo(res);
         return -1;
     }
 
-    struct timeval tv;
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        printf("setsockopt() failed\n");
-        close(sockfd);
-        freeaddrinfo(res);
-        return -1;
+    conn->attempt_fds[conn->attempt_count++] = sockfd;
+    if (connect(sockfd, (const struct sockaddr*)&addr->addr, addr->addr_len) == 0) {
+        Tcp_Attempt_Won(conn, conn->attempt_count - 1);
+        return 1;
+    }
+    if (errno == EINPROGRESS) {
+        return 0;
     }
 
-    printf("Connected to %s:%d\n", hostname, port);
-    freeaddrinfo(res);
-    return sockfd;
+    LOG_WARN("ev=connect_failed family=%s errno=%d", Tcp_Family_Name(addr->addr.ss_family), errno);
+    Tcp_Attempt_Remove(conn, conn->attempt_count - 1, 1);
+    return -1;
 }
 
-int Tcp_Send(int sockfd, const char* data, int length)
+        // Non-blocking connect, call again when a socket turns writable or at next_attempt_at.
+        // Returns 1 when the socket is ready for requests, 0 while handshakes are in flight,
+        // -1 if every candidate failed.
+int Tcp_Conn_Connect(tcp_conn_t* conn, uint64_t now_ms)
 {
-    if (sockfd < 0 || !data)
+    if (!conn) return -1;
+
+    if (conn->sockfd >= 0)
     {
-        return -1;
+        if (conn->pending > 0 || Tcp_Conn_Alive(conn->sockfd)) {
+            return 1;
+        }
+        LOG_INFO("ev=keepalive_closed host=%s action=reconnect", conn->hostname);
+        Tcp_Conn_Close(conn);
+        conn->reconnects++;
     }
 
-    int bytes_sent = send(sockfd, data, length, 0);
-    if (bytes_sent < 0)
+    if (!conn->connecting)
     {
-        printf("Send() failed\n");
-        return -1;
+        tcp_dns_entry_t* entry = Tcp_Dns_Entry(conn->hostname, conn->port);
+        if (!entry || entry->count == 0) {
+            return -1;
+        }
+        memcpy(conn->candidates, entry->addrs, entry->count * sizeof(tcp_addr_t));
+        conn->candidate_count = entry->count;
+        conn->next_candidate = 0;
+        conn->attempt_count = 0;
+        conn->next_attempt_at = now_ms;
+        conn->connect_started_us = Metrics_Now_Us();
+        conn->connecting = 1;
+    }
 
-    } else
+    // Harvest finished handshakes
+    if (conn->attempt_count > 0)
     {
-    printf("Send() %d bytes:\n%s\n", bytes_sent, data);
-    return bytes_sent;
+        struct pollfd pfds[TCP_ADDR_MAX];
+        for (int i = 0; i < conn->attempt_count; i++) {
+            pfds[i].fd = conn->attempt_fds[i];
+            pfds[i].events = POLLOUT;
+            pfds[i].revents = 0;
+        }
+
+        if (poll(pfds, conn->attempt_count, 0) > 0)
+        {
+            for (int i = conn->attempt_count - 1; i >= 0; i--)
+            {
+                if (!pfds[i].revents) continue;
+
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+                    Tcp_Attempt_Won(conn, i);
+                    return 1;
+                }
+                LOG_WARN("ev=connect_failed error=\"%s\"", strerror(error));
+                Tcp_Attempt_Remove(conn, i, 1);
+                conn->next_attempt_at = now_ms;     // A refused candidate hands over at once
+            }
+        }
     }
+
+    // Start the next candidate when its head start is over or nothing else is in flight
+    while (conn->next_candidate < conn->candidate_count &&
+           (conn->attempt_count == 0 || now_ms >= conn->next_attempt_at))
+    {
+        int started = Tcp_Attempt_Start(conn);
+        if (started > 0) return 1;
+        if (started == 0) {
+            conn->next_attempt_at = now_ms + TCP_ATTEMPT_DELAY_MS;
+            break;
+        }
+    }
+    if (conn->next_candidate >= conn->candidate_count) {
+        conn->next_attempt_at = 0;
+    }
+
+    if (conn->attempt_count == 0)
+    {
+        LOG_WARN("ev=connect_failed host=%s addresses=%d", conn->hostname, conn->candidate_count);
+        conn->connecting = 0;
+        Tcp_Dns_Invalidate(conn);
+        return -1;
+    }
+    return 0;
 }
 
-int Tcp_Recv(int sockfd, char* buffer, int buffer_size)
+        // Sockets the caller should wait on: the handshakes in flight, or the open socket
+int Tcp_Conn_Wait_Fds(const tcp_conn_t* conn, int* fds, int max)
 {
-    if (sockfd < 0 || !buffer) {
-    return -1;
+    int count = 0;
+    if (!conn) return 0;
+
+    if (conn->connecting) {
+        for (int i = 0; i < conn->attempt_count && count < max; i++) {
+            fds[count++] = conn->attempt_fds[i];
+        }
+    } else if (conn->sockfd >= 0 && max > 0) {
+        fds[count++] = conn->sockfd;
     }
+    return count;
+}
+
+        // Gathers iov into one sendmsg() and writes what the socket takes right now.
+        // Returns bytes written (0 = would block), or -1 on error. more tells the
+        // kernel further data follows, so it does not send a partial segment.
+int Tcp_Conn_Writev(tcp_conn_t* conn, const struct iovec* iov, int count, int more)
+{
+    if (!conn || conn->sockfd < 0) return -1;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec*)iov;
+    msg.msg_iovlen = count;
+
+    while (1)
+    {
+        uint64_t started = Metrics_Now_Us();
+        ssize_t n = sendmsg(conn->sockfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        Metrics_Time(METRIC_TCP_SEND, Metrics_Now_Us() - started);
+        if (n >= 0) {
+            Metrics_Count(METRIC_TX_BYTES, (uint64_t)n);
+            return (int)n;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        return -1;
+    }
+}
+
+        // Appends whatever has arrived to rx_buf. Returns bytes read, 0 if nothing is
+        // available yet, -1 when the peer closed or the socket failed.
+int Tcp_Conn_Read(tcp_conn_t* conn)
+{
+    if (!conn || conn->sockfd < 0 || conn->rx_len >= TCP_RX_SIZE) return -1;
 
-    int bytes_received = recv(sockfd, buffer, buffer_size -1, 0);
-    if (bytes_received < 0) {
-        printf("recv() failed\n");
+    while (1)
+    {
+        uint64_t started = Metrics_Now_Us();
+        ssize_t n = recv(conn->sockfd, conn->rx_buf + conn->rx_len, TCP_RX_SIZE - conn->rx_len, MSG_DONTWAIT);
+        Metrics_Time(METRIC_TCP_RECV, Metrics_Now_Us() - started);
+        if (n > 0) {
+            Metrics_Count(METRIC_RX_BYTES, (uint64_t)n);
+            conn->rx_len += n;
+            conn->rx_buf[conn->rx_len] = '\0';
+            return (int)n;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
         return -1;
     }
+}
+
+void Tcp_Conn_Close(tcp_conn_t* conn)
+{
+    if (!conn) return;
+
+    if (conn->connecting)
+    {
+        // Gave up mid-handshake - the address may have moved
+        while (conn->attempt_count > 0) {
+            Tcp_Attempt_Remove(conn, 0, 1);
+        }
+        conn->connecting = 0;
+        conn->next_attempt_at = 0;
+        Tcp_Dns_Invalidate(conn);
+    }
 
-    buffer[bytes_received] = '\0';
-    printf("Recv() %d bytes\n", bytes_received);
-     
-    return bytes_received;
+    if (conn->sockfd >= 0) {
+        Tcp_Close(conn->sockfd);
+        conn->sockfd = -1;
+        conn->socket_requests = 0;
+        conn->pending = 0;
+        conn->rx_len = 0;
+    }
 }
 
-void Tcp_Close(int sockfd)
+        // Gives a host's pool slot and resolver entry back, e.g. after the server moved.
+        // A lookup still running is cancelled; its entry is freed by the next resolve once
+        // the resolver is done with it.
+void Tcp_Pool_Release(tcp_conn_t* conn)
 {
-    if (sockfd > 0) {
-        close(sockfd);
-        printf("connection close() fd: %d\n", sockfd);
+    if (!conn || !conn->in_use) return;
+
+    Tcp_Conn_Close(conn);
+    for (int i = 0; i < TCP_POOL_SIZE; i++)
+    {
+        tcp_dns_entry_t* entry = &dns_cache[i];
+        if (!entry->in_use || entry->port != conn->port || strcmp(entry->hostname, conn->hostname) != 0) {
+            continue;
+        }
+        if (entry->in_progress) {
+            gai_cancel(&entry->request);
+            entry->released = 1;
+        }
+        else {
+            entry->in_use = 0;
+        }
     }
-}
\ No newline at end of file
+    conn->in_use = 0;
+}
+
+void Tcp_Conn_Print_Stats(const tcp_conn_t* conn)
+{
+    if (!conn) return;
+
+    double ratio = conn->requests ? 100.0 * conn->reuses / conn->requests : 0.0;
+    LOG_DEBUG("ev=connection_stats host=%s port=%d requests=%lu handshakes=%lu reused=%lu reuse_pct=%.0f reconnects=%lu lookups=%lu",
+              conn->hostname, conn->port, conn->requests, conn->connects, conn->reuses, ratio,
+              conn->reconnects, conn->lookups);
+}
@@ -0,0 +1,209 @@
+#include "../include/wheel.h"
+#include <string.h>
+
+#define WHEEL_SLOT_MASK ((uint64_t)WHEEL_SLOTS - 1)
+
+void Wheel_Init(wheel_t* wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+void Wheel_Timer_Init(wheel_timer_t* timer, wheel_fire_t fire, void* context)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->level = WHEEL_LIST_NONE;
+    timer->fire = fire;
+    timer->context = context;
+}
+
+static void Wheel_Push(wheel_timer_t** head, wheel_timer_t* timer)
+{
+    timer->next = *head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+}
+
+        // Files the timer relative to wheel->now: due already, in a level, or beyond the top one
+static void Wheel_Insert(wheel_t* wheel, wheel_timer_t* timer)
+{
+    if (timer->deadline <= wheel->now) {
+        timer->level = WHEEL_LIST_EXPIRED;
+        Wheel_Push(&wheel->expired, timer);
+        return;
+    }
+
+    // The highest bit in which deadline and now differ picks the level
+    int level = (63 - __builtin_clzll(timer->deadline ^ wheel->now)) / WHEEL_BITS;
+    if (level >= WHEEL_LEVELS) {
+        timer->level = WHEEL_LIST_OVERFLOW;
+        Wheel_Push(&wheel->overflow, timer);
+        return;
+    }
+
+    int slot = (int)((timer->deadline >> (level * WHEEL_BITS)) & WHEEL_SLOT_MASK);
+    timer->level = (int8_t)level;
+    timer->slot = (uint8_t)slot;
+    wheel->occupied[level] |= 1ULL << slot;
+    Wheel_Push(&wheel->slots[level][slot], timer);
+}
+
+static void Wheel_Unlink(wheel_t* wheel, wheel_timer_t* timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    if (timer->level >= 0 && !wheel->slots[timer->level][timer->slot]) {
+        wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->level = WHEEL_LIST_NONE;
+}
+
+        // O(1). Re-arming moves the timer; a deadline that has passed fires on the next advance.
+void Wheel_Arm(wheel_t* wheel, wheel_timer_t* timer, uint64_t deadline)
+{
+    if (timer->level != WHEEL_LIST_NONE) {
+        Wheel_Unlink(wheel, timer);
+        wheel->count--;
+    }
+    timer->deadline = deadline;
+    timer->fired = 0;
+    Wheel_Insert(wheel, timer);
+    wheel->count++;
+}
+
+        // O(1), and harmless for a timer that is not armed
+void Wheel_Cancel(wheel_t* wheel, wheel_timer_t* timer)
+{
+    if (timer->level != WHEEL_LIST_NONE) {
+        Wheel_Unlink(wheel, timer);
+        wheel->count--;
+    }
+    timer->fired = 0;
+}
+
+int Wheel_Armed(const wheel_timer_t* timer)
+{
+    return timer->level != WHEEL_LIST_NONE;
+}
+
+        // Next time the wheel has work: a timer firing or a slot moving down a level
+static uint64_t Wheel_Next_Slot(const wheel_t* wheel)
+{
+    // Every level holds later times than the one below it, so the lowest non-empty level decides
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        int shift = level * WHEEL_BITS;
+        uint64_t current = (wheel->now >> shift) & WHEEL_SLOT_MASK;
+        uint64_t later = current == WHEEL_SLOT_MASK ? 0 : wheel->occupied[level] & (~0ULL << (current + 1));
+        if (later) {
+            uint64_t block = (wheel->now >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+            return block | ((uint64_t)__builtin_ctzll(later) << shift);
+        }
+    }
+    if (wheel->overflow) {
+        return ((wheel->now >> WHEEL_SPAN_BITS) + 1) << WHEEL_SPAN_BITS;
+    }
+    return UINT64_MAX;
+}
+
+static uint64_t Wheel_Earliest(const wheel_timer_t* timer)
+{
+    uint64_t earliest = UINT64_MAX;
+    for (; timer; timer = timer->next) {
+        if (timer->deadline < earliest) earliest = timer->deadline;
+    }
+    return earliest;
+}
+
+        // Earliest deadline armed, UINT64_MAX with nothing armed. The first occupied slot holds
+        // it; a higher-level slot is searched so the caller sleeps through its cascades.
+uint64_t Wheel_Next(const wheel_t* wheel)
+{
+    if (wheel->expired) {
+        return wheel->now;
+    }
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        uint64_t current = (wheel->now >> (level * WHEEL_BITS)) & WHEEL_SLOT_MASK;
+        uint64_t later = current == WHEEL_SLOT_MASK ? 0 : wheel->occupied[level] & (~0ULL << (current + 1));
+        if (later) {
+            return Wheel_Earliest(wheel->slots[level][__builtin_ctzll(later)]);
+        }
+    }
+    return Wheel_Earliest(wheel->overflow);
+}
+
+static void Wheel_Refile(wheel_t* wheel, wheel_timer_t** head)
+{
+    wheel_timer_t* timer = *head;
+    *head = NULL;
+    while (timer) {
+        wheel_timer_t* next = timer->next;
+        Wheel_Insert(wheel, timer);
+        timer = next;
+    }
+}
+
+        // wheel->now just reached a slot boundary: re-file the slots that start here, top
+        // level first so a timer can fall through several levels in one step
+static void Wheel_Cascade(wheel_t* wheel)
+{
+    if (wheel->overflow && (wheel->now & ((1ULL << WHEEL_SPAN_BITS) - 1)) == 0) {
+        Wheel_Refile(wheel, &wheel->overflow);
+    }
+    for (int level = WHEEL_LEVELS - 1; level >= 0; level--)
+    {
+        int shift = level * WHEEL_BITS;
+        if (wheel->now & ((1ULL << shift) - 1)) continue;
+
+        int slot = (int)((wheel->now >> shift) & WHEEL_SLOT_MASK);
+        if (wheel->occupied[level] & (1ULL << slot)) {
+            wheel->occupied[level] &= ~(1ULL << slot);
+            Wheel_Refile(wheel, &wheel->slots[level][slot]);
+        }
+    }
+}
+
+        // Moves the wheel to now and fires every timer due by then. A callback may arm or
+        // cancel any timer; one armed for a time already passed fires on the next advance.
+        // Returns how many fired.
+int Wheel_Advance(wheel_t* wheel, uint64_t now)
+{
+    while (1) {
+        uint64_t next = Wheel_Next_Slot(wheel);
+        if (next > now) break;
+        wheel->now = next;
+        Wheel_Cascade(wheel);
+    }
+    if (now > wheel->now) {
+        wheel->now = now;
+    }
+
+    // Fire from a detached list so timers armed by the callbacks wait for the next advance
+    wheel->firing = wheel->expired;
+    wheel->expired = NULL;
+    if (wheel->firing) {
+        wheel->firing->pprev = &wheel->firing;
+    }
+
+    int fired = 0;
+    while (wheel->firing)
+    {
+        wheel_timer_t* timer = wheel->firing;
+        Wheel_Unlink(wheel, timer);
+        wheel->count--;
+        timer->fired = 1;
+        fired++;
+        if (timer->fire) {
+            timer->fire(timer, wheel->now);
+        }
+    }
+    return fired;
+}